@@ -0,0 +1,264 @@
+#include "analysis.h"
+#include "potential.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+static const double ANGSTROM = 1e-10;
+
+// "gofr.dat" + "_AU_CTL2" = "gofr_AU_CTL2.dat"
+static std::string withSuffix(const std::string& path, const std::string& suffix)
+{
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return path + suffix;
+	return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+static bool canCreate(const std::string& path)
+{
+	std::ofstream file(path);
+	if (!file) {
+		std::cout << "ERROR: cannot open " << path << " for writing" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool StructureAnalysis::setup(const RunOptions& options, const ParticleSystem& ps)
+{
+	gofrFile = options.gofrFile;
+	densityFile = options.densityFile;
+	if (!active()) return true;
+	if (options.analysisFreq <= 0) {
+		std::cout << "ERROR: analysisfreq must be positive when gofrfile or densityfile is set" << std::endl;
+		return false;
+	}
+
+	types = 1;
+	typeNames.clear();
+	if (pairTable != nullptr && pairTable->types > 1) {
+		types = pairTable->types;
+		typeNames = pairTable->names;
+	}
+	typeCount.assign(types, 0);
+	for (int i = 0; i < ps.n; ++i) typeCount[types > 1 ? ps.type[i] : 0]++;
+	samples = 0;
+	const int T = threadCount();
+
+	if (!gofrFile.empty()) {
+		// Every pair closer than the cutoff is in the neighbor list, and the minimum image
+		// distance is only complete up to half the box
+		const double limit = std::min(rCut, 0.5 * std::min(std::min(LW, LH), dimensions == 3 ? LD : LH));
+		double range = options.gofrMax > 0.0 ? options.gofrMax : limit;
+		if (range > limit * (1.0 + 1e-12)) {
+			std::cout << "ERROR: gofrmax " << range / ANGSTROM << " is beyond the cutoff or half the box, "
+				<< limit / ANGSTROM << " A" << std::endl;
+			return false;
+		}
+		if (options.gofrDelta <= 0.0 || options.gofrDelta > range) {
+			std::cout << "ERROR: gofrdelta must be positive and at most the g(r) range" << std::endl;
+			return false;
+		}
+		gofrDelta = options.gofrDelta;
+		gofrBins = std::max(1, (int)(range / gofrDelta + 1e-9));
+		gofrCounts.assign(T, std::vector<long long>((size_t)types * types * gofrBins, 0));
+		if (!canCreate(gofrFile)) return false;
+		std::cout << "Info: GOFR FILENAME          " << gofrFile << ", " << gofrBins << " bins of "
+			<< gofrDelta / ANGSTROM << " A" << (types > 1 ? ", and one file per type pair" : "") << std::endl;
+	}
+
+	if (!densityFile.empty()) {
+		densityAxis = options.densityAxis;
+		if (densityAxis >= dimensions) {
+			std::cout << "ERROR: densityaxis z needs a 3D system" << std::endl;
+			return false;
+		}
+		const double L[3] = { LW, LH, LD };
+		densityLength = L[densityAxis];
+		if (options.densityDelta <= 0.0) {
+			std::cout << "ERROR: densitydelta must be positive" << std::endl;
+			return false;
+		}
+		// The bins tile the box exactly, so the width is rounded to a divisor of its length
+		densityBins = std::max(1, (int)std::lround(densityLength / options.densityDelta));
+		densityDelta = densityLength / densityBins;
+		// The cross section of the box, or in 2D its other side times layerthickness
+		double section = densityAxis == 0 ? LH : LW;
+		if (dimensions == 3) section = L[0] * L[1] * L[2] / densityLength;
+		else section *= options.layerThickness;
+		binVolume = densityDelta * section / (ANGSTROM * ANGSTROM * ANGSTROM);
+		// Row 0 is every particle, row 1 + t the particles of type t
+		densityCounts.assign(T, std::vector<int>((size_t)(types + 1) * densityBins, 0));
+		densitySum.assign((size_t)(types + 1) * densityBins, 0.0);
+		densitySumSq.assign(densitySum.size(), 0.0);
+		if (!canCreate(densityFile)) return false;
+		std::cout << "Info: DENSITY FILENAME       " << densityFile << ", " << densityBins << " bins of "
+			<< densityDelta / ANGSTROM << " A along " << "xyz"[densityAxis]
+			<< (types > 1 ? ", and one file per type" : "") << std::endl;
+	}
+	std::cout << "Info: ANALYSIS FREQUENCY     " << options.analysisFreq << std::endl;
+	return true;
+}
+
+void StructureAnalysis::sample(const ParticleSystem& ps, const NeighborList& nl)
+{
+	if (!gofrFile.empty()) sampleGofr(ps, nl);
+	if (!densityFile.empty()) sampleDensity(ps);
+	samples++;
+}
+
+void StructureAnalysis::sampleGofr(const ParticleSystem& ps, const NeighborList& nl)
+{
+	ThreadPool& tp = threadPool();
+	const int T = tp.size();
+	if ((int)gofrCounts.size() < T) gofrCounts.resize(T, std::vector<long long>(gofrCounts[0].size(), 0));
+	const double range2 = (gofrBins * gofrDelta) * (gofrBins * gofrDelta);
+	const double invDelta = 1.0 / gofrDelta;
+	const int* offsets = nl.offsets.data();
+	const int* neighbors = nl.neighbors.data();
+	const bool threeD = dimensions == 3;
+	tp.run([&](int t) {
+		long long* counts = gofrCounts[t].data();
+		int begin, end;
+		splitRange(ps.n, T, t, begin, end);
+		for (int i = begin; i < end; ++i) {
+			const int ti = types > 1 ? ps.type[i] : 0;
+			for (int k = offsets[i]; k < offsets[i + 1]; ++k) {
+				const int j = neighbors[k];
+				double dx = ps.x[j] - ps.x[i];
+				double dy = ps.y[j] - ps.y[i];
+				dx -= LW * std::round(dx / LW);
+				dy -= LH * std::round(dy / LH);
+				double r2 = dx * dx + dy * dy;
+				if (threeD) {
+					double dz = ps.z[j] - ps.z[i];
+					dz -= LD * std::round(dz / LD);
+					r2 += dz * dz;
+				}
+				if (r2 >= range2) continue;
+				const int bin = std::min(gofrBins - 1, (int)(std::sqrt(r2) * invDelta));
+				const int tj = types > 1 ? ps.type[j] : 0;
+				counts[(size_t)(std::min(ti, tj) * types + std::max(ti, tj)) * gofrBins + bin]++;
+			}
+		}
+	});
+}
+
+void StructureAnalysis::sampleDensity(const ParticleSystem& ps)
+{
+	ThreadPool& tp = threadPool();
+	const int T = tp.size();
+	if ((int)densityCounts.size() < T) densityCounts.resize(T, std::vector<int>(densitySum.size(), 0));
+	const std::vector<double>& coord = ps.position(densityAxis);
+	const double invDelta = 1.0 / densityDelta;
+	tp.run([&](int t) {
+		std::vector<int>& counts = densityCounts[t];
+		std::fill(counts.begin(), counts.end(), 0);
+		int begin, end;
+		splitRange(ps.n, T, t, begin, end);
+		for (int i = begin; i < end; ++i) {
+			const int bin = std::min(densityBins - 1, std::max(0, (int)std::floor((coord[i] + 0.5 * densityLength) * invDelta)));
+			counts[bin]++;
+			if (types > 1) counts[(size_t)(1 + ps.type[i]) * densityBins + bin]++;
+		}
+	});
+	// The mean and spread need the density of each sample, so the threads are merged here
+	for (size_t b = 0; b < densitySum.size(); ++b) {
+		int count = 0;
+		for (int t = 0; t < T; ++t) count += densityCounts[t][b];
+		const double density = count / binVolume;
+		densitySum[b] += density;
+		densitySumSq[b] += density * density;
+	}
+}
+
+void StructureAnalysis::write(const ParticleSystem& ps) const
+{
+	if (samples == 0) {
+		if (active()) std::cout << "Warning: no structure samples were taken, analysis files not written" << std::endl;
+		return;
+	}
+	if (!gofrFile.empty()) {
+		const size_t perPair = gofrBins;
+		std::vector<long long> total(perPair, 0);
+		std::vector<long long> merged((size_t)types * types * perPair, 0);
+		for (const std::vector<long long>& counts : gofrCounts) {
+			for (size_t k = 0; k < merged.size(); ++k) merged[k] += counts[k];
+		}
+		for (size_t k = 0; k < merged.size(); ++k) total[k % perPair] += merged[k];
+		const double n = ps.n;
+		bool ok = writeGofr(gofrFile, total, 0.5 * n * (n - 1.0), 2.0 / n);
+		for (int a = 0; a < types && types > 1; ++a) {
+			for (int b = a; b < types; ++b) {
+				std::vector<long long> pair(merged.begin() + (a * types + b) * perPair, merged.begin() + (a * types + b + 1) * perPair);
+				const double na = typeCount[a], nb = typeCount[b];
+				// Coordination counts type b around a particle of type a
+				double pairs = a == b ? 0.5 * na * (na - 1.0) : na * nb;
+				ok &= writeGofr(withSuffix(gofrFile, "_" + typeNames[a] + "_" + typeNames[b]), pair, pairs,
+					a == b ? 2.0 / na : 1.0 / na);
+			}
+		}
+		if (ok) std::cout << "Info: Wrote g(r) of " << samples << " samples to " << gofrFile << std::endl;
+	}
+	if (!densityFile.empty()) {
+		bool ok = writeDensity(densityFile, 0);
+		for (int t = 0; t < types && types > 1; ++t) ok &= writeDensity(withSuffix(densityFile, "_" + typeNames[t]), 1 + t);
+		if (ok) std::cout << "Info: Wrote density profile of " << samples << " samples to " << densityFile << std::endl;
+	}
+}
+
+// Ideal-gas normalization: the expected count of a ring is pairs * ring area / box area in two
+// dimensions, and of a shell pairs * shell volume / box volume in three
+bool StructureAnalysis::writeGofr(const std::string& path, const std::vector<long long>& counts, double pairs, double neighborsPer) const
+{
+	std::ofstream out(path);
+	if (!out) {
+		std::cout << "ERROR: cannot open " << path << " for writing" << std::endl;
+		return false;
+	}
+	out << std::setprecision(12);
+	const double area = LW * LH;
+	double coordination = 0.0;
+	for (int bin = 0; bin < gofrBins; ++bin) {
+		const double r0 = bin * gofrDelta, r1 = (bin + 1) * gofrDelta;
+		const double ideal = dimensions == 3 ? pairs * 4.0 / 3.0 * PI * (r1 * r1 * r1 - r0 * r0 * r0) / (area * LD)
+			: pairs * PI * (r1 * r1 - r0 * r0) / area;
+		const double g = ideal > 0.0 ? counts[bin] / (samples * ideal) : 0.0;
+		coordination += counts[bin] * neighborsPer / samples;
+		out << (bin + 0.5) * gofrDelta / ANGSTROM << " " << g << " " << coordination << "\n";
+	}
+	if (!out) {
+		std::cout << "ERROR: failed to write " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Number density (particles per A^3; in 2D the area density over layerthickness) per bin, as the mean and
+// the mean plus and minus one standard deviation over the samples
+bool StructureAnalysis::writeDensity(const std::string& path, int row) const
+{
+	std::ofstream out(path);
+	if (!out) {
+		std::cout << "ERROR: cannot open " << path << " for writing" << std::endl;
+		return false;
+	}
+	out << std::setprecision(12);
+	for (int bin = 0; bin < densityBins; ++bin) {
+		const size_t k = (size_t)row * densityBins + bin;
+		const double mean = densitySum[k] / samples;
+		const double spread = std::sqrt(std::max(0.0, densitySumSq[k] / samples - mean * mean));
+		out << (-0.5 * densityLength + (bin + 0.5) * densityDelta) / ANGSTROM << " " << mean << " " << mean + spread
+			<< " " << mean - spread << "\n";
+	}
+	if (!out) {
+		std::cout << "ERROR: failed to write " << path << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,51 @@
+// STRUCTURE ANALYSIS
+// Radial distribution functions and density profiles accumulated while the system runs, from the
+// same neighbor list the force loop uses, so structure needs no trajectory on disk
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "md.h"
+#include "neighbor.h"
+
+class StructureAnalysis
+{
+public:
+	// Sizes the histograms for options.gofrFile and options.densityFile. Prints the reason and
+	// returns false on bad settings; does nothing when neither file is requested.
+	bool setup(const RunOptions& options, const ParticleSystem& ps);
+	bool active() const { return !gofrFile.empty() || !densityFile.empty(); }
+	// Adds the current configuration; nl must be up to date for ps
+	void sample(const ParticleSystem& ps, const NeighborList& nl);
+	// Merges the per-thread histograms and writes the .dat files: "r g(r) coordination" for g(r),
+	// as VMD's gofr, and "position mean mean+std mean-std" over the samples for the density
+	void write(const ParticleSystem& ps) const;
+
+private:
+	void sampleGofr(const ParticleSystem& ps, const NeighborList& nl);
+	void sampleDensity(const ParticleSystem& ps);
+	bool writeGofr(const std::string& path, const std::vector<long long>& counts, double pairs, double neighborsPer) const;
+	bool writeDensity(const std::string& path, int row) const;
+
+	int types = 1;
+	std::vector<std::string> typeNames; // From the pair table, empty for the built-in potential
+	std::vector<int> typeCount;         // Particles of each type
+	long long samples = 0;
+
+	// g(r): counts per unordered type pair (a <= b at a * types + b) and bin, one set per thread
+	std::string gofrFile;
+	int gofrBins = 0;
+	double gofrDelta = 0.0;
+	std::vector<std::vector<long long>> gofrCounts;
+
+	// Density: per-thread counts of the current sample, and the sums over samples per type and bin
+	std::string densityFile;
+	int densityAxis = 1;
+	int densityBins = 0;
+	double densityDelta = 0.0, densityLength = 0.0, binVolume = 0.0;
+	std::vector<std::vector<int>> densityCounts;
+	std::vector<double> densitySum, densitySumSq;
+};
@@ -0,0 +1,256 @@
+// MD KERNEL BENCHMARKS
+// Reproducible timings of the engine kernels, written as JSON so they can be compared across commits.
+//
+// Build (from FinalProject/):
+//   g++ -O2 -std=c++17 -DMD_HEADLESS -I. bench/bench.cpp $(ls *.cpp | grep -v main.cpp) -pthread -o md_bench
+// Usage:
+//   md_bench [--sizes 9,1000,100000,1000000] [--densities 1,0.5] [--min-time 0.2] [--threads N]
+//            [--kernel scalar|avx2|avx512] [--out results.json]
+//
+// Every workload starts from the same hexagonal lattice with the same velocity seed, so a
+// given (size, density) pair is the same system on every run. Density is relative to the
+// default lattice (eq_dist = 3.6 A): density 0.5 spreads the lattice by sqrt(2).
+//
+// The force loop is also timed with the particles in random order ("...Shuffled") and after a
+// Hilbert sort of that order ("...Sorted"), with the neighbor cache lines per particle and,
+// on Linux where perf events are allowed, the hardware cache misses per call.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "md.h"
+#include "neighbor.h"
+#include "simulation.h"
+#include "spatialsort.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+struct BenchResult
+{
+	std::string kernel;
+	int n;
+	double density;
+	long long calls;
+	double secondsPerCall;
+	double cacheLines = -1.0;  // neighborCacheLines of the list, -1 = not measured
+	double cacheMisses = -1.0; // Hardware cache misses per call, -1 = not measured
+};
+
+// Last-level cache misses of the calling thread and the threads it starts from now on,
+// through perf_event_open. Unavailable in containers and VMs that forbid perf events.
+class CacheMissCounter
+{
+public:
+	CacheMissCounter()
+	{
+#ifdef __linux__
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.disabled = 1;
+		attr.inherit = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+	}
+	~CacheMissCounter()
+	{
+#ifdef __linux__
+		if (fd >= 0) close(fd);
+#endif
+	}
+	bool available() const { return fd >= 0; }
+	// Misses per call of fn over calls calls, -1 when unavailable
+	double perCall(const std::function<void()>& fn, long long calls)
+	{
+		if (fd < 0) return -1.0;
+#ifdef __linux__
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		for (long long c = 0; c < calls; ++c) fn();
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		long long misses = 0;
+		if (read(fd, &misses, sizeof(misses)) != sizeof(misses)) return -1.0;
+		return (double)misses / calls;
+#else
+		return -1.0;
+#endif
+	}
+
+private:
+	int fd = -1;
+};
+
+// Calls fn repeatedly in batches until minTime has passed and keeps the fastest batch.
+// One untimed call first, so first-touch page faults and lazy setup are not measured.
+static double timeKernel(const std::function<void()>& fn, double minTime, long long& calls)
+{
+	typedef std::chrono::steady_clock Clock;
+	fn();
+	double best = 1e300;
+	double total = 0.0;
+	long long batch = 1;
+	calls = 0;
+	while (total < minTime) {
+		Clock::time_point start = Clock::now();
+		for (long long r = 0; r < batch; ++r) fn();
+		double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		best = std::min(best, elapsed / batch);
+		total += elapsed;
+		calls += batch;
+		// Grow batches until each takes about a tenth of the budget
+		if (elapsed < 0.1 * minTime) batch *= 2;
+	}
+	return best;
+}
+
+static std::vector<double> parseList(const std::string& text)
+{
+	std::vector<double> values;
+	std::stringstream stream(text);
+	std::string item;
+	while (std::getline(stream, item, ',')) values.push_back(std::stod(item));
+	return values;
+}
+
+// Hexagonal lattice of about n particles at the given relative density, with seeded velocities
+static void setupSystem(ParticleSystem& ps, NeighborList& nl, int n, double density)
+{
+	eq_dist = 3.6e-10 / std::sqrt(density);
+	int nx = std::max(1, (int)std::ceil(std::sqrt((double)n)));
+	int ny = (n + nx - 1) / nx;
+	hexagonalLattice(ps, nx, ny, n);
+	vInitial(ps);
+	nl.build(ps);
+	calculateForce(ps, nl);
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<double> sizes = { 9, 1000, 100000, 1000000 };
+	std::vector<double> densities = { 1.0, 0.5 };
+	double minTime = 0.2;
+	std::string outPath;
+	rngSeed = 20240607;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string arg = argv[i];
+		std::string value = argv[i + 1];
+		if (arg == "--sizes") sizes = parseList(value);
+		else if (arg == "--densities") densities = parseList(value);
+		else if (arg == "--min-time") minTime = std::stod(value);
+		else if (arg == "--threads") nThreads = std::stoi(value);
+		else if (arg == "--out") outPath = value;
+		else if (arg == "--kernel") {
+			forceKernel = ljKernelByName(value.c_str());
+			if (forceKernel == nullptr) {
+				std::cerr << "ERROR: LJ kernel " << value << " is unknown or not supported by this CPU" << std::endl;
+				return 1;
+			}
+		}
+		else {
+			std::cerr << "ERROR: unknown option " << arg << std::endl;
+			return 1;
+		}
+	}
+	if (forceKernel == nullptr) forceKernel = selectLJKernel();
+
+	std::vector<BenchResult> results;
+	CacheMissCounter missCounter;
+	if (!missCounter.available()) std::cerr << "Hardware cache-miss counter unavailable, reporting cache lines only" << std::endl;
+	for (double density : densities) {
+		for (double size : sizes) {
+			ParticleSystem ps;
+			NeighborList nl;
+			setupSystem(ps, nl, (int)size, density);
+			std::cerr << "Benchmarking " << ps.n << " particles at density " << density << std::endl;
+
+			auto add = [&](const std::string& name, const std::function<void()>& fn) {
+				long long calls;
+				double perCall = timeKernel(fn, minTime, calls);
+				results.push_back({ name, ps.n, density, calls, perCall });
+			};
+			// Every kernel starts from a fresh copy of the same lattice, so what it reads does not
+			// depend on how many calls of the previous kernel fitted in --min-time on this machine.
+			// integrate moves the particles with frozen forces while it is timed, but its cost does
+			// not depend on where they are.
+			add("calculateForce", [&] { calculateForce(ps, nl); });
+			setupSystem(ps, nl, (int)size, density);
+			add("integrate", [&] { integrate(ps); });
+			setupSystem(ps, nl, (int)size, density);
+			add("applyPBC", [&] { applyPBC(ps); });
+			setupSystem(ps, nl, (int)size, density);
+			add("neighborListBuild", [&] { nl.build(ps); });
+			setupSystem(ps, nl, (int)size, density);
+			Snapshot snapshot;
+			add("takeSnapshot", [&] { takeSnapshot(ps, 0, snapshot); });
+
+			// End to end: the full step
+			setupSystem(ps, nl, (int)size, density);
+			add("fullStep", [&] {
+				integrate(ps);
+				nl.update(ps);
+				calculateForce(ps, nl);
+			});
+
+			// Memory order: random, as after long diffusion or from an unsorted input file, then
+			// sorted along the Hilbert curve. The list is rebuilt for each order and kept fixed.
+			setupSystem(ps, nl, (int)size, density);
+			std::vector<int> order(ps.n);
+			for (int i = 0; i < ps.n; ++i) order[i] = i;
+			std::shuffle(order.begin(), order.end(), std::default_random_engine(12345));
+			for (const char* layout : { "Shuffled", "Sorted" }) {
+				if (std::strcmp(layout, "Sorted") == 0) spatialOrder(ps, 0.5 * (rCut + nl.skin), "hilbert", order);
+				permuteParticles(ps, order);
+				nl.build(ps);
+				auto force = [&] { calculateForce(ps, nl); };
+				add(std::string("calculateForce") + layout, force);
+				results.back().cacheLines = neighborCacheLines(nl);
+				results.back().cacheMisses = missCounter.perCall(force, std::max(1LL, results.back().calls / 10));
+			}
+		}
+	}
+
+	std::ostringstream json;
+	json << "{\n";
+	json << "  \"threads\": " << threadCount() << ",\n";
+	json << "  \"ljKernel\": \"" << ljKernelName(forceKernel) << "\",\n";
+	json << "  \"seed\": " << rngSeed << ",\n";
+	json << "  \"results\": [\n";
+	for (size_t r = 0; r < results.size(); ++r) {
+		const BenchResult& b = results[r];
+		json << "    {\"kernel\": \"" << b.kernel << "\", \"n\": " << b.n << ", \"density\": " << b.density
+			<< ", \"calls\": " << b.calls << ", \"secondsPerCall\": " << b.secondsPerCall
+			<< ", \"nsPerParticle\": " << b.secondsPerCall / b.n * 1e9;
+		if (b.kernel == "fullStep") json << ", \"stepsPerSecond\": " << 1.0 / b.secondsPerCall;
+		if (b.cacheLines >= 0.0) json << ", \"neighborCacheLines\": " << b.cacheLines;
+		if (b.cacheMisses >= 0.0) json << ", \"cacheMissesPerCall\": " << b.cacheMisses;
+		json << "}" << (r + 1 < results.size() ? "," : "") << "\n";
+	}
+	json << "  ]\n}\n";
+
+	if (outPath.empty()) {
+		std::cout << json.str();
+	}
+	else {
+		std::ofstream out(outPath);
+		out << json.str();
+	}
+	return 0;
+}
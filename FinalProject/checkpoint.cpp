@@ -0,0 +1,209 @@
+#include "checkpoint.h"
+#include "mappedfile.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+static const char CHECKPOINT_MAGIC[8] = "MDCHKPT";
+static const uint32_t CHECKPOINT_VERSION = 3;
+
+// Double arrays in the file for dims dimensions; the ids follow in the next slot
+static int arrayCount(int dims)
+{
+	return 4 * dims;
+}
+
+// The arrays of ps and the list build positions in file order
+template <typename P, typename L, typename A>
+static void fileArrays(P& ps, L& list, int dims, A** arrays)
+{
+	for (int d = 0; d < dims; ++d) {
+		arrays[d] = ps.position(d).data();
+		arrays[dims + d] = ps.oldPosition(d).data();
+		arrays[2 * dims + d] = ps.acceleration(d).data();
+		arrays[3 * dims + d] = list[d];
+	}
+}
+
+static uint64_t alignUp(uint64_t offset)
+{
+	return (offset + 63) / 64 * 64;
+}
+
+// Pushes the file contents to the storage device before it is renamed into place
+static bool syncFile(std::FILE* file)
+{
+	if (std::fflush(file) != 0) return false;
+#ifdef _WIN32
+	return _commit(_fileno(file)) == 0;
+#else
+	return fsync(fileno(file)) == 0;
+#endif
+}
+
+static bool replaceFile(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+bool writeCheckpoint(const std::string& path, const ParticleSystem& ps, const NeighborList& nl, long long step)
+{
+	std::ostringstream rngText;
+	rngText << rng;
+	const std::string rngState = rngText.str();
+
+	CheckpointHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.version = CHECKPOINT_VERSION;
+	header.headerBytes = sizeof(CheckpointHeader);
+	header.step = step;
+	header.n = ps.n;
+	header.dimensions = dimensions;
+	header.dt = dt;
+	header.boxWidth = LW;
+	header.boxHeight = LH;
+	header.boxDepth = dimensions == 3 ? LD : 0.0;
+	header.temperature = temperature;
+	header.rngSeed = rngSeed;
+	header.rngStateBytes = rngState.size();
+	header.arraysOffset = alignUp(sizeof(header) + rngState.size());
+	header.arrayStride = alignUp((uint64_t)ps.n * sizeof(double));
+
+	const std::string tmpPath = path + ".tmp";
+	std::FILE* file = std::fopen(tmpPath.c_str(), "wb");
+	if (file == nullptr) {
+		std::cout << "ERROR: cannot open checkpoint file " << tmpPath << " for writing" << std::endl;
+		return false;
+	}
+	const char padding[64] = {};
+	// A list that was never built is rebuilt at the current positions on restart
+	const bool listBuilt = (int)nl.rRef[0].size() == ps.n;
+	const int count = arrayCount(dimensions);
+	const double* list[3];
+	for (int d = 0; d < dimensions; ++d) list[d] = listBuilt ? nl.rRef[d].data() : ps.position(d).data();
+	const double* arrays[12];
+	fileArrays(ps, list, dimensions, arrays);
+	const size_t arrayBytes = (size_t)ps.n * sizeof(double);
+	const size_t idBytes = (size_t)ps.n * sizeof(int32_t);
+	const std::vector<int32_t> ids(ps.id.begin(), ps.id.end());
+	bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1
+		&& std::fwrite(rngState.data(), 1, rngState.size(), file) == rngState.size()
+		&& std::fwrite(padding, 1, header.arraysOffset - sizeof(header) - rngState.size(), file) == header.arraysOffset - sizeof(header) - rngState.size();
+	for (int a = 0; ok && a < count; ++a) {
+		ok = std::fwrite(arrays[a], 1, arrayBytes, file) == arrayBytes
+			&& std::fwrite(padding, 1, header.arrayStride - arrayBytes, file) == header.arrayStride - arrayBytes;
+	}
+	ok = ok && std::fwrite(ids.data(), 1, idBytes, file) == idBytes;
+	ok = ok && syncFile(file);
+	ok = std::fclose(file) == 0 && ok;
+	if (!ok || !replaceFile(tmpPath, path)) {
+		std::cout << "ERROR: failed to write checkpoint " << path << std::endl;
+		std::remove(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool loadCheckpoint(const std::string& path, ParticleSystem& ps, NeighborList& nl, long long& step)
+{
+	MappedFile file;
+	if (!file.open(path)) return false;
+	CheckpointHeader header;
+	if (file.size() < sizeof(header)) {
+		std::cout << "ERROR: " << path << " is too short to be a checkpoint" << std::endl;
+		return false;
+	}
+	std::memcpy(&header, file.data(), sizeof(header));
+	if (std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0) {
+		std::cout << "ERROR: " << path << " is not a checkpoint file" << std::endl;
+		return false;
+	}
+	if (header.version != CHECKPOINT_VERSION || header.headerBytes != sizeof(header)) {
+		std::cout << "ERROR: " << path << " was written by an incompatible version (format " << header.version << ")" << std::endl;
+		return false;
+	}
+	if (header.n <= 0 || (header.dimensions != 2 && header.dimensions != 3)
+		|| header.arraysOffset < sizeof(header) + header.rngStateBytes
+		|| header.arrayStride < (uint64_t)header.n * sizeof(double)
+		|| file.size() < header.arraysOffset + arrayCount((int)header.dimensions) * header.arrayStride + header.n * sizeof(int32_t)) {
+		std::cout << "ERROR: checkpoint " << path << " is truncated or corrupt" << std::endl;
+		return false;
+	}
+
+	std::istringstream rngText(std::string(file.data() + sizeof(header), header.rngStateBytes));
+	rngText >> rng;
+	if (!rngText) {
+		std::cout << "ERROR: checkpoint " << path << " has an unreadable random engine state" << std::endl;
+		return false;
+	}
+
+	// The file decides the dimension of the run, as it does the box
+	dimensions = (int)header.dimensions;
+	const int count = arrayCount(dimensions);
+	ps.resize((int)header.n);
+	double* list[3];
+	for (int d = 0; d < dimensions; ++d) {
+		nl.rRef[d].resize(ps.n);
+		list[d] = nl.rRef[d].data();
+	}
+	double* arrays[12];
+	fileArrays(ps, list, dimensions, arrays);
+	for (int a = 0; a < count; ++a) {
+		std::memcpy(arrays[a], file.data() + header.arraysOffset + a * header.arrayStride, ps.n * sizeof(double));
+	}
+	std::vector<int32_t> ids(ps.n);
+	std::memcpy(ids.data(), file.data() + header.arraysOffset + count * header.arrayStride, ps.n * sizeof(int32_t));
+	// Every input index exactly once, or the types and DCD frames would be scrambled
+	std::vector<char> seen(ps.n, 0);
+	for (int i = 0; i < ps.n; ++i) {
+		if (ids[i] < 0 || ids[i] >= ps.n || seen[ids[i]]) {
+			std::cout << "ERROR: checkpoint " << path << " has an invalid particle order" << std::endl;
+			return false;
+		}
+		seen[ids[i]] = 1;
+		ps.id[i] = ids[i];
+	}
+
+	setBox(header.boxWidth, header.boxHeight);
+	LD = header.boxDepth;
+	rngSeed = header.rngSeed;
+	Npart = ps.n;
+	step = header.step;
+
+	if (header.dt != dt) {
+		// Position Verlet carries the velocity in x - xOld; keep it when the timestep changes.
+		// x is wrapped into the box and xOld is not, so the displacement is the minimum image.
+		const double scale = dt / header.dt;
+		const double L[3] = { LW, LH, LD };
+		for (int d = 0; d < dimensions; ++d) {
+			const std::vector<double>& r = ps.position(d);
+			std::vector<double>& old = ps.oldPosition(d);
+			for (int i = 0; i < ps.n; ++i) {
+				double dr = r[i] - old[i];
+				dr -= L[d] * std::round(dr / L[d]);
+				old[i] = r[i] - dr * scale;
+			}
+		}
+		std::cout << "Info: Timestep changed from " << header.dt * 1e15 << " fs to " << dt * 1e15
+			<< " fs, previous positions rescaled" << std::endl;
+	}
+	return true;
+}
@@ -0,0 +1,50 @@
+// CHECKPOINT / RESTART
+// Binary snapshots of the integrator state, so a run can be continued where it stopped.
+// The particles stay in the order the run had them and the positions the neighbor list was
+// built at are kept, so a restart rebuilds the same list, sums the forces in the same order
+// and continues a position Verlet run bitwise (with the same threads and cutoff). Adaptive
+// and respa runs restart from the velocities xOld implies, which differ in the last bits.
+//
+// File layout (native byte order, every array starts on a 64-byte boundary):
+//   CheckpointHeader
+//   random engine state as text, rngStateBytes long
+//   x, y, xOld, yOld, ax, ay   n doubles each, and z, zOld, az after each group in 3D
+//   xList, yList               n doubles each, positions at the last neighbor list build (zList in 3D)
+//   id                         n int32, index of each particle in the input
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "md.h"
+#include "neighbor.h"
+
+struct CheckpointHeader
+{
+	char magic[8];          // "MDCHKPT" and a terminating zero
+	uint32_t version;
+	uint32_t headerBytes;   // sizeof(CheckpointHeader), rejects files from incompatible builds
+	int64_t step;           // Steps completed when the checkpoint was taken
+	int64_t n;              // Particles
+	int64_t dimensions;     // 2 or 3
+	double dt;              // Timestep (s) that xOld belongs to
+	double boxWidth;        // LW (m)
+	double boxHeight;       // LH (m)
+	double boxDepth;        // LD (m), 0 in 2D
+	double temperature;     // Target temperature (K) of the run, for reference
+	uint64_t rngSeed;
+	uint64_t rngStateBytes;
+	uint64_t arraysOffset;  // Offset of x from the start of the file
+	uint64_t arrayStride;   // Bytes from one array to the next
+};
+
+// Writes ps and the build positions of nl to path + ".tmp", flushes it to disk and renames it
+// over path, so a crash leaves either the previous checkpoint or the new one, never a partial file.
+bool writeCheckpoint(const std::string& path, const ParticleSystem& ps, const NeighborList& nl, long long step);
+
+// Maps the file and copies its state into ps, the box, dimensions and the random engine, and the build
+// positions into nl.rRef for NeighborList::restore. step receives the step count
+// stored in the file. If dt differs from the stored timestep, the previous positions are
+// rescaled so the velocities are kept.
+bool loadCheckpoint(const std::string& path, ParticleSystem& ps, NeighborList& nl, long long& step);
@@ -0,0 +1,317 @@
+#include "config.h"
+#include "md.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+
+static const double ANGSTROM = 1e-10;
+static const double FEMTOSECOND = 1e-15;
+static const double PICOSECOND = 1e-12;
+static const double KCAL_PER_MOL = 4184.0 / 6.02214076e23; // J per particle
+
+static std::string normalizeKey(const std::string& key)
+{
+	std::string out;
+	for (char c : key) {
+		if (c == '-' || c == '_') continue;
+		out += (char)std::tolower((unsigned char)c);
+	}
+	return out;
+}
+
+static bool parseBool(const std::string& value, bool& out)
+{
+	std::string v = normalizeKey(value);
+	if (v == "yes" || v == "on" || v == "true" || v == "1") out = true;
+	else if (v == "no" || v == "off" || v == "false" || v == "0") out = false;
+	else return false;
+	return true;
+}
+
+// The whole value as a number, throwing std::invalid_argument or std::out_of_range as std::stod
+// and its kin do. They stop at the first character they cannot read, so "2fs" alone would be 2.
+template <typename N>
+static N wholeNumber(const std::string& value)
+{
+	size_t end = 0;
+	N n;
+	if constexpr (std::is_same<N, double>::value) n = std::stod(value, &end);
+	else if constexpr (std::is_same<N, int>::value) n = std::stoi(value, &end);
+	else if constexpr (std::is_same<N, long long>::value) n = std::stoll(value, &end);
+	else n = std::stoull(value, &end);
+	if (value.find_first_not_of(" \t", end) != std::string::npos) throw std::invalid_argument(value);
+	return n;
+}
+
+// Options that may appear on the command line without a value
+static bool isFlag(const std::string& key)
+{
+	return key == "headless" || key == "nondeterministic" || key == "checkkernels" || key == "scaling"
+		|| key == "compareprecision";
+}
+
+bool setOption(const std::string& rawKey, const std::string& value, RunOptions& options)
+{
+	std::string key = normalizeKey(rawKey);
+	try {
+		bool flag;
+		if (key == "temperature") temperature = wholeNumber<double>(value);
+		else if (key == "timestep") dt = wholeNumber<double>(value) * FEMTOSECOND;
+		else if (key == "numsteps") options.numSteps = wholeNumber<long long>(value);
+		else if (key == "eqdist") eq_dist = wholeNumber<double>(value) * ANGSTROM;
+		else if (key == "latticex") {
+			latticeX = wholeNumber<int>(value);
+			Npart = latticeX * latticeY;
+		}
+		else if (key == "latticey") {
+			latticeY = wholeNumber<int>(value);
+			Npart = latticeX * latticeY;
+		}
+		else if (key == "npart") {
+			// Closest-to-square lattice that holds Npart particles; hexagonalLattice fills the first Npart sites
+			Npart = wholeNumber<int>(value);
+			latticeX = std::max(1, (int)std::ceil(std::sqrt((double)Npart)));
+			latticeY = (Npart + latticeX - 1) / latticeX;
+		}
+		else if (key == "latticez") latticeZ = wholeNumber<int>(value);
+		else if (key == "dimensions") {
+			const int d = wholeNumber<int>(value);
+			if (d != 2 && d != 3) {
+				std::cout << "ERROR: dimensions must be 2 or 3, got " << value << std::endl;
+				return false;
+			}
+			dimensions = d;
+		}
+		else if (key == "boxwidth") options.boxWidth = wholeNumber<double>(value) * ANGSTROM;
+		else if (key == "boxheight") options.boxHeight = wholeNumber<double>(value) * ANGSTROM;
+		else if (key == "boxdepth") options.boxDepth = wholeNumber<double>(value) * ANGSTROM;
+		else if (key == "cutoff") {
+			rCut = wholeNumber<double>(value) * ANGSTROM;
+			options.cutoffGiven = true;
+		}
+		else if (key == "switchdist") options.switchDist = wholeNumber<double>(value) * ANGSTROM;
+		else if (key == "pairlistdist") options.pairlistDist = wholeNumber<double>(value) * ANGSTROM;
+		else if (key == "parameters") options.parameterFiles.push_back(value);
+		else if (key == "types") {
+			std::stringstream list(value);
+			std::string name;
+			options.typeNames.clear();
+			while (std::getline(list, name, ',')) {
+				if (!name.empty()) options.typeNames.push_back(name);
+			}
+		}
+		else if (key == "tableintervals") options.tableIntervals = wholeNumber<int>(value);
+		else if (key == "integrator") {
+			std::string name = normalizeKey(value);
+			if (name != "verlet" && name != "adaptive" && name != "respa") {
+				std::cout << "ERROR: integrator must be verlet, adaptive or respa, got " << value << std::endl;
+				return false;
+			}
+			options.integrator = name;
+		}
+		else if (key == "adaptivetolerance") options.adaptiveTolerance = wholeNumber<double>(value) * ANGSTROM;
+		else if (key == "maxtimestep") options.maxTimestep = wholeNumber<double>(value) * FEMTOSECOND;
+		else if (key == "respasteps") options.respaSteps = wholeNumber<int>(value);
+		else if (key == "respasplit") options.respaSplit = wholeNumber<double>(value) * ANGSTROM;
+		else if (key == "respawidth") options.respaWidth = wholeNumber<double>(value) * ANGSTROM;
+		else if (key == "outputenergies") options.outputEnergies = wholeNumber<int>(value);
+		else if (key == "layerthickness") options.layerThickness = wholeNumber<double>(value) * ANGSTROM;
+		else if (key == "analysisfreq") options.analysisFreq = wholeNumber<int>(value);
+		else if (key == "gofrfile") options.gofrFile = value;
+		else if (key == "gofrmax") options.gofrMax = wholeNumber<double>(value) * ANGSTROM;
+		else if (key == "gofrdelta") options.gofrDelta = wholeNumber<double>(value) * ANGSTROM;
+		else if (key == "densityfile") options.densityFile = value;
+		else if (key == "densityaxis") {
+			std::string axis = normalizeKey(value);
+			if (axis != "x" && axis != "y" && axis != "z") {
+				std::cout << "ERROR: densityaxis must be x, y or z, got " << value << std::endl;
+				return false;
+			}
+			options.densityAxis = axis[0] - 'x';
+		}
+		else if (key == "densitydelta") options.densityDelta = wholeNumber<double>(value) * ANGSTROM;
+		else if (key == "sortfreq") options.sortFreq = wholeNumber<int>(value);
+		else if (key == "sortcurve") {
+			std::string name = normalizeKey(value);
+			if (name != "hilbert" && name != "morton") {
+				std::cout << "ERROR: sortcurve must be hilbert or morton, got " << value << std::endl;
+				return false;
+			}
+			options.sortCurve = name;
+		}
+		else if (key == "replicas") options.replicas = wholeNumber<int>(value);
+		else if (key == "replicatemperatures") {
+			std::stringstream list(value);
+			std::string t;
+			options.replicaTemperatures.clear();
+			while (std::getline(list, t, ',')) {
+				if (t.empty()) continue;
+				options.replicaTemperatures.push_back(wholeNumber<double>(t));
+			}
+		}
+		else if (key == "replicaexchange") options.replicaExchange = wholeNumber<int>(value);
+		else if (key == "langevindamping") options.langevinDamping = wholeNumber<double>(value) / PICOSECOND;
+		else if (key == "profiletrace") options.profileTrace = value;
+		else if (key == "skin") options.skin = wholeNumber<double>(value) * ANGSTROM;
+		else if (key == "threads") nThreads = wholeNumber<int>(value);
+		else if (key == "seed") rngSeed = wholeNumber<unsigned long long>(value);
+		else if (key == "kernel") {
+			forceKernel = ljKernelByName(value.c_str());
+			if (forceKernel == nullptr) {
+				std::cout << "ERROR: LJ kernel " << value << " is unknown or not supported by this CPU" << std::endl;
+				return false;
+			}
+		}
+		else if (key == "stepsperframe") options.stepsPerFrame = value == "max" ? 0 : wholeNumber<int>(value);
+		else if (key == "offscreenframes") options.offscreenFrames = wholeNumber<int>(value);
+		else if (key == "outputtiming") options.outputTiming = wholeNumber<int>(value);
+		else if (key == "dcdfile") options.dcdFile = value;
+		else if (key == "veldcdfile") options.velDcdFile = value;
+		else if (key == "dcdfreq") options.dcdFreq = wholeNumber<int>(value);
+		else if (key == "restartname") options.restartName = value;
+		else if (key == "restartfreq") options.restartFreq = wholeNumber<int>(value);
+		else if (key == "restartfrom") options.restartFrom = value;
+		else if (key == "coordinates") options.coordinates = value;
+		else if (key == "bincoordinates") options.binCoordinates = value;
+		else if (key == "coordinateplane") options.coordinatePlane = normalizeKey(value);
+		else if (key == "minimize") options.minimizeSteps = wholeNumber<long long>(value);
+		else if (key == "minimizer") {
+			std::string name = normalizeKey(value);
+			if (name != "fire" && name != "lbfgs") {
+				std::cout << "ERROR: minimizer must be fire or lbfgs, got " << value << std::endl;
+				return false;
+			}
+			options.minimizer = name;
+		}
+		else if (key == "minimizetolerance") options.minimizeTolerance = wholeNumber<double>(value) * KCAL_PER_MOL / ANGSTROM;
+		else if (key == "lattice") {
+			std::string name = normalizeKey(value);
+			if (name != "hexagonal" && name != "square" && name != "fcc") {
+				std::cout << "ERROR: lattice must be hexagonal, square or fcc, got " << value << std::endl;
+				return false;
+			}
+			options.lattice = name;
+		}
+		else if (isFlag(key) || key == "deterministic" || key == "dcdunitcell" || key == "switching" || key == "vdwforceswitching") {
+			if (!parseBool(value, flag)) {
+				std::cout << "ERROR: expected yes/no for " << rawKey << ", got " << value << std::endl;
+				return false;
+			}
+			if (key == "headless") options.headless = flag;
+			else if (key == "deterministic") deterministicReduction = flag;
+			else if (key == "dcdunitcell") options.dcdUnitCell = flag;
+			else if (key == "switching") options.switching = flag ? 1 : 0;
+			else if (key == "vdwforceswitching") options.forceSwitching = flag ? 1 : 0;
+			else if (key == "nondeterministic") deterministicReduction = !flag;
+			else if (flag && key == "checkkernels") options.mode = "check-kernels";
+			else if (flag && key == "compareprecision") options.mode = "compare-precision";
+			else if (flag) options.mode = "scaling";
+		}
+		else {
+			std::cout << "ERROR: unknown option " << rawKey << std::endl;
+			return false;
+		}
+	}
+	catch (const std::exception&) {
+		std::cout << "ERROR: invalid value " << value << " for " << rawKey << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool loadConfigFile(const std::string& path, RunOptions& options)
+{
+	std::ifstream file(path);
+	if (!file) {
+		std::cout << "ERROR: cannot open configuration file " << path << std::endl;
+		return false;
+	}
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line)) {
+		lineNumber++;
+		// Comments start with '#', also after a ';' as in "dt 2.0 ;# fs"
+		line = line.substr(0, line.find('#'));
+		std::replace(line.begin(), line.end(), ';', ' ');
+		std::istringstream fields(line);
+		std::string key, value;
+		if (!(fields >> key)) continue;
+		if (!(fields >> value)) {
+			std::cout << "ERROR: " << path << ":" << lineNumber << ": missing value for " << key << std::endl;
+			return false;
+		}
+		std::string extra;
+		if (fields >> extra) {
+			std::cout << "ERROR: " << path << ":" << lineNumber << ": " << key << " takes one value, got " << value
+				<< " " << extra << " (lists are comma-separated)" << std::endl;
+			return false;
+		}
+		if (!setOption(key, value, options)) {
+			std::cout << "       at " << path << ":" << lineNumber << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool parseCommandLine(int argc, char** argv, RunOptions& options)
+{
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 2, "--") != 0) {
+			if (!loadConfigFile(arg, options)) return false;
+			continue;
+		}
+		std::string key = arg.substr(2);
+		bool flagValue;
+		if (isFlag(normalizeKey(key)) && (i + 1 >= argc || !parseBool(argv[i + 1], flagValue))) {
+			if (!setOption(key, "yes", options)) return false;
+			continue;
+		}
+		if (i + 1 >= argc) {
+			std::cout << "ERROR: missing value for " << arg << std::endl;
+			return false;
+		}
+		if (!setOption(key, argv[++i], options)) return false;
+	}
+	return true;
+}
+
+void printConfiguration(const RunOptions& options)
+{
+	std::cout << "Info: SIMULATION PARAMETERS:" << std::endl;
+	std::cout << "Info: TIMESTEP               " << dt / FEMTOSECOND << std::endl;
+	std::cout << "Info: NUMBER OF STEPS        " << options.numSteps << std::endl;
+	std::cout << "Info: TEMPERATURE            " << temperature << std::endl;
+	std::cout << "Info: NUMBER OF PARTICLES    " << Npart << std::endl;
+	std::cout << "Info: DIMENSIONS             " << dimensions << std::endl;
+	std::cout << "Info: PERIODIC CELL          " << LW / ANGSTROM << " x " << LH / ANGSTROM;
+	if (dimensions == 3) std::cout << " x " << LD / ANGSTROM;
+	std::cout << std::endl;
+	std::cout << "Info: CUTOFF                 " << rCut / ANGSTROM << std::endl;
+	std::cout << "Info: PAIRLIST DISTANCE      " << (rCut + options.skin) / ANGSTROM << std::endl;
+	std::cout << "Info: ENERGY OUTPUT STEPS    " << options.outputEnergies << std::endl;
+	if (dimensions == 2) std::cout << "Info: LAYER THICKNESS        " << options.layerThickness / ANGSTROM << std::endl;
+	std::cout << "Info: INTEGRATOR             " << (options.replicas > 0 ? "langevin" : options.integrator);
+	if (options.replicas > 0) {
+		std::cout << " (BAOAB) for every replica, damping " << options.langevinDamping * PICOSECOND << " /ps";
+	}
+	else if (options.integrator == "adaptive") {
+		std::cout << ", tolerance " << options.adaptiveTolerance / ANGSTROM << " A, timestep up to "
+			<< (options.maxTimestep > 0.0 ? options.maxTimestep : 10.0 * dt) / FEMTOSECOND;
+	}
+	if (options.integrator == "respa") {
+		std::cout << ", outer force every " << options.respaSteps << " steps beyond " << options.respaSplit / ANGSTROM << " A";
+	}
+	std::cout << std::endl;
+	if (options.sortFreq > 0) {
+		std::cout << "Info: SPATIAL SORT           " << options.sortCurve << " every " << options.sortFreq << " steps" << std::endl;
+	}
+	std::cout << "Info: THREADS                " << threadCount() << (deterministicReduction ? " (deterministic)" : "") << std::endl;
+}
@@ -0,0 +1,81 @@
+// RUN CONFIGURATION
+// NAMD-style "key value" configuration files and the equivalent --key value command line
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "md.h"
+
+// Options that decide what the program does. Physical parameters (temperature, timestep,
+// lattice, box, cutoff, threads) are written straight into the engine globals in md.h.
+struct RunOptions
+{
+	bool headless = false;     // Integrate without creating a window or an OpenGL context
+	long long numSteps = 0;    // Steps to run in headless mode
+	int stepsPerFrame = 1;     // Steps per rendered frame, 0 = as fast as possible
+	int offscreenFrames = 0;   // Frames to render into a hidden window before exiting, 0 = interactive
+	int outputTiming = 1000;   // Steps between TIMING lines in headless mode
+	double skin = 0.3 * sigma; // Neighbor-list skin (m)
+	double boxWidth = 0.0;     // Overrides the lattice box width LW when > 0 (m)
+	double boxHeight = 0.0;    // Overrides the lattice box height LH when > 0 (m)
+	double boxDepth = 0.0;     // Overrides the lattice box depth LD when > 0 (m), 3D only
+	std::string mode;          // "check-kernels", "scaling" or "compare-precision" for the diagnostic modes
+	std::string dcdFile;       // Trajectory file, empty = no trajectory
+	std::string velDcdFile;    // Velocity trajectory file, written at the same steps as dcdFile
+	int dcdFreq = 0;           // Steps between trajectory frames
+	bool dcdUnitCell = true;   // Store the periodic cell with every frame
+	std::string restartName;   // Checkpoints go to restartName + ".chk", empty = none
+	int restartFreq = 0;       // Steps between checkpoints, 0 = only at the end of the run
+	std::string restartFrom;   // Checkpoint to continue from instead of building a lattice
+	std::string coordinates;   // PDB or XYZ file with the starting positions, empty = a lattice
+	std::string binCoordinates; // NAMD binary coordinates, replacing the positions of coordinates
+	std::string coordinatePlane = "xy"; // Plane the 3D coordinates of those files are projected on in 2D
+	std::string lattice;       // Starting lattice without coordinates: "hexagonal" or "square" in 2D, "fcc" in 3D; empty = the first of them
+	long long minimizeSteps = 0; // Energy minimization steps before the dynamics, 0 = none
+	std::string minimizer = "fire"; // "fire" or "lbfgs"
+	double minimizeTolerance = 6.9477e-14; // Force below which minimization stops (N), 1e-3 kcal/mol/A
+	long long firstStep = 0;   // Step count at the start of the run, taken from the checkpoint
+	bool cellFromExtent = false; // The coordinate files had no cell and the box was made around the atoms, so it may grow
+	std::vector<std::string> parameterFiles; // CHARMM parameter files; when given, forces come from pair tables
+	std::vector<std::string> typeNames;      // Atom types given to the particles in turn ("types AU" or "types CTL2,CTL3")
+	int switching = -1;        // 1/0 forces the switching function on/off, -1 = as the parameter file says
+	int forceSwitching = -1;   // 1 = vdwForceSwitching, -1 = as the parameter file says
+	double switchDist = 0.0;   // Start of the switching region (m), 0 = ctonnb of the parameter file
+	bool cutoffGiven = false;  // cutoff was set explicitly, so ctofnb of the parameter file is ignored
+	double pairlistDist = 0.0; // Neighbor-list range (m) as in NAMD; sets skin = pairlistdist - cutoff
+	int tableIntervals = 1024; // Spline intervals per type pair
+	std::string integrator = "verlet"; // "verlet", "adaptive" (velocity Verlet with error control) or "respa"
+	double adaptiveTolerance = 1e-14; // Largest local position error per step allowed by "adaptive" (m), 1e-4 A
+	double maxTimestep = 0.0;  // Upper bound of the adaptive timestep (s), 0 = 10 x timestep
+	int respaSteps = 4;        // r-RESPA: steps between evaluations of the outer force
+	double respaSplit = 5e-10; // r-RESPA: distance beyond which the force is outer (m)
+	double respaWidth = 1e-10; // r-RESPA: width of the smooth inner-outer switch below respaSplit (m)
+	int outputEnergies = 100;  // Steps between ENERGY lines (also the drift report's samples), 0 = none
+	double layerThickness = sigma; // Thickness that turns the 2D box into a volume for PRESSURE and VOLUME (m)
+	int analysisFreq = 100;    // Steps between g(r) and density-profile samples
+	std::string gofrFile;      // Radial distribution function, empty = none; one more file per type pair
+	double gofrMax = 0.0;      // Range of g(r) (m), 0 = the cutoff or half the box if smaller
+	double gofrDelta = 1e-11;  // g(r) bin width (m), 0.1 A
+	std::string densityFile;   // Density profile, empty = none; one more file per type
+	int densityAxis = 1;       // Axis of the density profile, 0 = x, 1 = y, 2 = z
+	double densityDelta = 1e-10; // Density-profile bin width (m), 1 A
+	int replicas = 0;          // Independent copies run side by side by runReplicas, 0 = one ordinary run
+	std::vector<double> replicaTemperatures; // Replica temperatures (K): one per replica, or the ends of a geometric ladder; empty = temperature
+	int replicaExchange = 0;   // Steps between replica-exchange attempts, 0 = none
+	int sortFreq = 0;          // Steps between spatial sorts of the particle arrays, 0 = never
+	std::string sortCurve = "hilbert"; // Space-filling curve of the sort: "hilbert" or "morton"
+	double langevinDamping = 1e12; // Langevin friction of the replicas (1/s), given in 1/ps as in NAMD
+	std::string profileTrace;  // Chrome trace-event file of the profiled run, empty = none (needs MD_PROFILE)
+};
+
+// Keys are case-insensitive and ignore '-' and '_', so "--steps-per-frame 4" on the command
+// line and "stepsPerFrame 4" in a file are the same option. Lengths are in Angstrom and the
+// timestep in femtoseconds, as in NAMD; they are converted to SI units when stored.
+// Each function prints the offending line or argument and returns false on error.
+bool setOption(const std::string& key, const std::string& value, RunOptions& options);
+bool loadConfigFile(const std::string& path, RunOptions& options);
+// A bare argument is read as a configuration file; later arguments override earlier ones
+bool parseCommandLine(int argc, char** argv, RunOptions& options);
+void printConfiguration(const RunOptions& options);
@@ -0,0 +1,424 @@
+#include "coordinates.h"
+#include "checkpoint.h"
+#include "mappedfile.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+static const double ANGSTROM = 1e-10;
+
+// Decimal number with optional sign, fraction and exponent, after optional blanks. Unlike strtod
+// it ignores the locale and needs no terminating zero; with up to 15 significant digits, as in
+// every coordinate format, the result is correctly rounded.
+static bool parseNumber(const char*& p, const char* end, double& value)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	while (p < end && (*p == ' ' || *p == '\t')) ++p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+	unsigned long long mantissa = 0;
+	int exponent = 0, digits = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; ++p, ++digits) {
+		if (digits < 19) mantissa = mantissa * 10 + (*p - '0');
+		else exponent++;
+	}
+	if (p < end && *p == '.') {
+		for (++p; p < end && *p >= '0' && *p <= '9'; ++p, ++digits) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				exponent--;
+			}
+		}
+	}
+	if (digits == 0) return false;
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		++p;
+		bool negativeExp = false;
+		if (p < end && (*p == '-' || *p == '+')) negativeExp = *p++ == '-';
+		int e = 0;
+		if (p >= end || *p < '0' || *p > '9') return false;
+		for (; p < end && *p >= '0' && *p <= '9'; ++p) e = std::min(e * 10 + (*p - '0'), 10000);
+		exponent += negativeExp ? -e : e;
+	}
+	double scale = std::abs(exponent) <= 22 ? powers[std::abs(exponent)] : std::pow(10.0, std::abs(exponent));
+	value = exponent < 0 ? (double)mantissa / scale : (double)mantissa * scale;
+	if (negative) value = -value;
+	return true;
+}
+
+// Number in the fixed columns [from, to) of a line, blanks allowed around it
+static bool parseField(const char* line, const char* lineEnd, int from, int to, double& value)
+{
+	if (line + to > lineEnd) return false;
+	const char* p = line + from;
+	if (!parseNumber(p, line + to, value)) return false;
+	while (p < line + to && (*p == ' ' || *p == '\t')) ++p;
+	return p == line + to;
+}
+
+static std::string trimmed(const char* begin, const char* end)
+{
+	while (begin < end && (*begin == ' ' || *begin == '\t')) ++begin;
+	while (end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) --end;
+	return std::string(begin, end);
+}
+
+static const char* lineEndOf(const char* line, const char* end)
+{
+	const char* newline = (const char*)std::memchr(line, '\n', end - line);
+	return newline != nullptr ? newline : end;
+}
+
+// 1-based line number of p, only needed for error messages
+static long long lineNumber(const char* begin, const char* p)
+{
+	return 1 + std::count(begin, p, '\n');
+}
+
+// Runs over the lines of [begin, end), part of the mapped file, in one chunk of whole lines per
+// thread. Pass one counts the lines isAtom accepts, up to the first line stop accepts;
+// allocate(count) then sizes the output and pass two calls parse(line, lineEnd, index) with the
+// index of the line among the accepted ones. Returns the count, or -1 after printing the line
+// parse rejected.
+template<class IsAtom, class Stop, class Allocate, class Parse>
+static long long parseLines(const std::string& path, const char* file, const char* begin, const char* end, IsAtom isAtom,
+	Stop stop, Allocate allocate, Parse parse)
+{
+	ThreadPool& tp = threadPool();
+	const int T = tp.size();
+	const size_t size = end - begin;
+	std::vector<const char*> start(T + 1, end);
+	for (int t = 1; t < T; ++t) {
+		const char* p = std::max(begin + size * t / T, start[t - 1]);
+		// A chunk starts at the beginning of a line
+		if (p > begin && p < end && p[-1] != '\n') p = std::min(end, lineEndOf(p, end) + 1);
+		start[t] = p;
+	}
+	start[0] = begin;
+
+	std::vector<long long> counts(T, 0);
+	std::vector<const char*> stops(T, nullptr);
+	tp.run([&](int t) {
+		for (const char* line = start[t]; line < start[t + 1];) {
+			const char* lineEnd = lineEndOf(line, end);
+			if (stop(line, lineEnd)) {
+				stops[t] = line;
+				break;
+			}
+			if (isAtom(line, lineEnd)) counts[t]++;
+			line = lineEnd + 1;
+		}
+	});
+
+	// The chunk with the first stop line ends there, and the chunks after it hold nothing
+	std::vector<const char*> limit(start.begin() + 1, start.end());
+	std::vector<long long> first(T, 0);
+	long long total = 0;
+	for (int t = 0; t < T; ++t) {
+		first[t] = total;
+		total += counts[t];
+		if (stops[t] != nullptr) {
+			limit[t] = stops[t];
+			for (int s = t + 1; s < T; ++s) limit[s] = start[s];
+			break;
+		}
+	}
+	allocate(total);
+
+	std::vector<const char*> failed(T, nullptr);
+	tp.run([&](int t) {
+		long long index = first[t];
+		for (const char* line = start[t]; line < limit[t];) {
+			const char* lineEnd = lineEndOf(line, end);
+			if (isAtom(line, lineEnd) && !parse(line, lineEnd, index++)) {
+				failed[t] = line;
+				return;
+			}
+			line = lineEnd + 1;
+		}
+	});
+	for (int t = 0; t < T; ++t) {
+		if (failed[t] != nullptr) {
+			const char* lineEnd = lineEndOf(failed[t], end);
+			std::cout << "ERROR: " << path << ":" << lineNumber(file, failed[t]) << ": cannot read atom from \""
+				<< trimmed(failed[t], lineEnd) << "\"" << std::endl;
+			return -1;
+		}
+	}
+	return total;
+}
+
+static void resizeSet(CoordinateSet& set, long long n, bool names)
+{
+	set.x.resize(n);
+	set.y.resize(n);
+	set.z.resize(n);
+	set.names.resize(names ? n : 0);
+}
+
+bool readPDB(const std::string& path, CoordinateSet& set)
+{
+	MappedFile file;
+	if (!file.open(path)) return false;
+	const char* begin = file.data();
+	const char* end = begin + file.size();
+
+	// CRYST1 comes before the first atom
+	for (const char* line = begin; line < end;) {
+		const char* lineEnd = lineEndOf(line, end);
+		if (lineEnd - line >= 6 && (std::strncmp(line, "ATOM  ", 6) == 0 || std::strncmp(line, "HETATM", 6) == 0)) break;
+		if (lineEnd - line >= 6 && std::strncmp(line, "CRYST1", 6) == 0) {
+			double a, b, c;
+			if (!parseField(line, lineEnd, 6, 15, a) || !parseField(line, lineEnd, 15, 24, b) || !parseField(line, lineEnd, 24, 33, c)) {
+				std::cout << "ERROR: " << path << ":" << lineNumber(begin, line) << ": unreadable CRYST1 record" << std::endl;
+				return false;
+			}
+			set.cell[0] = a * ANGSTROM;
+			set.cell[1] = b * ANGSTROM;
+			set.cell[2] = c * ANGSTROM;
+			break;
+		}
+		line = lineEnd + 1;
+	}
+
+	auto isAtom = [](const char* line, const char* lineEnd) {
+		return lineEnd - line >= 6 && (std::strncmp(line, "ATOM  ", 6) == 0 || std::strncmp(line, "HETATM", 6) == 0);
+	};
+	// END, or ENDMDL after the first model
+	auto stop = [](const char* line, const char* lineEnd) {
+		return lineEnd - line >= 3 && std::strncmp(line, "END", 3) == 0
+			&& (lineEnd - line == 3 || line[3] == ' ' || line[3] == '\r' || line[3] == 'M');
+	};
+	auto allocate = [&](long long n) { resizeSet(set, n, true); };
+	auto parse = [&](const char* line, const char* lineEnd, long long i) {
+		double x, y, z;
+		if (!parseField(line, lineEnd, 30, 38, x) || !parseField(line, lineEnd, 38, 46, y) || !parseField(line, lineEnd, 46, 54, z)) return false;
+		set.x[i] = x * ANGSTROM;
+		set.y[i] = y * ANGSTROM;
+		set.z[i] = z * ANGSTROM;
+		// Element in columns 77-78, the atom name in 13-16 for files without one
+		std::string name = lineEnd - line >= 78 ? trimmed(line + 76, line + 78) : std::string();
+		if (name.empty()) name = trimmed(line + 12, line + std::min<ptrdiff_t>(16, lineEnd - line));
+		set.names[i] = name;
+		return true;
+	};
+	long long n = parseLines(path, begin, begin, end, isAtom, stop, allocate, parse);
+	if (n < 0) return false;
+	if (n == 0) {
+		std::cout << "ERROR: " << path << " has no ATOM or HETATM records" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool readXYZ(const std::string& path, CoordinateSet& set)
+{
+	MappedFile file;
+	if (!file.open(path)) return false;
+	const char* begin = file.data();
+	const char* end = begin + file.size();
+
+	const char* p = begin;
+	double count;
+	if (!parseNumber(p, lineEndOf(begin, end), count) || count < 1 || count != (long long)count) {
+		std::cout << "ERROR: " << path << " does not start with an atom count" << std::endl;
+		return false;
+	}
+	const long long n = (long long)count;
+	// Atoms start after the comment line
+	const char* atoms = std::min(end, lineEndOf(begin, end) + 1);
+	atoms = std::min(end, lineEndOf(atoms, end) + 1);
+
+	auto isAtom = [](const char* line, const char* lineEnd) {
+		for (; line < lineEnd; ++line) {
+			if (*line != ' ' && *line != '\t' && *line != '\r') return true;
+		}
+		return false;
+	};
+	auto stop = [](const char*, const char*) { return false; };
+	auto allocate = [&](long long lines) { resizeSet(set, std::min(lines, n), true); };
+	// Lines beyond the first n belong to later frames
+	auto parse = [&](const char* line, const char* lineEnd, long long i) {
+		if (i >= n) return true;
+		while (line < lineEnd && (*line == ' ' || *line == '\t')) ++line;
+		const char* name = line;
+		while (line < lineEnd && *line != ' ' && *line != '\t') ++line;
+		const char* nameEnd = line;
+		double x, y, z;
+		if (!parseNumber(line, lineEnd, x) || !parseNumber(line, lineEnd, y) || !parseNumber(line, lineEnd, z)) return false;
+		set.x[i] = x * ANGSTROM;
+		set.y[i] = y * ANGSTROM;
+		set.z[i] = z * ANGSTROM;
+		set.names[i] = std::string(name, nameEnd);
+		return true;
+	};
+	long long lines = parseLines(path, begin, atoms, end, isAtom, stop, allocate, parse);
+	if (lines < 0) return false;
+	if (lines < n) {
+		std::cout << "ERROR: " << path << " announces " << n << " atoms but holds " << lines << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool readNamdBin(const std::string& path, CoordinateSet& set)
+{
+	MappedFile file;
+	if (!file.open(path)) return false;
+	int32_t n = 0;
+	if (file.size() >= sizeof(n)) std::memcpy(&n, file.data(), sizeof(n));
+	if (n <= 0 || file.size() != sizeof(n) + (size_t)n * 3 * sizeof(double)) {
+		std::cout << "ERROR: " << path << " is not a NAMD binary coordinate file of this byte order" << std::endl;
+		return false;
+	}
+	resizeSet(set, n, false);
+	const char* data = file.data() + sizeof(n);
+	ThreadPool& tp = threadPool();
+	tp.run([&](int t) {
+		int first, last;
+		splitRange(n, tp.size(), t, first, last);
+		for (int i = first; i < last; ++i) {
+			// The doubles follow a 4-byte count, so they are not aligned
+			double r[3];
+			std::memcpy(r, data + (size_t)i * sizeof(r), sizeof(r));
+			set.x[i] = r[0] * ANGSTROM;
+			set.y[i] = r[1] * ANGSTROM;
+			set.z[i] = r[2] * ANGSTROM;
+		}
+	});
+	return true;
+}
+
+bool loadCoordinates(RunOptions& options, ParticleSystem& ps)
+{
+	const std::string plane = dimensions == 3 ? "xyz" : options.coordinatePlane;
+	if (plane != "xy" && plane != "xz" && plane != "yz" && plane != "xyz") {
+		std::cout << "ERROR: coordinateplane must be xy, xz or yz, got " << plane << std::endl;
+		return false;
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	CoordinateSet set;
+	if (!options.coordinates.empty()) {
+		std::string extension = options.coordinates.substr(options.coordinates.find_last_of('.') + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		bool ok = extension == "xyz" ? readXYZ(options.coordinates, set) : readPDB(options.coordinates, set);
+		if (!ok) return false;
+		std::cout << "Info: COORDINATE " << (extension == "xyz" ? "XYZ         " : "PDB         ") << options.coordinates << std::endl;
+	}
+	if (!options.binCoordinates.empty()) {
+		CoordinateSet binary;
+		if (!readNamdBin(options.binCoordinates, binary)) return false;
+		if (!options.coordinates.empty() && binary.size() != set.size()) {
+			std::cout << "ERROR: " << options.binCoordinates << " has " << binary.size() << " atoms, "
+				<< options.coordinates << " has " << set.size() << std::endl;
+			return false;
+		}
+		set.x.swap(binary.x);
+		set.y.swap(binary.y);
+		set.z.swap(binary.z);
+		std::cout << "Info: BINARY COORDINATES     " << options.binCoordinates << std::endl;
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	const int n = set.size();
+	ps.resize(n);
+	const std::vector<double>* axes[3] = { &set.x, &set.y, &set.z };
+	bool fromCell = true;
+	for (int d = 0; d < dimensions; ++d) {
+		const int axis = plane[d] - 'x';
+		std::copy(axes[axis]->begin(), axes[axis]->end(), ps.position(d).begin());
+		fromCell = fromCell && set.cell[axis] > 0.0;
+	}
+	if (fromCell) {
+		setBox(set.cell[plane[0] - 'x'], set.cell[plane[1] - 'x']);
+		if (dimensions == 3) LD = set.cell[2];
+	}
+	else {
+		// No cell: the atoms are centered in a box one eq_dist larger than their extent, as the lattices
+		double extent[3];
+		for (int d = 0; d < dimensions; ++d) {
+			std::vector<double>& r = ps.position(d);
+			auto [lo, hi] = std::minmax_element(r.begin(), r.end());
+			const double center = 0.5 * (*lo + *hi);
+			extent[d] = *hi - *lo + eq_dist;
+			for (int i = 0; i < n; ++i) r[i] -= center;
+		}
+		setBox(extent[0], extent[1]);
+		if (dimensions == 3) LD = extent[2];
+		options.cellFromExtent = true;
+	}
+	applyPBC(ps);
+	std::copy(ps.x.begin(), ps.x.end(), ps.xOld.begin());
+	std::copy(ps.y.begin(), ps.y.end(), ps.yOld.begin());
+	if (dimensions == 3) std::copy(ps.z.begin(), ps.z.end(), ps.zOld.begin());
+	Npart = n;
+
+	if (!options.parameterFiles.empty() && options.typeNames.empty() && !set.names.empty()) {
+		options.typeNames = set.names;
+	}
+	std::cout << "Info: READ " << n << " ATOMS IN " << seconds << " s, " << plane << " plane, cell "
+		<< LW / ANGSTROM << " x " << LH / ANGSTROM;
+	if (dimensions == 3) std::cout << " x " << LD / ANGSTROM;
+	std::cout << (fromCell ? " from CRYST1" : "") << std::endl;
+	return true;
+}
+
+bool loadInitialSystem(RunOptions& options, ParticleSystem& ps, NeighborList& nl)
+{
+	if (!options.restartFrom.empty()) {
+		// Continue a previous run: positions, previous positions and accelerations come from the checkpoint
+		if (!loadCheckpoint(options.restartFrom, ps, nl, options.firstStep)) return false;
+		std::cout << "Info: Restarting from " << options.restartFrom << " at step " << options.firstStep << std::endl;
+		return true;
+	}
+	if (!options.coordinates.empty() || !options.binCoordinates.empty()) {
+		if (!loadCoordinates(options, ps)) return false;
+	}
+	else {
+		if (options.lattice.empty()) options.lattice = dimensions == 3 ? "fcc" : "hexagonal";
+		if ((options.lattice == "fcc") != (dimensions == 3)) {
+			std::cout << "ERROR: the " << options.lattice << " lattice is " << (dimensions == 3 ? "2D" : "3D")
+				<< ", set dimensions " << (dimensions == 3 ? 2 : 3) << " or another lattice" << std::endl;
+			return false;
+		}
+		if (options.lattice == "fcc") fccLattice(ps, latticeX, latticeY, latticeZ);
+		else if (options.lattice == "square") squareLattice(ps, latticeX, latticeY, Npart);
+		else hexagonalLattice(ps, latticeX, latticeY, Npart);
+	}
+	if (options.boxWidth > 0 || options.boxHeight > 0 || (dimensions == 3 && options.boxDepth > 0)) {
+		setBox(options.boxWidth > 0 ? options.boxWidth : LW, options.boxHeight > 0 ? options.boxHeight : LH);
+		if (dimensions == 3 && options.boxDepth > 0) LD = options.boxDepth;
+		applyPBC(ps);
+		options.cellFromExtent = false;
+	}
+	return true;
+}
+
+bool fitBoxToCutoff(RunOptions& options, ParticleSystem& ps)
+{
+	const double least = 2.0 * (rCut + options.skin);
+	const bool threeD = dimensions == 3;
+	if (LW >= least && LH >= least && (!threeD || LD >= least)) return true;
+	if (options.cellFromExtent) {
+		// Vacuum around the atoms, which stay centered on the origin
+		setBox(std::max(LW, least), std::max(LH, least));
+		if (threeD) LD = std::max(LD, least);
+		applyPBC(ps);
+		std::cout << "Info: CELL PADDED TO " << LW / ANGSTROM << " x " << LH / ANGSTROM;
+		if (threeD) std::cout << " x " << LD / ANGSTROM;
+		std::cout << " A, twice the cutoff plus skin" << std::endl;
+		return true;
+	}
+	const bool fromFile = options.restartFrom.empty() && (!options.coordinates.empty() || !options.binCoordinates.empty());
+	std::cout << (fromFile ? "ERROR: " : "Warning: ") << "the box " << LW / ANGSTROM << " x " << LH / ANGSTROM;
+	if (threeD) std::cout << " x " << LD / ANGSTROM;
+	std::cout << " A is smaller than twice the cutoff plus skin (" << least / ANGSTROM
+		<< " A), so the minimum image misses pairs within the cutoff" << std::endl;
+	return !fromFile;
+}
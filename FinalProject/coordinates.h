@@ -0,0 +1,51 @@
+// COORDINATE FILES
+// Starting positions from PDB, XYZ and NAMD binary coordinate files. The files are memory-mapped
+// and split into one chunk of whole lines per thread; each thread counts its atoms, then parses
+// them straight into their final slots, so large files load at close to disk speed.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "md.h"
+#include "neighbor.h"
+
+// Atoms of a coordinate file, in the file's order
+struct CoordinateSet
+{
+	std::vector<double> x, y, z;    // m
+	std::vector<std::string> names; // Element, or atom name without one; empty for .coor files
+	double cell[3] = { 0.0, 0.0, 0.0 }; // CRYST1 edge lengths (m), 0 = not in the file
+
+	int size() const { return (int)x.size(); }
+};
+
+// Each reader prints the reason and returns false on error.
+// ATOM and HETATM records of the first model, and the CRYST1 cell when there is one
+bool readPDB(const std::string& path, CoordinateSet& set);
+// First frame of an XYZ file: atom count, comment line, then "name x y z" per atom
+bool readXYZ(const std::string& path, CoordinateSet& set);
+// NAMD binary coordinates (.coor, .restart.coor): int32 atom count, then x, y, z doubles per atom
+bool readNamdBin(const std::string& path, CoordinateSet& set);
+
+// Fills ps from options.coordinates (.pdb or .xyz) and options.binCoordinates, projected on
+// options.coordinatePlane in 2D. The box is the CRYST1 cell, or the extent of the atoms plus eq_dist
+// with the atoms centered in it. With parameter files and no types option, the atoms are typed
+// by their names in the file. Velocities are left to vInitial.
+bool loadCoordinates(RunOptions& options, ParticleSystem& ps);
+
+// Starting state of a run: the checkpoint options.restartFrom (which sets options.firstStep and
+// leaves the neighbor list positions in nl for NeighborList::restore), the coordinate files, or
+// a lattice of options.lattice, resized to boxwidth/boxheight/boxdepth when given. The FCC lattice
+// of 3D runs has latticex x latticey x latticez cubic cells of four atoms and ignores npart.
+// Prints the reason and returns false on error.
+bool loadInitialSystem(RunOptions& options, ParticleSystem& ps, NeighborList& nl);
+
+// The minimum image needs every side of the box to be at least twice the pair-list distance,
+// rCut + options.skin. A box made around the atoms of a coordinate file is padded to that size;
+// a smaller cell of a coordinate file (CRYST1, boxwidth/boxheight/boxdepth) is an error. The lattices
+// the program builds, 3 x 3 by default, and checkpoints only get a warning. Call it once
+// loadForceField has settled the cutoff and skin. Prints the reason and returns false on error.
+bool fitBoxToCutoff(RunOptions& options, ParticleSystem& ps);
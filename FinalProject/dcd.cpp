@@ -0,0 +1,229 @@
+#include "dcd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+
+static const double ANGSTROM = 1e-10;
+// DCD headers store the timestep in AKMA time units (1 AKMA = 48.88821 fs)
+static const double AKMA_FS = 48.88821;
+
+static bool writeInt(std::FILE* f, int32_t value)
+{
+	return std::fwrite(&value, sizeof(value), 1, f) == 1;
+}
+
+// Fortran unformatted record: length, payload, length
+static bool writeRecord(std::FILE* f, const void* data, int32_t bytes)
+{
+	return writeInt(f, bytes) && std::fwrite(data, 1, bytes, f) == (size_t)bytes && writeInt(f, bytes);
+}
+
+DCDFile::~DCDFile()
+{
+	close();
+}
+
+bool DCDFile::open(const std::string& path, int natoms, int firstStep, int stride, double timestepFs, bool unitCell)
+{
+	close();
+	file = std::fopen(path.c_str(), "wb");
+	if (file == nullptr) {
+		std::cout << "ERROR: cannot open DCD file " << path << " for writing" << std::endl;
+		return false;
+	}
+	this->natoms = natoms;
+	this->firstStep = firstStep;
+	this->stride = stride;
+	this->unitCell = unitCell;
+	frames = 0;
+	zeros.assign(natoms, 0.0f);
+
+	// Header in the CHARMM flavour that NAMD writes and VMD reads
+	char header[84] = {};
+	int32_t* control = (int32_t*)(header + 4);
+	std::memcpy(header, "CORD", 4);
+	control[0] = 0;         // NSET, frames in the file, patched after every frame
+	control[1] = firstStep; // ISTART
+	control[2] = stride;    // NSAVC
+	control[3] = 0;         // NSTEP, last step in the file, patched after every frame
+	float delta = (float)(timestepFs / AKMA_FS);
+	std::memcpy(&control[9], &delta, sizeof(delta));
+	control[10] = unitCell ? 1 : 0;
+	control[19] = 24; // CHARMM version
+
+	char title[4 + 2 * 80];
+	int32_t lines = 2;
+	std::memcpy(title, &lines, 4);
+	// Two 80-character title lines, space padded
+	std::memset(title + 4, ' ', 2 * 80);
+	std::string name = "REMARKS FILENAME=" + path;
+	std::memcpy(title + 4, name.c_str(), std::min<size_t>(name.size(), 80));
+	std::time_t now = std::time(nullptr);
+	char created[81];
+	size_t length = std::strftime(created, sizeof(created), "REMARKS DATE: %m/%d/%y CREATED BY MD ENGINE", std::localtime(&now));
+	std::memcpy(title + 84, created, length);
+
+	int32_t count = natoms;
+	if (!writeRecord(file, header, sizeof(header)) || !writeRecord(file, title, sizeof(title))
+		|| !writeRecord(file, &count, sizeof(count))) {
+		std::cout << "ERROR: cannot write DCD header to " << path << std::endl;
+		close();
+		return false;
+	}
+	std::fflush(file);
+	return true;
+}
+
+bool DCDFile::writeFrame(const float* x, const float* y, const float* z, const double* cell)
+{
+	int32_t bytes = natoms * (int32_t)sizeof(float);
+	bool ok = true;
+	if (unitCell) ok = writeRecord(file, cell, 6 * sizeof(double));
+	ok = ok && writeRecord(file, x, bytes) && writeRecord(file, y, bytes) && writeRecord(file, z != nullptr ? z : zeros.data(), bytes);
+	if (!ok) return false;
+	frames++;
+
+	// Keep the header consistent with what is on disk
+	long end = std::ftell(file);
+	int32_t lastStep = firstStep + (frames - 1) * stride;
+	std::fseek(file, 8, SEEK_SET);
+	writeInt(file, frames);
+	std::fseek(file, 20, SEEK_SET);
+	writeInt(file, lastStep);
+	std::fseek(file, end, SEEK_SET);
+	return std::fflush(file) == 0;
+}
+
+void DCDFile::close()
+{
+	if (file != nullptr) std::fclose(file);
+	file = nullptr;
+}
+
+TrajectoryWriter::TrajectoryWriter(int queueDepth)
+	: buffers(std::max(1, queueDepth))
+{
+	for (TrajectoryFrame& frame : buffers) freeList.push_back(&frame);
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+	close();
+}
+
+bool TrajectoryWriter::open(const std::string& dcdPath, const std::string& velPath, int natoms, long long firstStep,
+	int stride, bool unitCell)
+{
+	double timestepFs = dt * 1e15;
+	if (!positions.open(dcdPath, natoms, (int)firstStep, stride, timestepFs, unitCell)) return false;
+	withVelocities = !velPath.empty();
+	if (withVelocities && !velocities.open(velPath, natoms, (int)firstStep, stride, timestepFs, unitCell)) {
+		positions.close();
+		return false;
+	}
+	const int depth = dimensions == 3 ? natoms : 0;
+	for (TrajectoryFrame& frame : buffers) {
+		frame.x.resize(natoms);
+		frame.y.resize(natoms);
+		frame.z.resize(depth);
+		frame.vx.resize(withVelocities ? natoms : 0);
+		frame.vy.resize(withVelocities ? natoms : 0);
+		frame.vz.resize(withVelocities ? depth : 0);
+	}
+	closing = false;
+	writer = std::thread(&TrajectoryWriter::writerLoop, this);
+	return true;
+}
+
+void TrajectoryWriter::submit(const ParticleSystem& ps, const Integrator& integrator, long long step)
+{
+	TrajectoryFrame* frame;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (freeList.empty()) {
+			// The disk is behind by a whole queue: wait rather than lose a frame
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			freed.wait(lock, [&] { return !freeList.empty(); });
+			stalls++;
+			stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		frame = freeList.front();
+		freeList.pop_front();
+	}
+
+	frame->step = step;
+	const bool threeD = dimensions == 3;
+	const double cell[6] = { LW / ANGSTROM, 90.0, LH / ANGSTROM, 90.0, 90.0, threeD ? LD / ANGSTROM : 0.0 };
+	std::memcpy(frame->cell, cell, sizeof(cell));
+	// Atoms in their input order, whatever order spatial sorting left them in
+	for (int i = 0; i < ps.n; ++i) {
+		frame->x[ps.id[i]] = (float)(ps.x[i] / ANGSTROM);
+		frame->y[ps.id[i]] = (float)(ps.y[i] / ANGSTROM);
+		if (threeD) frame->z[ps.id[i]] = (float)(ps.z[i] / ANGSTROM);
+	}
+	if (withVelocities) {
+		// The velocities the kinetic energy and temperature of the ENERGY lines are computed from
+		const double toAngstromPerPs = 1.0 / (ANGSTROM * 1e12);
+		for (int i = 0; i < ps.n; ++i) {
+			double v[3];
+			integrator.velocity(ps, i, v);
+			frame->vx[ps.id[i]] = (float)(v[0] * toAngstromPerPs);
+			frame->vy[ps.id[i]] = (float)(v[1] * toAngstromPerPs);
+			if (threeD) frame->vz[ps.id[i]] = (float)(v[2] * toAngstromPerPs);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(frame);
+	}
+	queued.notify_one();
+}
+
+void TrajectoryWriter::writerLoop()
+{
+	for (;;) {
+		TrajectoryFrame* frame;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			queued.wait(lock, [&] { return closing || !queue.empty(); });
+			if (queue.empty()) return;
+			frame = queue.front();
+			queue.pop_front();
+		}
+
+		const float* z = frame->z.empty() ? nullptr : frame->z.data();
+		const float* vz = frame->vz.empty() ? nullptr : frame->vz.data();
+		bool ok = positions.writeFrame(frame->x.data(), frame->y.data(), z, frame->cell);
+		if (withVelocities) ok = velocities.writeFrame(frame->vx.data(), frame->vy.data(), vz, frame->cell) && ok;
+		if (!ok) std::cout << "ERROR: failed to write trajectory frame at step " << frame->step << std::endl;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			freeList.push_back(frame);
+			framesWritten++;
+		}
+		freed.notify_one();
+	}
+}
+
+void TrajectoryWriter::close()
+{
+	if (!writer.joinable()) return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closing = true;
+	}
+	queued.notify_one();
+	writer.join();
+	positions.close();
+	velocities.close();
+	std::cout << "Info: Wrote " << framesWritten << " trajectory frames";
+	if (stalls > 0) std::cout << ", integration waited " << stallSeconds << " s for the disk " << stalls << " times";
+	std::cout << std::endl;
+}
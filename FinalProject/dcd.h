@@ -0,0 +1,81 @@
+// DCD TRAJECTORIES
+// CHARMM/NAMD binary trajectory files, readable by VMD, written on a background thread
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "integrator.h"
+#include "md.h"
+
+// Synchronous writer of one DCD file. Coordinates are stored in Angstrom as 32-bit floats,
+// with z = 0 for 2D runs. The frame count in the header is updated after every frame, so a run
+// that dies still leaves a readable file.
+class DCDFile
+{
+public:
+	~DCDFile();
+	bool open(const std::string& path, int natoms, int firstStep, int stride, double timestepFs, bool unitCell);
+	// x, y and z hold natoms values each, z null for zeros; cell is {A, gamma, B, beta, alpha, C}
+	// in Angstrom and degrees
+	bool writeFrame(const float* x, const float* y, const float* z, const double* cell);
+	void close();
+	bool isOpen() const { return file != nullptr; }
+
+private:
+	std::FILE* file = nullptr;
+	int natoms = 0;
+	int frames = 0;
+	int firstStep = 0;
+	int stride = 1;
+	bool unitCell = false;
+	std::vector<float> zeros;
+};
+
+// One frame of a trajectory in output units: positions in Angstrom, velocities in Angstrom/ps
+struct TrajectoryFrame
+{
+	long long step = 0;
+	double cell[6];
+	std::vector<float> x, y, z, vx, vy, vz; // z and vz only in 3D
+};
+
+// Hands frames from the integration loop to a writer thread through a bounded queue.
+// Frame buffers are recycled, so steady-state output allocates nothing. If the disk falls
+// behind by more than queueDepth frames, submit() waits for a free buffer rather than drop
+// frames; such waits are counted and reported by close().
+class TrajectoryWriter
+{
+public:
+	TrajectoryWriter(int queueDepth = 8);
+	~TrajectoryWriter();
+
+	// velPath may be empty to skip velocities
+	bool open(const std::string& dcdPath, const std::string& velPath, int natoms, long long firstStep,
+		int stride, bool unitCell);
+	// Copies the positions of ps and the velocities of integrator; the caller decides which steps are written
+	void submit(const ParticleSystem& ps, const Integrator& integrator, long long step);
+	// Writes the queued frames and closes the files
+	void close();
+
+private:
+	void writerLoop();
+
+	DCDFile positions, velocities;
+	bool withVelocities = false;
+	std::vector<TrajectoryFrame> buffers;
+	std::deque<TrajectoryFrame*> queue, freeList;
+	std::mutex mutex;
+	std::condition_variable queued, freed;
+	std::thread writer;
+	bool closing = false;
+	long long stalls = 0;
+	double stallSeconds = 0.0;
+	long long framesWritten = 0;
+};
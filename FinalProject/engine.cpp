@@ -0,0 +1,186 @@
+#include "engine.h"
+#include "neighbor.h"
+
+#include <chrono>
+#include <iomanip>
+#include <random>
+
+// Starting state shared by both precisions, in reduced units
+struct PrecisionSetup
+{
+	int n = 0;
+	double L[3];
+	std::vector<double> r[3], v[3];
+};
+
+// 2D: hexagonal lattice with nearest neighbors eq_dist apart. 3D: FCC lattice with the same
+// nearest-neighbor distance. Velocities are Gaussian, without center-of-mass drift, scaled
+// to the configured temperature.
+static PrecisionSetup makeSetup(int dims, int cellsPerSide, unsigned long long seed)
+{
+	PrecisionSetup s;
+	const double a = eq_dist / sigma;
+	if (dims == 2) {
+		const int nx = cellsPerSide, ny = 2 * ((cellsPerSide + 1) / 2);
+		const double h = std::sqrt(0.75) * a;
+		s.L[0] = nx * a;
+		s.L[1] = ny * h;
+		for (int row = 0; row < ny; ++row) {
+			for (int col = 0; col < nx; ++col) {
+				s.r[0].push_back((col + 0.5 * (row % 2) + 0.25) * a - 0.5 * s.L[0]);
+				s.r[1].push_back((row + 0.5) * h - 0.5 * s.L[1]);
+			}
+		}
+	}
+	else {
+		const double cube = std::sqrt(2.0) * a;
+		const double basis[4][3] = { { 0, 0, 0 }, { 0.5, 0.5, 0 }, { 0.5, 0, 0.5 }, { 0, 0.5, 0.5 } };
+		for (int d = 0; d < 3; ++d) s.L[d] = cellsPerSide * cube;
+		for (int cz = 0; cz < cellsPerSide; ++cz)
+			for (int cy = 0; cy < cellsPerSide; ++cy)
+				for (int cx = 0; cx < cellsPerSide; ++cx)
+					for (int b = 0; b < 4; ++b) {
+						const int c[3] = { cx, cy, cz };
+						for (int d = 0; d < 3; ++d) s.r[d].push_back((c[d] + basis[b][d] + 0.25) * cube - 0.5 * s.L[d]);
+					}
+	}
+	s.n = (int)s.r[0].size();
+
+	std::default_random_engine eng((std::default_random_engine::result_type)seed);
+	std::normal_distribution<double> gauss(0.0, 1.0);
+	double sum2 = 0.0;
+	for (int d = 0; d < dims; ++d) {
+		s.v[d].resize(s.n);
+		double mean = 0.0;
+		for (int i = 0; i < s.n; ++i) mean += (s.v[d][i] = gauss(eng));
+		mean /= s.n;
+		for (int i = 0; i < s.n; ++i) {
+			s.v[d][i] -= mean;
+			sum2 += s.v[d][i] * s.v[d][i];
+		}
+	}
+	const double scale = std::sqrt(dims * s.n * ljReducedTemperature(temperature) / sum2);
+	for (int d = 0; d < dims; ++d)
+		for (int i = 0; i < s.n; ++i) s.v[d][i] *= scale;
+	return s;
+}
+
+struct PrecisionResult
+{
+	double nsPerParticleStep;
+	double drift;      // (E_end - E_0) / N
+	double maxError;   // max |E - E_0| / N over the run
+	std::vector<double> finalPositions[3];
+};
+
+template <int D, typename T>
+static PrecisionResult runPrecision(const PrecisionSetup& s, int steps, double dtReduced)
+{
+	Particles<D, T> ps;
+	ps.resize(s.n);
+	T L[D];
+	double Ld[D];
+	for (int d = 0; d < D; ++d) {
+		L[d] = (T)s.L[d];
+		Ld[d] = s.L[d];
+		for (int i = 0; i < s.n; ++i) {
+			ps.r[d][i] = (T)s.r[d][i];
+			ps.rOld[d][i] = (T)(s.r[d][i] - dtReduced * s.v[d][i]);
+		}
+	}
+	T* r[D];
+	T* rOld[D];
+	T* a[D];
+	ps.pointers(r, rOld, a);
+	const T* rc[D];
+	const T* ac[D];
+	for (int d = 0; d < D; ++d) {
+		rc[d] = r[d];
+		ac[d] = a[d];
+	}
+
+	BasicNeighborList<T> nl;
+	nl.skin = T(0.3);
+	const T rList = (T)(rCut / sigma) + nl.skin;
+	nl.template build<D>(rc, ps.n, L, rList);
+	const PairParams<D, T> p = makePairParams<D, T>(1.0, 1.0, rCut / sigma, Ld);
+	auto forces = [&]() {
+		for (int d = 0; d < D; ++d) std::fill(ps.a[d].begin(), ps.a[d].end(), T(0));
+		PairSums sums;
+		ljHalfListVector<D, T>(p, rc, nl.offsets.data(), nl.neighbors.data(), 0, ps.n, a, &sums);
+		return sums.energy;
+	};
+
+	const T dt2 = (T)(dtReduced * dtReduced);
+	double potential = forces();
+	double kineticBefore = halfStepKinetic<D, T>(ps, L, dtReduced, 1.0);
+	double e0 = 0.0, eLast = 0.0, maxError = 0.0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int step = 0; step < steps; ++step) {
+		verletPositions<D, T>(r, rOld, ac, dt2, 0, ps.n);
+		wrapPositions<D, T>(r, L, 0, ps.n);
+		// Kinetic energy at the force evaluation: mean of the half steps on either side of it
+		double kineticAfter = halfStepKinetic<D, T>(ps, L, dtReduced, 1.0);
+		double total = potential + 0.5 * (kineticBefore + kineticAfter);
+		if (step == 0) e0 = total;
+		maxError = std::max(maxError, std::abs(total - e0));
+		eLast = total;
+		kineticBefore = kineticAfter;
+		if (nl.template needsRebuild<D>(rc, ps.n, L)) nl.template build<D>(rc, ps.n, L, rList);
+		potential = forces();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	PrecisionResult result;
+	result.nsPerParticleStep = seconds / ((double)steps * s.n) * 1e9;
+	result.drift = (eLast - e0) / s.n;
+	result.maxError = maxError / s.n;
+	for (int d = 0; d < D; ++d) result.finalPositions[d].assign(ps.r[d].begin(), ps.r[d].end());
+	return result;
+}
+
+// RMS and largest minimum-image distance between two final configurations
+static void deviation(const PrecisionResult& a, const PrecisionResult& b, const PrecisionSetup& s, int dims,
+	double& rms, double& largest)
+{
+	double sum = 0.0;
+	largest = 0.0;
+	for (int i = 0; i < s.n; ++i) {
+		double d2 = 0.0;
+		for (int d = 0; d < dims; ++d) {
+			double dr = a.finalPositions[d][i] - b.finalPositions[d][i];
+			dr -= s.L[d] * std::round(dr / s.L[d]);
+			d2 += dr * dr;
+		}
+		sum += d2;
+		largest = std::max(largest, std::sqrt(d2));
+	}
+	rms = std::sqrt(sum / s.n);
+}
+
+template <int D>
+static void comparePrecisionIn(std::ostream& out, int cellsPerSide, int steps)
+{
+	const unsigned long long seed = rngSeed != 0 ? rngSeed : 12345;
+	const double dtReduced = dt / ljTimeUnit();
+	PrecisionSetup s = makeSetup(D, cellsPerSide, seed);
+	PrecisionResult d = runPrecision<D, double>(s, steps, dtReduced);
+	PrecisionResult f = runPrecision<D, float>(s, steps, dtReduced);
+	double rms, largest;
+	deviation(f, d, s, D, rms, largest);
+
+	out << D << "D, " << s.n << " particles, " << steps << " steps of " << dtReduced << " tau, T* = "
+		<< ljReducedTemperature(temperature) << std::endl;
+	out << "  precision  ns/particle-step  drift (eps/particle)  max |E-E0| (eps/particle)" << std::endl;
+	out << "  double     " << std::setw(16) << d.nsPerParticleStep << "  " << std::setw(20) << d.drift << "  " << d.maxError << std::endl;
+	out << "  float      " << std::setw(16) << f.nsPerParticleStep << "  " << std::setw(20) << f.drift << "  " << f.maxError << std::endl;
+	out << "  float vs double positions: rms " << rms << " sigma, max " << largest << " sigma" << std::endl;
+}
+
+void comparePrecision(std::ostream& out, int steps)
+{
+	out << "Float vs double, reduced Lennard-Jones units (rCut = " << rCut / sigma << " sigma, 1 tau = "
+		<< ljTimeUnit() * 1e12 << " ps), pair loops: " << ljVectorKernelName() << " in both" << std::endl;
+	comparePrecisionIn<2>(out, 30, steps);
+	comparePrecisionIn<3>(out, 6, steps);
+}
@@ -0,0 +1,186 @@
+// TEMPLATED ENGINE CORE
+// Periodic boundaries, Verlet integration and the Lennard-Jones pair loop, written once for any
+// dimension D and scalar type T; the neighbor list is BasicNeighborList<T> in neighbor.h.
+// The functions work on arrays of coordinate pointers (r[0] = x, r[1] = y, r[2] = z).
+// The simulation runs the double instantiations for D = 2 or 3, by the dimensions option, on the
+// ParticleSystem of md.h in SI units: applyPBC, integrate and NeighborList pick D at run time, and
+// the built-in 3D force is ljHalfListVector (2D keeps the forceKernel of ljkernel.h). Particles<D, T>
+// below holds any instantiation in reduced Lennard-Jones units for --compare-precision, the only
+// user of float: with both precisions through the same AVX2 loop, float took 141-157 ns per
+// particle-step in 2D against 121-145 for double, and 748-825 against 894-916 in 3D, too little
+// to give up the double energy drift of the production runs.
+
+#pragma once
+
+#include <cmath>
+#include <ostream>
+#include <vector>
+
+#include "md.h"
+
+// Reduced Lennard-Jones units: lengths in sigma, energies in epsilon, masses in cMass and time
+// in tau = sigma * sqrt(cMass / epsilon). Forces are of order one, so float does not overflow
+// (r^-12 in meters is about 1e120) and keeps its 24 bits of mantissa where they matter.
+inline double ljTimeUnit() { return sigma * std::sqrt(cMass / epsilon); }
+inline double ljReducedTemperature(double kelvin) { return Kb * kelvin / epsilon; }
+
+// Particles in D dimensions, stored as one array per coordinate
+template <int D, typename T>
+struct Particles
+{
+	int n = 0;
+	std::vector<T> r[D];    // Current positions
+	std::vector<T> rOld[D]; // Positions at the previous step
+	std::vector<T> a[D];    // Accelerations
+
+	void resize(int count)
+	{
+		n = count;
+		for (int d = 0; d < D; ++d) {
+			r[d].assign(n, T(0));
+			rOld[d].assign(n, T(0));
+			a[d].assign(n, T(0));
+		}
+	}
+	void pointers(T** pr, T** prOld, T** pa)
+	{
+		for (int d = 0; d < D; ++d) {
+			pr[d] = r[d].data();
+			prOld[d] = rOld[d].data();
+			pa[d] = a[d].data();
+		}
+	}
+};
+
+// Lennard-Jones coefficients and box, precomputed once per force evaluation
+template <int D, typename T>
+struct PairParams
+{
+	T c12, c6;   // Force coefficients, 48 * epsilon * sigma^12 and 24 * epsilon * sigma^6
+	T e12, e6;   // Energy coefficients, 4 * epsilon * sigma^12 and 4 * epsilon * sigma^6
+	T rCut2;     // Squared cutoff radius
+	T eShift;    // V(rCut), so the pair energy is zero at the cutoff
+	T L[D];      // Box lengths
+};
+
+template <int D, typename T>
+PairParams<D, T> makePairParams(double sig, double eps, double cutoff, const double* box)
+{
+	PairParams<D, T> p;
+	double s6 = std::pow(sig, 6);
+	double s12 = s6 * s6;
+	double rc6_inv = 1.0 / std::pow(cutoff, 6);
+	p.c12 = (T)(48.0 * eps * s12);
+	p.c6 = (T)(24.0 * eps * s6);
+	p.e12 = (T)(4.0 * eps * s12);
+	p.e6 = (T)(4.0 * eps * s6);
+	p.rCut2 = (T)(cutoff * cutoff);
+	p.eShift = (T)(4.0 * eps * (s12 * rc6_inv * rc6_inv - s6 * rc6_inv));
+	for (int d = 0; d < D; ++d) p.L[d] = (T)box[d];
+	return p;
+}
+
+// Wraps positions begin..end-1 into the box centered on the origin
+template <int D, typename T>
+void wrapPositions(T* const* r, const T* L, int begin, int end)
+{
+	for (int d = 0; d < D; ++d) {
+		T* rd = r[d];
+		const T Ld = L[d];
+		for (int i = begin; i < end; ++i) rd[i] -= Ld * std::floor(rd[i] / Ld + T(0.5));
+	}
+}
+
+// Position Verlet step for particles begin..end-1; the new position overwrites the old one in place
+template <int D, typename T>
+void verletPositions(T* const* r, T* const* rOld, const T* const* a, T dt2, int begin, int end)
+{
+	for (int d = 0; d < D; ++d) {
+		T* rd = r[d];
+		T* oldd = rOld[d];
+		const T* ad = a[d];
+		for (int i = begin; i < end; ++i) {
+			T rNew = 2 * rd[i] - oldd[i] + ad[i] * dt2;
+			oldd[i] = rd[i];
+			rd[i] = rNew;
+		}
+	}
+}
+
+// Accumulates the force of the pairs listed for particles iBegin..iEnd-1 into f, as ljkernel.h.
+// With Energy, also adds the truncated and shifted potential energy and the virial of those
+// pairs to sums; they are summed in double whatever T is, so they measure the trajectory
+// rather than the accumulator.
+template <int D, typename T, bool Energy>
+void ljHalfList(const PairParams<D, T>& p, const T* const* r, const int* offsets, const int* neighbors,
+	int iBegin, int iEnd, T* const* f, PairSums* sums)
+{
+	T invL[D];
+	for (int d = 0; d < D; ++d) invL[d] = T(1) / p.L[d];
+	double energy = 0.0, virial = 0.0;
+	for (int i = iBegin; i < iEnd; ++i) {
+		T ri[D], fi[D];
+		for (int d = 0; d < D; ++d) {
+			ri[d] = r[d][i];
+			fi[d] = T(0);
+		}
+		for (int k = offsets[i]; k < offsets[i + 1]; ++k) {
+			int j = neighbors[k];
+			T dr[D];
+			T d2 = T(0);
+			for (int d = 0; d < D; ++d) {
+				dr[d] = r[d][j] - ri[d];
+				dr[d] -= p.L[d] * std::round(dr[d] * invL[d]);
+				d2 += dr[d] * dr[d];
+			}
+			if (d2 >= p.rCut2) continue;
+			T r2_inv = T(1) / d2;
+			T r6_inv = r2_inv * r2_inv * r2_inv;
+			// Force on i along (rj - ri); negative means repulsion
+			T f_mag = -(p.c12 * r6_inv - p.c6) * r6_inv * r2_inv;
+			for (int d = 0; d < D; ++d) {
+				fi[d] += f_mag * dr[d];
+				f[d][j] -= f_mag * dr[d];
+			}
+			if (Energy) {
+				energy += (double)((p.e12 * r6_inv - p.e6) * r6_inv - p.eShift);
+				virial -= (double)(f_mag * d2);
+			}
+		}
+		for (int d = 0; d < D; ++d) f[d][i] += fi[d];
+	}
+	if (Energy) {
+		sums->energy += energy;
+		sums->virial += virial;
+	}
+}
+
+// Kinetic energy of the half step that ends at the current positions, sum of m v^2 / 2 with
+// v = (r - rOld) / dt taken as the minimum image, since r is wrapped into the box and rOld is not
+template <int D, typename T>
+double halfStepKinetic(const Particles<D, T>& ps, const T* L, double dt, double mass)
+{
+	double sum = 0.0;
+	for (int d = 0; d < D; ++d) {
+		for (int i = 0; i < ps.n; ++i) {
+			double dr = (double)ps.r[d][i] - (double)ps.rOld[d][i];
+			dr -= L[d] * std::round(dr / L[d]);
+			sum += dr * dr;
+		}
+	}
+	return 0.5 * mass * sum / (dt * dt);
+}
+
+// ljHalfList for D = 2 or 3 and T = float or double, with AVX2 when the CPU has it (ljkernel.cpp):
+// eight float or four double neighbors of i per iteration, the same loop otherwise. Both
+// precisions take the same path, so comparing them measures precision rather than vectorization.
+template <int D, typename T>
+void ljHalfListVector(const PairParams<D, T>& p, const T* const* r, const int* offsets, const int* neighbors,
+	int iBegin, int iEnd, T* const* f, PairSums* sums);
+// Kernel ljHalfListVector runs on this CPU, "avx2" or "scalar"
+const char* ljVectorKernelName();
+
+// Runs the same 2D hexagonal and 3D FCC systems with the float and double instantiations
+// from identical starting states, and reports the energy drift of each, the deviation of
+// the float trajectory from the double one and the time per particle-step.
+void comparePrecision(std::ostream& out, int steps);
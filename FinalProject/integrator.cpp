@@ -0,0 +1,363 @@
+#include "integrator.h"
+#include "profile.h"
+#include "spatialsort.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+static const double FEMTOSECOND = 1e-15;
+static const double PICOSECOND = 1e-12;
+static const double KCAL_PER_MOL = 4184.0 / 6.02214076e23; // J per particle
+
+// Calls body(begin, end) on every thread with its contiguous share of the n particles
+template <typename Body>
+static void forParticles(int n, const Body& body)
+{
+	ThreadPool& tp = threadPool();
+	tp.run([&](int t) {
+		int begin, end;
+		splitRange(n, tp.size(), t, begin, end);
+		body(begin, end);
+	});
+}
+
+bool Integrator::setup(const RunOptions& options, ParticleSystem& ps, NeighborList& nl)
+{
+	method = options.integrator == "adaptive" ? Adaptive : (options.integrator == "respa" ? Respa : Verlet);
+	energyFreq = options.outputEnergies;
+	firstStep = options.firstStep;
+	sortFreq = options.sortFreq;
+	sortCurve = options.sortCurve;
+	// Loaded structures can come in any order; lattices start sorted by rows. A checkpoint keeps
+	// the order of the run it came from, which the next multiple of sortfreq sorts again.
+	if (sortFreq > 0 && options.restartFrom.empty()) sortParticles(ps, nl);
+
+	const int D = dimensions;
+	if (method != Verlet) {
+		// Velocities at the current positions from the position Verlet state
+		for (int d = 0; d < D; ++d) v[d].resize(ps.n);
+		for (int i = 0; i < ps.n; ++i) {
+			if (D == 3) particleVelocity(ps, i, v[0][i], v[1][i], v[2][i]);
+			else particleVelocity(ps, i, v[0][i], v[1][i]);
+		}
+	}
+
+	if (method == Adaptive) {
+		if (options.adaptiveTolerance <= 0.0) {
+			std::cout << "ERROR: adaptivetolerance must be positive" << std::endl;
+			return false;
+		}
+		tolerance = options.adaptiveTolerance;
+		dtMax = options.maxTimestep > 0.0 ? options.maxTimestep : 10.0 * dt;
+		dt = std::min(dt, dtMax);
+		// Collisions may need steps well below the starting one
+		dtMin = dt / 64.0;
+		storeVelocities(ps);
+	}
+
+	if (method == Respa) {
+		if (options.respaSteps < 1) {
+			std::cout << "ERROR: respasteps must be at least 1" << std::endl;
+			return false;
+		}
+		respaSteps = options.respaSteps;
+		// Velocities only include the whole outer force at the end of a cycle, so energies, velocity
+		// frames and checkpoints are only taken there, and a run must start and stop there
+		if (energyFreq % respaSteps != 0 || firstStep % respaSteps != 0 || options.restartFreq % respaSteps != 0
+			|| (!options.dcdFile.empty() && options.dcdFreq % respaSteps != 0)
+			|| (options.headless && options.numSteps % respaSteps != 0)) {
+			std::cout << "ERROR: outputenergies, restartfreq, dcdfreq, numsteps and the restart step must be multiples of respasteps ("
+				<< respaSteps << ")" << std::endl;
+			return false;
+		}
+		if (!buildInnerTable(options.respaSplit, options.respaWidth, options.tableIntervals, innerTable, std::cout)) {
+			return false;
+		}
+		innerList.skin = nl.skin;
+		innerList.range = options.respaSplit;
+		innerList.build(ps);
+		for (int d = 0; d < D; ++d) {
+			innerA[d].assign(ps.n, 0.0);
+			outerA[d].assign(ps.n, 0.0);
+		}
+		calculateForce(ps, innerList, &innerTable, innerA[0].data(), innerA[1].data(), innerA[2].data());
+		innerCalls++;
+		for (int d = 0; d < D; ++d) {
+			const std::vector<double>& a = ps.acceleration(d);
+			for (int i = 0; i < ps.n; ++i) outerA[d][i] = a[i] - innerA[d][i];
+		}
+	}
+
+	if (energyFreq > 0) {
+		// Energies of the starting state; the forces go to scratch arrays, ps.ax is already current
+		std::vector<double> a[3];
+		for (int d = 0; d < D; ++d) a[d].resize(ps.n);
+		PairSums sums;
+		calculateForce(ps, nl, pairTable, a[0].data(), a[1].data(), a[2].data(), &sums);
+		recordEnergy(ps, sums);
+	}
+	return true;
+}
+
+void Integrator::step(ParticleSystem& ps, NeighborList& nl)
+{
+	MD_PROFILE_SCOPE("step");
+	// Energy and virial come out of the force pass of the step, never from a pass of their own
+	const bool energyDue = energyFreq > 0 && (firstStep + steps + 1) % energyFreq == 0;
+	PairSums sums;
+	PairSums* wanted = energyDue ? &sums : nullptr;
+	if (method == Adaptive) {
+		stepAdaptive(ps, nl, wanted);
+	}
+	else if (method == Respa) {
+		stepRespa(ps, nl, wanted);
+	}
+	else {
+		integrate(ps);
+		// Update accelerations based on new positions
+		nl.update(ps);
+		calculateForce(ps, nl, wanted);
+		forceCalls++;
+		simulatedTime += dt;
+	}
+	steps++;
+	if (energyDue) recordEnergy(ps, sums);
+	if (sortFreq > 0 && (firstStep + steps) % sortFreq == 0) sortParticles(ps, nl);
+}
+
+void Integrator::sortParticles(ParticleSystem& ps, NeighborList& nl)
+{
+	MD_PROFILE_SCOPE("spatial sort");
+	linesBefore += neighborCacheLines(nl);
+	std::vector<int> order;
+	// Cells of half the list range, as LAMMPS bins its sort, hold a handful of particles each
+	spatialOrder(ps, 0.5 * (rCut + nl.skin), sortCurve, order);
+	permuteParticles(ps, order);
+	for (int d = 0; d < 3; ++d) {
+		std::vector<double>* arrays[] = { &v[d], &innerA[d], &outerA[d] };
+		for (std::vector<double>* a : arrays) {
+			if (!a->empty()) permuteArray(*a, order);
+		}
+	}
+	nl.build(ps);
+	if (!innerList.offsets.empty()) innerList.build(ps);
+	linesAfter += neighborCacheLines(nl);
+	sorts++;
+}
+
+// Velocity Verlet with a step chosen from the local error estimate |a(t + h) - a(t)| h^2 / 6,
+// the third-order term of the position update that the method leaves out. A step whose error
+// exceeds twice the tolerance is taken again from the saved state with a shorter one.
+void Integrator::stepAdaptive(ParticleSystem& ps, NeighborList& nl, PairSums* sums)
+{
+	const int D = dimensions;
+	double* r[3];
+	double* a[3];
+	for (int d = 0; d < D; ++d) {
+		r[d] = ps.position(d).data();
+		a[d] = ps.acceleration(d).data();
+	}
+	// saved[d], saved[D + d] and saved[2 D + d] are coordinate d of the positions, velocities and accelerations
+	double* state[9];
+	for (int d = 0; d < D; ++d) {
+		state[d] = r[d];
+		state[D + d] = v[d].data();
+		state[2 * D + d] = a[d];
+	}
+	for (int k = 0; k < 3 * D; ++k) saved[k].resize(ps.n);
+	forParticles(ps.n, [&](int begin, int end) {
+		for (int k = 0; k < 3 * D; ++k) std::copy(state[k] + begin, state[k] + end, saved[k].begin() + begin);
+	});
+
+	double h = dt;
+	double error = 0.0;
+	for (;;) {
+		forParticles(ps.n, [&](int begin, int end) {
+			for (int d = 0; d < D; ++d) {
+				double* vd = v[d].data();
+				for (int i = begin; i < end; ++i) {
+					vd[i] += 0.5 * h * a[d][i];
+					r[d][i] += h * vd[i];
+				}
+			}
+			applyPBC(ps, begin, end);
+		});
+		nl.update(ps);
+		calculateForce(ps, nl, sums);
+		forceCalls++;
+
+		double change2 = 0.0;
+		for (int i = 0; i < ps.n; ++i) {
+			double change = 0.0;
+			for (int d = 0; d < D; ++d) {
+				double da = a[d][i] - saved[2 * D + d][i];
+				change += da * da;
+			}
+			change2 = std::max(change2, change);
+		}
+		error = std::sqrt(change2) * h * h / 6.0;
+		if (error <= 2.0 * tolerance || h <= dtMin) break;
+
+		rejected++;
+		forParticles(ps.n, [&](int begin, int end) {
+			for (int k = 0; k < 3 * D; ++k) std::copy(saved[k].begin() + begin, saved[k].begin() + end, state[k] + begin);
+		});
+		nl.update(ps);
+		h = std::max(dtMin, h * std::max(0.25, 0.9 * std::cbrt(tolerance / error)));
+	}
+
+	simulatedTime += h;
+	// The error scales as h^3; grow or shrink by at most a factor of two per step
+	double factor = error > 0.0 ? 0.9 * std::cbrt(tolerance / error) : 2.0;
+	dt = std::min(dtMax, std::max(dtMin, h * std::min(2.0, std::max(0.5, factor))));
+	const double halfDt2 = 0.5 * dt * dt;
+	forParticles(ps.n, [&](int begin, int end) {
+		for (int d = 0; d < D; ++d) {
+			double* vd = v[d].data();
+			double* old = ps.oldPosition(d).data();
+			for (int i = begin; i < end; ++i) {
+				vd[i] += 0.5 * h * a[d][i];
+				// As storeVelocities, for the next step's dt
+				old[i] = r[d][i] - vd[i] * dt + a[d][i] * halfDt2;
+			}
+		}
+	});
+}
+
+// Impulse r-RESPA: the outer force kicks the velocities by half a cycle at the start and the end
+// of every respaSteps steps, and velocity Verlet with the inner force runs in between. The inner
+// force has its own neighbor list up to the split, so an inner step touches only close pairs; the
+// outer force is the full one, from the usual kernels, minus the inner force at the same positions.
+void Integrator::stepRespa(ParticleSystem& ps, NeighborList& nl, PairSums* sums)
+{
+	const int D = dimensions;
+	const double outerKick = 0.5 * respaSteps * dt;
+	const bool startCycle = phase == 0;
+	forParticles(ps.n, [&](int begin, int end) {
+		for (int d = 0; d < D; ++d) {
+			double* r = ps.position(d).data();
+			double* vd = v[d].data();
+			const double* inner = innerA[d].data();
+			const double* outer = outerA[d].data();
+			for (int i = begin; i < end; ++i) {
+				if (startCycle) vd[i] += outerKick * outer[i];
+				vd[i] += 0.5 * dt * inner[i];
+				r[i] += dt * vd[i];
+			}
+		}
+		applyPBC(ps, begin, end);
+	});
+	innerList.update(ps);
+	calculateForce(ps, innerList, &innerTable, innerA[0].data(), innerA[1].data(), innerA[2].data());
+	innerCalls++;
+
+	phase++;
+	const bool endCycle = phase == respaSteps;
+	if (endCycle) {
+		// The full list is only needed, and only checked, at the end of a cycle
+		nl.update(ps);
+		calculateForce(ps, nl, sums);
+		forceCalls++;
+		phase = 0;
+	}
+	const double halfDt2 = 0.5 * dt * dt;
+	forParticles(ps.n, [&](int begin, int end) {
+		for (int d = 0; d < D; ++d) {
+			const double* r = ps.position(d).data();
+			double* old = ps.oldPosition(d).data();
+			double* a = ps.acceleration(d).data();
+			double* vd = v[d].data();
+			const double* inner = innerA[d].data();
+			double* outer = outerA[d].data();
+			for (int i = begin; i < end; ++i) {
+				vd[i] += 0.5 * dt * inner[i];
+				if (endCycle) {
+					outer[i] = a[i] - inner[i];
+					vd[i] += outerKick * outer[i];
+				}
+				else {
+					a[i] = inner[i] + outer[i];
+				}
+				// As storeVelocities, in the same pass
+				old[i] = r[i] - vd[i] * dt + a[i] * halfDt2;
+			}
+		}
+	});
+	simulatedTime += dt;
+}
+
+void Integrator::storeVelocities(ParticleSystem& ps) const
+{
+	const double halfDt2 = 0.5 * dt * dt;
+	forParticles(ps.n, [&](int begin, int end) {
+		for (int d = 0; d < dimensions; ++d) {
+			const double* r = ps.position(d).data();
+			const double* a = ps.acceleration(d).data();
+			double* old = ps.oldPosition(d).data();
+			for (int i = begin; i < end; ++i) old[i] = r[i] - v[d][i] * dt + a[i] * halfDt2;
+		}
+	});
+}
+
+double Integrator::kinetic(const ParticleSystem& ps) const
+{
+	if (method == Verlet) return kineticEnergy(ps);
+	double sum = 0.0;
+	for (int i = 0; i < ps.n; ++i) {
+		double v2 = 0.0;
+		for (int d = 0; d < dimensions; ++d) v2 += v[d][i] * v[d][i];
+		sum += v2;
+	}
+	return 0.5 * cMass * sum;
+}
+
+void Integrator::recordEnergy(const ParticleSystem& ps, const PairSums& sums)
+{
+	lastEnergy.step = firstStep + steps;
+	lastEnergy.potential = sums.energy;
+	lastEnergy.kinetic = kinetic(ps);
+	lastEnergy.virial = sums.virial;
+	energyTimes.push_back(simulatedTime);
+	energies.push_back(lastEnergy.potential + lastEnergy.kinetic);
+}
+
+void Integrator::report(const ParticleSystem& ps, std::ostream& out) const
+{
+	static const char* names[] = { "verlet", "adaptive", "respa" };
+	const double picoseconds = simulatedTime / PICOSECOND;
+	out << "Info: INTEGRATOR " << names[method] << ": " << steps << " steps in " << picoseconds << " ps";
+	if (method == Adaptive && steps > 0) {
+		out << " (mean timestep " << simulatedTime / steps / FEMTOSECOND << " fs, " << rejected << " steps retaken)";
+	}
+	out << ", " << forceCalls << " force evaluations";
+	if (picoseconds > 0.0) out << " (" << forceCalls / picoseconds << " per ps)";
+	if (method == Respa) out << " and " << innerCalls << " inner ones";
+	out << std::endl;
+	if (sorts > 0) {
+		out << "Info: SPATIAL SORT " << sortCurve << ": " << sorts << " sorts, neighbors of a particle on " << linesBefore / sorts
+			<< " cache lines before and " << linesAfter / sorts << " after a sort (mean)" << std::endl;
+	}
+
+	const int samples = (int)energies.size();
+	if (samples < 2) {
+		out << "Info: ENERGY DRIFT not measured, fewer than two energy samples (outputenergies)" << std::endl;
+		return;
+	}
+	// Least-squares slope of E(t), and the largest excursion from the first sample
+	double meanT = 0.0, meanE = 0.0;
+	for (int k = 0; k < samples; ++k) {
+		meanT += energyTimes[k] / samples;
+		meanE += energies[k] / samples;
+	}
+	double stt = 0.0, ste = 0.0, largest = 0.0;
+	for (int k = 0; k < samples; ++k) {
+		stt += (energyTimes[k] - meanT) * (energyTimes[k] - meanT);
+		ste += (energyTimes[k] - meanT) * (energies[k] - meanE);
+		largest = std::max(largest, std::abs(energies[k] - energies[0]));
+	}
+	const double perAtom = 1.0 / (ps.n * KCAL_PER_MOL);
+	out << "Info: ENERGY DRIFT " << ste / stt * 1e-9 * perAtom << " kcal/mol/atom/ns over " << samples
+		<< " samples, largest |E - E0| " << largest * perAtom << " kcal/mol/atom" << std::endl;
+}
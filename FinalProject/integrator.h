@@ -0,0 +1,99 @@
+// INTEGRATORS
+// Fixed-step position Verlet, velocity Verlet with an error-controlled timestep, and r-RESPA
+// multiple time stepping, behind one step() used by both run loops
+
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "md.h"
+#include "neighbor.h"
+#include "potential.h"
+
+// Energies at one step, from the pair loop and the integrator's velocities
+struct EnergySample
+{
+	long long step = -1;    // Absolute step number
+	double potential = 0.0; // J
+	double kinetic = 0.0;   // J
+	double virial = 0.0;    // Sum over pairs of r_ij . F_ij (J)
+};
+
+class Integrator
+{
+public:
+	// Prepares the integrator from options.integrator; the accelerations in ps must be current.
+	// Prints the reason and returns false on bad settings.
+	bool setup(const RunOptions& options, ParticleSystem& ps, NeighborList& nl);
+	// Advances one step and leaves positions, accelerations and the neighbor list current.
+	// Whatever the method, xOld is left where position Verlet would have it for the current dt,
+	// so velocities, checkpoints and trajectories read the state the same way.
+	void step(ParticleSystem& ps, NeighborList& nl);
+
+	double time() const { return simulatedTime; } // Simulated time of this run (s)
+	// Velocity of particle i (m/s) into vi[0 .. dimensions - 1]: the integrator's own for adaptive
+	// and respa, from xOld for verlet
+	void velocity(const ParticleSystem& ps, int i, double* vi) const
+	{
+		if (method == Verlet && dimensions == 3) particleVelocity(ps, i, vi[0], vi[1], vi[2]);
+		else if (method == Verlet) particleVelocity(ps, i, vi[0], vi[1]);
+		else {
+			for (int d = 0; d < dimensions; ++d) vi[d] = v[d][i];
+		}
+	}
+	long long stepCount() const { return steps; }
+	// True between the outer kicks of an r-RESPA cycle, where the velocities lack part of the outer force
+	bool midCycle() const { return method == Respa && phase != 0; }
+	// Latest energies, taken every outputEnergies steps in the force pass of that step
+	const EnergySample& energy() const { return lastEnergy; }
+	// Method, force evaluations per simulated picosecond and the energy drift of the run
+	void report(const ParticleSystem& ps, std::ostream& out) const;
+
+private:
+	enum Method { Verlet, Adaptive, Respa };
+
+	// sums, when not null, receives the energy and virial of the last full force evaluation
+	void stepAdaptive(ParticleSystem& ps, NeighborList& nl, PairSums* sums);
+	void stepRespa(ParticleSystem& ps, NeighborList& nl, PairSums* sums);
+	// xOld = x - v dt + a dt^2 / 2, the previous position of the equivalent position Verlet step
+	void storeVelocities(ParticleSystem& ps) const;
+	double kinetic(const ParticleSystem& ps) const;
+	void recordEnergy(const ParticleSystem& ps, const PairSums& sums);
+	// Reorders the particles and every per-particle array of the integrator along sortCurve,
+	// then rebuilds the neighbor lists for the new order
+	void sortParticles(ParticleSystem& ps, NeighborList& nl);
+
+	Method method = Verlet;
+	double simulatedTime = 0.0;
+	long long firstStep = 0;
+	long long steps = 0;
+	long long forceCalls = 0; // Evaluations over the full neighbor list
+	long long innerCalls = 0; // r-RESPA inner evaluations
+	std::vector<double> v[3]; // Velocities at the current positions (m/s) per coordinate, adaptive and respa
+
+	// Adaptive timestep
+	double tolerance = 0.0, dtMin = 0.0, dtMax = 0.0;
+	long long rejected = 0;
+	std::vector<double> saved[9]; // Positions, velocities and accelerations at the start of the step
+
+	// r-RESPA
+	int respaSteps = 1;
+	int phase = 0; // Inner steps since the last outer force
+	PairTable innerTable;
+	NeighborList innerList;
+	std::vector<double> innerA[3], outerA[3]; // Per coordinate; outer = full - inner, from the last full force
+
+	// Spatial sorting
+	int sortFreq = 0;
+	std::string sortCurve;
+	long long sorts = 0;
+	double linesBefore = 0.0, linesAfter = 0.0; // Sums over the sorts of neighborCacheLines
+
+	// Total energy (J) every energyFreq steps and the time it was taken at (s)
+	int energyFreq = 0;
+	EnergySample lastEnergy;
+	std::vector<double> energyTimes, energies;
+};
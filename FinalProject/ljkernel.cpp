@@ -0,0 +1,903 @@
+#include "ljkernel.h"
+#include "engine.h"
+#include "md.h"
+#include "neighbor.h"
+#include "potential.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+LJParams makeLJParams()
+{
+	LJParams p;
+	double s6 = std::pow(sigma, 6);
+	double s12 = s6 * s6;
+	p.c12 = 48.0 * epsilon * s12;
+	p.c6 = 24.0 * epsilon * s6;
+	p.e12 = 4.0 * epsilon * s12;
+	p.e6 = 4.0 * epsilon * s6;
+	p.rCut2 = rCut * rCut;
+	double rc6_inv = 1.0 / (p.rCut2 * p.rCut2 * p.rCut2);
+	p.eShift = 4.0 * epsilon * (s12 * rc6_inv * rc6_inv - s6 * rc6_inv);
+	p.boxW = LW;
+	p.boxH = LH;
+	return p;
+}
+
+void ljForceScalar(const LJParams& p, const double* x, const double* y,
+	const int* offsets, const int* neighbors, int iBegin, int iEnd, double* fx, double* fy, PairSums* sums)
+{
+	// The 2D double instantiation of the generic pair loop
+	PairParams<2, double> pp;
+	pp.c12 = p.c12;
+	pp.c6 = p.c6;
+	pp.e12 = p.e12;
+	pp.e6 = p.e6;
+	pp.rCut2 = p.rCut2;
+	pp.eShift = p.eShift;
+	pp.L[0] = p.boxW;
+	pp.L[1] = p.boxH;
+	const double* r[2] = { x, y };
+	double* f[2] = { fx, fy };
+	if (sums != nullptr) ljHalfList<2, double, true>(pp, r, offsets, neighbors, iBegin, iEnd, f, sums);
+	else ljHalfList<2, double, false>(pp, r, offsets, neighbors, iBegin, iEnd, f, nullptr);
+}
+
+// Minimum image of the difference of two wrapped coordinates, which is less than one box
+static inline double batchImage(double d, double L)
+{
+	if (d > 0.5 * L) return d - L;
+	if (d < -0.5 * L) return d + L;
+	return d;
+}
+
+template <bool Energy>
+static void ljBatchLanes(const LJParams& p, int n, const double* r, double* f, double* energy)
+{
+	const int W = LJ_BATCH_LANES;
+	const double* x = r;
+	const double* y = r + (size_t)n * W;
+	double* fx = f;
+	double* fy = f + (size_t)n * W;
+	std::fill(f, f + 2 * (size_t)n * W, 0.0);
+	double e[LJ_BATCH_LANES] = {};
+	for (int i = 0; i < n; ++i) {
+		for (int j = i + 1; j < n; ++j) {
+			for (int l = 0; l < W; ++l) {
+				const double dx = batchImage(x[j * W + l] - x[i * W + l], p.boxW);
+				const double dy = batchImage(y[j * W + l] - y[i * W + l], p.boxH);
+				const double d2 = dx * dx + dy * dy;
+				if (d2 >= p.rCut2) continue;
+				const double r2_inv = 1.0 / d2;
+				const double r6_inv = r2_inv * r2_inv * r2_inv;
+				const double f_mag = -(p.c12 * r6_inv - p.c6) * r6_inv * r2_inv;
+				fx[i * W + l] += f_mag * dx;
+				fy[i * W + l] += f_mag * dy;
+				fx[j * W + l] -= f_mag * dx;
+				fy[j * W + l] -= f_mag * dy;
+				if (Energy) e[l] += (p.e12 * r6_inv - p.e6) * r6_inv - p.eShift;
+			}
+		}
+	}
+	if (Energy) std::copy(e, e + W, energy);
+}
+
+void ljBatchScalar(const LJParams& p, int n, const double* r, double* f, double* energy)
+{
+	if (energy != nullptr) ljBatchLanes<true>(p, n, r, f, energy);
+	else ljBatchLanes<false>(p, n, r, f, nullptr);
+}
+
+#ifdef MD_X86
+MD_TARGET_AVX2
+static inline double hsum(__m256d v)
+{
+	__m128d lo = _mm256_castpd256_pd128(v);
+	__m128d hi = _mm256_extractf128_pd(v, 1);
+	lo = _mm_add_pd(lo, hi);
+	return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+// Four neighbors of i per iteration. Positions of j are gathered; the reaction on j is
+// written back lane by lane, since AVX2 has no scatter.
+template <bool Energy>
+MD_TARGET_AVX2
+static void ljAVX2(const LJParams& p, const double* x, const double* y,
+	const int* offsets, const int* neighbors, int iBegin, int iEnd, double* fx, double* fy, PairSums* sums)
+{
+	const __m256d boxW = _mm256_set1_pd(p.boxW), boxH = _mm256_set1_pd(p.boxH);
+	const __m256d invW = _mm256_set1_pd(1.0 / p.boxW), invH = _mm256_set1_pd(1.0 / p.boxH);
+	const __m256d c12 = _mm256_set1_pd(p.c12), c6 = _mm256_set1_pd(p.c6);
+	const __m256d rCut2 = _mm256_set1_pd(p.rCut2);
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d e12 = _mm256_set1_pd(p.e12), e6 = _mm256_set1_pd(p.e6), eShift = _mm256_set1_pd(p.eShift);
+	const int round = _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC;
+	alignas(32) double fjx[4], fjy[4];
+	__m256d energy = _mm256_setzero_pd(), virial = _mm256_setzero_pd();
+	double energyTail = 0.0, virialTail = 0.0;
+
+	for (int i = iBegin; i < iEnd; ++i) {
+		const __m256d xi = _mm256_set1_pd(x[i]), yi = _mm256_set1_pd(y[i]);
+		__m256d fxi = _mm256_setzero_pd(), fyi = _mm256_setzero_pd();
+		int k = offsets[i];
+		const int end = offsets[i + 1];
+		for (; k + 4 <= end; k += 4) {
+			__m128i j = _mm_loadu_si128((const __m128i*)(neighbors + k));
+			__m256d dx = _mm256_sub_pd(_mm256_i32gather_pd(x, j, 8), xi);
+			__m256d dy = _mm256_sub_pd(_mm256_i32gather_pd(y, j, 8), yi);
+			dx = _mm256_fnmadd_pd(boxW, _mm256_round_pd(_mm256_mul_pd(dx, invW), round), dx);
+			dy = _mm256_fnmadd_pd(boxH, _mm256_round_pd(_mm256_mul_pd(dy, invH), round), dy);
+			__m256d d2 = _mm256_fmadd_pd(dx, dx, _mm256_mul_pd(dy, dy));
+			__m256d inside = _mm256_cmp_pd(d2, rCut2, _CMP_LT_OQ);
+			if (_mm256_movemask_pd(inside) == 0) continue;
+			__m256d r2_inv = _mm256_div_pd(one, d2);
+			__m256d r6_inv = _mm256_mul_pd(_mm256_mul_pd(r2_inv, r2_inv), r2_inv);
+			__m256d f_mag = _mm256_mul_pd(_mm256_fmsub_pd(c12, r6_inv, c6), _mm256_mul_pd(r6_inv, r2_inv));
+			f_mag = _mm256_and_pd(f_mag, inside);
+			if (Energy) {
+				__m256d e = _mm256_sub_pd(_mm256_mul_pd(_mm256_fmsub_pd(e12, r6_inv, e6), r6_inv), eShift);
+				energy = _mm256_add_pd(energy, _mm256_and_pd(e, inside));
+				virial = _mm256_fmadd_pd(f_mag, d2, virial);
+			}
+			// f_mag here is the opposite sign of the scalar kernel: force on j along (rj - ri)
+			__m256d fx_pair = _mm256_mul_pd(f_mag, dx);
+			__m256d fy_pair = _mm256_mul_pd(f_mag, dy);
+			fxi = _mm256_sub_pd(fxi, fx_pair);
+			fyi = _mm256_sub_pd(fyi, fy_pair);
+			_mm256_store_pd(fjx, fx_pair);
+			_mm256_store_pd(fjy, fy_pair);
+			for (int l = 0; l < 4; ++l) {
+				int jl = neighbors[k + l];
+				fx[jl] += fjx[l];
+				fy[jl] += fjy[l];
+			}
+		}
+		double fxs = hsum(fxi), fys = hsum(fyi);
+		for (; k < end; ++k) {
+			int j = neighbors[k];
+			double dx = x[j] - x[i];
+			double dy = y[j] - y[i];
+			dx -= p.boxW * std::round(dx * (1.0 / p.boxW));
+			dy -= p.boxH * std::round(dy * (1.0 / p.boxH));
+			double d2 = dx * dx + dy * dy;
+			if (d2 >= p.rCut2) continue;
+			double r2_inv = 1.0 / d2;
+			double r6_inv = r2_inv * r2_inv * r2_inv;
+			double f_mag = -(p.c12 * r6_inv - p.c6) * r6_inv * r2_inv;
+			fxs += f_mag * dx;
+			fys += f_mag * dy;
+			fx[j] -= f_mag * dx;
+			fy[j] -= f_mag * dy;
+			if (Energy) {
+				energyTail += (p.e12 * r6_inv - p.e6) * r6_inv - p.eShift;
+				virialTail -= f_mag * d2;
+			}
+		}
+		fx[i] += fxs;
+		fy[i] += fys;
+	}
+	if (Energy) {
+		sums->energy += hsum(energy) + energyTail;
+		sums->virial += hsum(virial) + virialTail;
+	}
+}
+
+void ljForceAVX2(const LJParams& p, const double* x, const double* y,
+	const int* offsets, const int* neighbors, int iBegin, int iEnd, double* fx, double* fy, PairSums* sums)
+{
+	if (sums != nullptr) ljAVX2<true>(p, x, y, offsets, neighbors, iBegin, iEnd, fx, fy, sums);
+	else ljAVX2<false>(p, x, y, offsets, neighbors, iBegin, iEnd, fx, fy, nullptr);
+}
+
+// Eight neighbors of i per iteration. The j indices of one row are distinct, so the
+// reaction can be applied with a gather-subtract-scatter without lane conflicts.
+template <bool Energy>
+MD_TARGET_AVX512
+static void ljAVX512(const LJParams& p, const double* x, const double* y,
+	const int* offsets, const int* neighbors, int iBegin, int iEnd, double* fx, double* fy, PairSums* sums)
+{
+	const __m512d boxW = _mm512_set1_pd(p.boxW), boxH = _mm512_set1_pd(p.boxH);
+	const __m512d invW = _mm512_set1_pd(1.0 / p.boxW), invH = _mm512_set1_pd(1.0 / p.boxH);
+	const __m512d c12 = _mm512_set1_pd(p.c12), c6 = _mm512_set1_pd(p.c6);
+	const __m512d rCut2 = _mm512_set1_pd(p.rCut2);
+	const __m512d one = _mm512_set1_pd(1.0);
+	const __m512d e12 = _mm512_set1_pd(p.e12), e6 = _mm512_set1_pd(p.e6), eShift = _mm512_set1_pd(p.eShift);
+	const int round = _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC;
+	__m512d energy = _mm512_setzero_pd(), virial = _mm512_setzero_pd();
+
+	for (int i = iBegin; i < iEnd; ++i) {
+		const __m512d xi = _mm512_set1_pd(x[i]), yi = _mm512_set1_pd(y[i]);
+		__m512d fxi = _mm512_setzero_pd(), fyi = _mm512_setzero_pd();
+		const int begin = offsets[i];
+		const int end = offsets[i + 1];
+		for (int k = begin; k < end; k += 8) {
+			// The last chunk of the row is handled with a lane mask instead of a scalar tail
+			__mmask8 lanes = end - k >= 8 ? (__mmask8)0xFF : (__mmask8)((1u << (end - k)) - 1);
+			__m256i j;
+			if (lanes == 0xFF) {
+				j = _mm256_loadu_si256((const __m256i*)(neighbors + k));
+			}
+			else {
+				alignas(32) int tail[8] = { 0 };
+				std::memcpy(tail, neighbors + k, (end - k) * sizeof(int));
+				j = _mm256_load_si256((const __m256i*)tail);
+			}
+			__m512d dx = _mm512_sub_pd(_mm512_mask_i32gather_pd(xi, lanes, j, x, 8), xi);
+			__m512d dy = _mm512_sub_pd(_mm512_mask_i32gather_pd(yi, lanes, j, y, 8), yi);
+			dx = _mm512_fnmadd_pd(boxW, _mm512_roundscale_pd(_mm512_mul_pd(dx, invW), round), dx);
+			dy = _mm512_fnmadd_pd(boxH, _mm512_roundscale_pd(_mm512_mul_pd(dy, invH), round), dy);
+			__m512d d2 = _mm512_fmadd_pd(dx, dx, _mm512_mul_pd(dy, dy));
+			__mmask8 inside = _mm512_mask_cmp_pd_mask(lanes, d2, rCut2, _CMP_LT_OQ);
+			if (inside == 0) continue;
+			__m512d r2_inv = _mm512_maskz_div_pd(inside, one, d2);
+			__m512d r6_inv = _mm512_mul_pd(_mm512_mul_pd(r2_inv, r2_inv), r2_inv);
+			__m512d f_mag = _mm512_mul_pd(_mm512_fmsub_pd(c12, r6_inv, c6), _mm512_mul_pd(r6_inv, r2_inv));
+			if (Energy) {
+				__m512d e = _mm512_sub_pd(_mm512_mul_pd(_mm512_fmsub_pd(e12, r6_inv, e6), r6_inv), eShift);
+				energy = _mm512_mask_add_pd(energy, inside, energy, e);
+				virial = _mm512_mask3_fmadd_pd(f_mag, d2, virial, inside);
+			}
+			__m512d fx_pair = _mm512_mul_pd(f_mag, dx);
+			__m512d fy_pair = _mm512_mul_pd(f_mag, dy);
+			fxi = _mm512_mask_sub_pd(fxi, inside, fxi, fx_pair);
+			fyi = _mm512_mask_sub_pd(fyi, inside, fyi, fy_pair);
+			__m512d fjx = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), inside, j, fx, 8);
+			__m512d fjy = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), inside, j, fy, 8);
+			_mm512_mask_i32scatter_pd(fx, inside, j, _mm512_add_pd(fjx, fx_pair), 8);
+			_mm512_mask_i32scatter_pd(fy, inside, j, _mm512_add_pd(fjy, fy_pair), 8);
+		}
+		fx[i] += _mm512_reduce_add_pd(fxi);
+		fy[i] += _mm512_reduce_add_pd(fyi);
+	}
+	if (Energy) {
+		sums->energy += _mm512_reduce_add_pd(energy);
+		sums->virial += _mm512_reduce_add_pd(virial);
+	}
+}
+
+void ljForceAVX512(const LJParams& p, const double* x, const double* y,
+	const int* offsets, const int* neighbors, int iBegin, int iEnd, double* fx, double* fy, PairSums* sums)
+{
+	if (sums != nullptr) ljAVX512<true>(p, x, y, offsets, neighbors, iBegin, iEnd, fx, fy, sums);
+	else ljAVX512<false>(p, x, y, offsets, neighbors, iBegin, iEnd, fx, fy, nullptr);
+}
+
+// Batches: lane l of every vector is replica l, so the pair loop needs no gathers and no
+// horizontal sums. The minimum image is one conditional shift by the box.
+template <bool Energy>
+MD_TARGET_AVX2
+static void ljBatch256(const LJParams& p, int n, const double* r, double* f, double* energy)
+{
+	const int W = LJ_BATCH_LANES;
+	const __m256d boxW = _mm256_set1_pd(p.boxW), boxH = _mm256_set1_pd(p.boxH);
+	const __m256d halfW = _mm256_set1_pd(0.5 * p.boxW), halfH = _mm256_set1_pd(0.5 * p.boxH);
+	const __m256d minusHalfW = _mm256_set1_pd(-0.5 * p.boxW), minusHalfH = _mm256_set1_pd(-0.5 * p.boxH);
+	const __m256d c12 = _mm256_set1_pd(p.c12), c6 = _mm256_set1_pd(p.c6);
+	const __m256d rCut2 = _mm256_set1_pd(p.rCut2);
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d e12 = _mm256_set1_pd(p.e12), e6 = _mm256_set1_pd(p.e6), eShift = _mm256_set1_pd(p.eShift);
+	const double* x = r;
+	const double* y = r + (size_t)n * W;
+	double* fx = f;
+	double* fy = f + (size_t)n * W;
+	std::fill(f, f + 2 * (size_t)n * W, 0.0);
+
+	// Two halves of four lanes each
+	for (int g = 0; g < W; g += 4) {
+		__m256d e = _mm256_setzero_pd();
+		for (int i = 0; i < n; ++i) {
+			const __m256d xi = _mm256_loadu_pd(x + i * W + g), yi = _mm256_loadu_pd(y + i * W + g);
+			__m256d fxi = _mm256_setzero_pd(), fyi = _mm256_setzero_pd();
+			for (int j = i + 1; j < n; ++j) {
+				__m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + j * W + g), xi);
+				__m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y + j * W + g), yi);
+				dx = _mm256_sub_pd(dx, _mm256_and_pd(_mm256_cmp_pd(dx, halfW, _CMP_GT_OQ), boxW));
+				dx = _mm256_add_pd(dx, _mm256_and_pd(_mm256_cmp_pd(dx, minusHalfW, _CMP_LT_OQ), boxW));
+				dy = _mm256_sub_pd(dy, _mm256_and_pd(_mm256_cmp_pd(dy, halfH, _CMP_GT_OQ), boxH));
+				dy = _mm256_add_pd(dy, _mm256_and_pd(_mm256_cmp_pd(dy, minusHalfH, _CMP_LT_OQ), boxH));
+				const __m256d d2 = _mm256_fmadd_pd(dx, dx, _mm256_mul_pd(dy, dy));
+				const __m256d inside = _mm256_cmp_pd(d2, rCut2, _CMP_LT_OQ);
+				const __m256d r2_inv = _mm256_div_pd(one, d2);
+				const __m256d r6_inv = _mm256_mul_pd(_mm256_mul_pd(r2_inv, r2_inv), r2_inv);
+				// -(c12 r^-6 - c6) r^-6 r^-2, zero beyond the cutoff
+				const __m256d f_mag = _mm256_and_pd(inside,
+					_mm256_mul_pd(_mm256_fnmadd_pd(c12, r6_inv, c6), _mm256_mul_pd(r6_inv, r2_inv)));
+				const __m256d fx_pair = _mm256_mul_pd(f_mag, dx);
+				const __m256d fy_pair = _mm256_mul_pd(f_mag, dy);
+				fxi = _mm256_add_pd(fxi, fx_pair);
+				fyi = _mm256_add_pd(fyi, fy_pair);
+				_mm256_storeu_pd(fx + j * W + g, _mm256_sub_pd(_mm256_loadu_pd(fx + j * W + g), fx_pair));
+				_mm256_storeu_pd(fy + j * W + g, _mm256_sub_pd(_mm256_loadu_pd(fy + j * W + g), fy_pair));
+				if (Energy) {
+					const __m256d pair = _mm256_sub_pd(_mm256_mul_pd(_mm256_fmsub_pd(e12, r6_inv, e6), r6_inv), eShift);
+					e = _mm256_add_pd(e, _mm256_and_pd(inside, pair));
+				}
+			}
+			_mm256_storeu_pd(fx + i * W + g, _mm256_add_pd(_mm256_loadu_pd(fx + i * W + g), fxi));
+			_mm256_storeu_pd(fy + i * W + g, _mm256_add_pd(_mm256_loadu_pd(fy + i * W + g), fyi));
+		}
+		if (Energy) _mm256_storeu_pd(energy + g, e);
+	}
+}
+
+void ljBatchAVX2(const LJParams& p, int n, const double* r, double* f, double* energy)
+{
+	if (energy != nullptr) ljBatch256<true>(p, n, r, f, energy);
+	else ljBatch256<false>(p, n, r, f, nullptr);
+}
+
+// One vector holds all eight lanes
+template <bool Energy>
+MD_TARGET_AVX512
+static void ljBatch512(const LJParams& p, int n, const double* r, double* f, double* energy)
+{
+	const int W = LJ_BATCH_LANES;
+	const __m512d boxW = _mm512_set1_pd(p.boxW), boxH = _mm512_set1_pd(p.boxH);
+	const __m512d halfW = _mm512_set1_pd(0.5 * p.boxW), halfH = _mm512_set1_pd(0.5 * p.boxH);
+	const __m512d minusHalfW = _mm512_set1_pd(-0.5 * p.boxW), minusHalfH = _mm512_set1_pd(-0.5 * p.boxH);
+	const __m512d c12 = _mm512_set1_pd(p.c12), c6 = _mm512_set1_pd(p.c6);
+	const __m512d rCut2 = _mm512_set1_pd(p.rCut2);
+	const __m512d one = _mm512_set1_pd(1.0);
+	const __m512d e12 = _mm512_set1_pd(p.e12), e6 = _mm512_set1_pd(p.e6), eShift = _mm512_set1_pd(p.eShift);
+	const double* x = r;
+	const double* y = r + (size_t)n * W;
+	double* fx = f;
+	double* fy = f + (size_t)n * W;
+	std::fill(f, f + 2 * (size_t)n * W, 0.0);
+
+	__m512d e = _mm512_setzero_pd();
+	for (int i = 0; i < n; ++i) {
+		const __m512d xi = _mm512_loadu_pd(x + i * W), yi = _mm512_loadu_pd(y + i * W);
+		__m512d fxi = _mm512_setzero_pd(), fyi = _mm512_setzero_pd();
+		for (int j = i + 1; j < n; ++j) {
+			__m512d dx = _mm512_sub_pd(_mm512_loadu_pd(x + j * W), xi);
+			__m512d dy = _mm512_sub_pd(_mm512_loadu_pd(y + j * W), yi);
+			dx = _mm512_mask_sub_pd(dx, _mm512_cmp_pd_mask(dx, halfW, _CMP_GT_OQ), dx, boxW);
+			dx = _mm512_mask_add_pd(dx, _mm512_cmp_pd_mask(dx, minusHalfW, _CMP_LT_OQ), dx, boxW);
+			dy = _mm512_mask_sub_pd(dy, _mm512_cmp_pd_mask(dy, halfH, _CMP_GT_OQ), dy, boxH);
+			dy = _mm512_mask_add_pd(dy, _mm512_cmp_pd_mask(dy, minusHalfH, _CMP_LT_OQ), dy, boxH);
+			const __m512d d2 = _mm512_fmadd_pd(dx, dx, _mm512_mul_pd(dy, dy));
+			const __mmask8 inside = _mm512_cmp_pd_mask(d2, rCut2, _CMP_LT_OQ);
+			const __m512d r2_inv = _mm512_div_pd(one, d2);
+			const __m512d r6_inv = _mm512_mul_pd(_mm512_mul_pd(r2_inv, r2_inv), r2_inv);
+			const __m512d f_mag = _mm512_maskz_mul_pd(inside, _mm512_fnmadd_pd(c12, r6_inv, c6), _mm512_mul_pd(r6_inv, r2_inv));
+			const __m512d fx_pair = _mm512_mul_pd(f_mag, dx);
+			const __m512d fy_pair = _mm512_mul_pd(f_mag, dy);
+			fxi = _mm512_add_pd(fxi, fx_pair);
+			fyi = _mm512_add_pd(fyi, fy_pair);
+			_mm512_storeu_pd(fx + j * W, _mm512_sub_pd(_mm512_loadu_pd(fx + j * W), fx_pair));
+			_mm512_storeu_pd(fy + j * W, _mm512_sub_pd(_mm512_loadu_pd(fy + j * W), fy_pair));
+			if (Energy) {
+				const __m512d pair = _mm512_sub_pd(_mm512_mul_pd(_mm512_fmsub_pd(e12, r6_inv, e6), r6_inv), eShift);
+				e = _mm512_mask_add_pd(e, inside, e, pair);
+			}
+		}
+		_mm512_storeu_pd(fx + i * W, _mm512_add_pd(_mm512_loadu_pd(fx + i * W), fxi));
+		_mm512_storeu_pd(fy + i * W, _mm512_add_pd(_mm512_loadu_pd(fy + i * W), fyi));
+	}
+	if (Energy) _mm512_storeu_pd(energy, e);
+}
+
+void ljBatchAVX512(const LJParams& p, int n, const double* r, double* f, double* energy)
+{
+	if (energy != nullptr) ljBatch512<true>(p, n, r, f, energy);
+	else ljBatch512<false>(p, n, r, f, nullptr);
+}
+
+MD_TARGET_AVX2
+static inline float hsum(__m256 v)
+{
+	__m128 lo = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+	return _mm_cvtss_f32(_mm_add_ss(lo, _mm_movehdup_ps(lo)));
+}
+
+// Eight float lanes summed into four double ones
+MD_TARGET_AVX2
+static inline __m256d widenSum(__m256 v)
+{
+	return _mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(v)), _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+}
+
+// ljHalfList in float with eight neighbors of i per iteration, laid out as ljAVX2. The pair
+// energy and virial are widened to double before they are summed, as the generic loop does.
+template <int D, bool Energy>
+MD_TARGET_AVX2
+static void ljHalfListAVX2(const PairParams<D, float>& p, const float* const* r, const int* offsets, const int* neighbors,
+	int iBegin, int iEnd, float* const* f, PairSums* sums)
+{
+	__m256 L[D], invL[D];
+	float invLs[D];
+	for (int d = 0; d < D; ++d) {
+		invLs[d] = 1.0f / p.L[d];
+		L[d] = _mm256_set1_ps(p.L[d]);
+		invL[d] = _mm256_set1_ps(invLs[d]);
+	}
+	const __m256 c12 = _mm256_set1_ps(p.c12), c6 = _mm256_set1_ps(p.c6);
+	const __m256 rCut2 = _mm256_set1_ps(p.rCut2);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 e12 = _mm256_set1_ps(p.e12), e6 = _mm256_set1_ps(p.e6), eShift = _mm256_set1_ps(p.eShift);
+	const int round = _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC;
+	alignas(32) float fj[D][8];
+	__m256d energy = _mm256_setzero_pd(), virial = _mm256_setzero_pd();
+	double energyTail = 0.0, virialTail = 0.0;
+
+	for (int i = iBegin; i < iEnd; ++i) {
+		__m256 ri[D], fi[D];
+		for (int d = 0; d < D; ++d) {
+			ri[d] = _mm256_set1_ps(r[d][i]);
+			fi[d] = _mm256_setzero_ps();
+		}
+		int k = offsets[i];
+		const int end = offsets[i + 1];
+		for (; k + 8 <= end; k += 8) {
+			__m256i j = _mm256_loadu_si256((const __m256i*)(neighbors + k));
+			__m256 dr[D];
+			__m256 d2 = _mm256_setzero_ps();
+			for (int d = 0; d < D; ++d) {
+				dr[d] = _mm256_sub_ps(_mm256_i32gather_ps(r[d], j, 4), ri[d]);
+				dr[d] = _mm256_fnmadd_ps(L[d], _mm256_round_ps(_mm256_mul_ps(dr[d], invL[d]), round), dr[d]);
+				d2 = _mm256_fmadd_ps(dr[d], dr[d], d2);
+			}
+			__m256 inside = _mm256_cmp_ps(d2, rCut2, _CMP_LT_OQ);
+			if (_mm256_movemask_ps(inside) == 0) continue;
+			__m256 r2_inv = _mm256_div_ps(one, d2);
+			__m256 r6_inv = _mm256_mul_ps(_mm256_mul_ps(r2_inv, r2_inv), r2_inv);
+			__m256 f_mag = _mm256_mul_ps(_mm256_fmsub_ps(c12, r6_inv, c6), _mm256_mul_ps(r6_inv, r2_inv));
+			f_mag = _mm256_and_ps(f_mag, inside);
+			if (Energy) {
+				__m256 e = _mm256_sub_ps(_mm256_mul_ps(_mm256_fmsub_ps(e12, r6_inv, e6), r6_inv), eShift);
+				energy = _mm256_add_pd(energy, widenSum(_mm256_and_ps(e, inside)));
+				virial = _mm256_add_pd(virial, widenSum(_mm256_mul_ps(f_mag, d2)));
+			}
+			// f_mag here is the opposite sign of the generic loop: force on j along (rj - ri)
+			for (int d = 0; d < D; ++d) {
+				__m256 pair = _mm256_mul_ps(f_mag, dr[d]);
+				fi[d] = _mm256_sub_ps(fi[d], pair);
+				_mm256_store_ps(fj[d], pair);
+			}
+			for (int l = 0; l < 8; ++l) {
+				const int jl = neighbors[k + l];
+				for (int d = 0; d < D; ++d) f[d][jl] += fj[d][l];
+			}
+		}
+		float fis[D], ris[D];
+		for (int d = 0; d < D; ++d) {
+			fis[d] = hsum(fi[d]);
+			ris[d] = r[d][i];
+		}
+		for (; k < end; ++k) {
+			const int j = neighbors[k];
+			float dr[D];
+			float d2 = 0.0f;
+			for (int d = 0; d < D; ++d) {
+				dr[d] = r[d][j] - ris[d];
+				dr[d] -= p.L[d] * std::round(dr[d] * invLs[d]);
+				d2 += dr[d] * dr[d];
+			}
+			if (d2 >= p.rCut2) continue;
+			float r2_inv = 1.0f / d2;
+			float r6_inv = r2_inv * r2_inv * r2_inv;
+			float f_mag = -(p.c12 * r6_inv - p.c6) * r6_inv * r2_inv;
+			for (int d = 0; d < D; ++d) {
+				fis[d] += f_mag * dr[d];
+				f[d][j] -= f_mag * dr[d];
+			}
+			if (Energy) {
+				energyTail += (double)((p.e12 * r6_inv - p.e6) * r6_inv - p.eShift);
+				virialTail -= (double)(f_mag * d2);
+			}
+		}
+		for (int d = 0; d < D; ++d) f[d][i] += fis[d];
+	}
+	if (Energy) {
+		sums->energy += hsum(energy) + energyTail;
+		sums->virial += hsum(virial) + virialTail;
+	}
+}
+
+// The same in double with four neighbors of i per iteration, so float and double differ only
+// in precision and lane count
+template <int D, bool Energy>
+MD_TARGET_AVX2
+static void ljHalfListAVX2(const PairParams<D, double>& p, const double* const* r, const int* offsets, const int* neighbors,
+	int iBegin, int iEnd, double* const* f, PairSums* sums)
+{
+	__m256d L[D], invL[D];
+	double invLs[D];
+	for (int d = 0; d < D; ++d) {
+		invLs[d] = 1.0 / p.L[d];
+		L[d] = _mm256_set1_pd(p.L[d]);
+		invL[d] = _mm256_set1_pd(invLs[d]);
+	}
+	const __m256d c12 = _mm256_set1_pd(p.c12), c6 = _mm256_set1_pd(p.c6);
+	const __m256d rCut2 = _mm256_set1_pd(p.rCut2);
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d e12 = _mm256_set1_pd(p.e12), e6 = _mm256_set1_pd(p.e6), eShift = _mm256_set1_pd(p.eShift);
+	const int round = _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC;
+	alignas(32) double fj[D][4];
+	__m256d energy = _mm256_setzero_pd(), virial = _mm256_setzero_pd();
+	double energyTail = 0.0, virialTail = 0.0;
+
+	for (int i = iBegin; i < iEnd; ++i) {
+		__m256d ri[D], fi[D];
+		for (int d = 0; d < D; ++d) {
+			ri[d] = _mm256_set1_pd(r[d][i]);
+			fi[d] = _mm256_setzero_pd();
+		}
+		int k = offsets[i];
+		const int end = offsets[i + 1];
+		for (; k + 4 <= end; k += 4) {
+			__m128i j = _mm_loadu_si128((const __m128i*)(neighbors + k));
+			__m256d dr[D];
+			__m256d d2 = _mm256_setzero_pd();
+			for (int d = 0; d < D; ++d) {
+				dr[d] = _mm256_sub_pd(_mm256_i32gather_pd(r[d], j, 8), ri[d]);
+				dr[d] = _mm256_fnmadd_pd(L[d], _mm256_round_pd(_mm256_mul_pd(dr[d], invL[d]), round), dr[d]);
+				d2 = _mm256_fmadd_pd(dr[d], dr[d], d2);
+			}
+			__m256d inside = _mm256_cmp_pd(d2, rCut2, _CMP_LT_OQ);
+			if (_mm256_movemask_pd(inside) == 0) continue;
+			__m256d r2_inv = _mm256_div_pd(one, d2);
+			__m256d r6_inv = _mm256_mul_pd(_mm256_mul_pd(r2_inv, r2_inv), r2_inv);
+			__m256d f_mag = _mm256_mul_pd(_mm256_fmsub_pd(c12, r6_inv, c6), _mm256_mul_pd(r6_inv, r2_inv));
+			f_mag = _mm256_and_pd(f_mag, inside);
+			if (Energy) {
+				__m256d e = _mm256_sub_pd(_mm256_mul_pd(_mm256_fmsub_pd(e12, r6_inv, e6), r6_inv), eShift);
+				energy = _mm256_add_pd(energy, _mm256_and_pd(e, inside));
+				virial = _mm256_fmadd_pd(f_mag, d2, virial);
+			}
+			// f_mag here is the opposite sign of the generic loop: force on j along (rj - ri)
+			for (int d = 0; d < D; ++d) {
+				__m256d pair = _mm256_mul_pd(f_mag, dr[d]);
+				fi[d] = _mm256_sub_pd(fi[d], pair);
+				_mm256_store_pd(fj[d], pair);
+			}
+			for (int l = 0; l < 4; ++l) {
+				const int jl = neighbors[k + l];
+				for (int d = 0; d < D; ++d) f[d][jl] += fj[d][l];
+			}
+		}
+		double fis[D], ris[D];
+		for (int d = 0; d < D; ++d) {
+			fis[d] = hsum(fi[d]);
+			ris[d] = r[d][i];
+		}
+		for (; k < end; ++k) {
+			const int j = neighbors[k];
+			double dr[D];
+			double d2 = 0.0;
+			for (int d = 0; d < D; ++d) {
+				dr[d] = r[d][j] - ris[d];
+				dr[d] -= p.L[d] * std::round(dr[d] * invLs[d]);
+				d2 += dr[d] * dr[d];
+			}
+			if (d2 >= p.rCut2) continue;
+			double r2_inv = 1.0 / d2;
+			double r6_inv = r2_inv * r2_inv * r2_inv;
+			double f_mag = -(p.c12 * r6_inv - p.c6) * r6_inv * r2_inv;
+			for (int d = 0; d < D; ++d) {
+				fis[d] += f_mag * dr[d];
+				f[d][j] -= f_mag * dr[d];
+			}
+			if (Energy) {
+				energyTail += (p.e12 * r6_inv - p.e6) * r6_inv - p.eShift;
+				virialTail -= f_mag * d2;
+			}
+		}
+		for (int d = 0; d < D; ++d) f[d][i] += fis[d];
+	}
+	if (Energy) {
+		sums->energy += hsum(energy) + energyTail;
+		sums->virial += hsum(virial) + virialTail;
+	}
+}
+
+static bool cpuHasAVX2()
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+	int info[4];
+	__cpuidex(info, 7, 0);
+	bool avx2 = (info[1] & (1 << 5)) != 0;
+	__cpuid(info, 1);
+	bool fma = (info[2] & (1 << 12)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	return avx2 && fma && osxsave && (_xgetbv(0) & 0x6) == 0x6;
+#endif
+}
+
+static bool cpuHasAVX512()
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_cpu_supports("avx512f");
+#else
+	int info[4];
+	__cpuidex(info, 7, 0);
+	bool avx512 = (info[1] & (1 << 16)) != 0;
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	return avx512 && osxsave && (_xgetbv(0) & 0xE6) == 0xE6;
+#endif
+}
+#else
+// Non-x86 builds only have the scalar kernel
+void ljForceAVX2(const LJParams& p, const double* x, const double* y,
+	const int* offsets, const int* neighbors, int iBegin, int iEnd, double* fx, double* fy, PairSums* sums)
+{
+	ljForceScalar(p, x, y, offsets, neighbors, iBegin, iEnd, fx, fy, sums);
+}
+
+void ljForceAVX512(const LJParams& p, const double* x, const double* y,
+	const int* offsets, const int* neighbors, int iBegin, int iEnd, double* fx, double* fy, PairSums* sums)
+{
+	ljForceScalar(p, x, y, offsets, neighbors, iBegin, iEnd, fx, fy, sums);
+}
+
+void ljBatchAVX2(const LJParams& p, int n, const double* r, double* f, double* energy)
+{
+	ljBatchScalar(p, n, r, f, energy);
+}
+
+void ljBatchAVX512(const LJParams& p, int n, const double* r, double* f, double* energy)
+{
+	ljBatchScalar(p, n, r, f, energy);
+}
+
+static bool cpuHasAVX2() { return false; }
+static bool cpuHasAVX512() { return false; }
+#endif
+
+template <int D, typename T>
+void ljHalfListVector(const PairParams<D, T>& p, const T* const* r, const int* offsets, const int* neighbors,
+	int iBegin, int iEnd, T* const* f, PairSums* sums)
+{
+#ifdef MD_X86
+	if (cpuHasAVX2()) {
+		if (sums != nullptr) ljHalfListAVX2<D, true>(p, r, offsets, neighbors, iBegin, iEnd, f, sums);
+		else ljHalfListAVX2<D, false>(p, r, offsets, neighbors, iBegin, iEnd, f, nullptr);
+		return;
+	}
+#endif
+	if (sums != nullptr) ljHalfList<D, T, true>(p, r, offsets, neighbors, iBegin, iEnd, f, sums);
+	else ljHalfList<D, T, false>(p, r, offsets, neighbors, iBegin, iEnd, f, nullptr);
+}
+
+template void ljHalfListVector<2, float>(const PairParams<2, float>&, const float* const*, const int*, const int*, int, int,
+	float* const*, PairSums*);
+template void ljHalfListVector<3, float>(const PairParams<3, float>&, const float* const*, const int*, const int*, int, int,
+	float* const*, PairSums*);
+template void ljHalfListVector<2, double>(const PairParams<2, double>&, const double* const*, const int*, const int*, int,
+	int, double* const*, PairSums*);
+template void ljHalfListVector<3, double>(const PairParams<3, double>&, const double* const*, const int*, const int*, int,
+	int, double* const*, PairSums*);
+
+const char* ljVectorKernelName()
+{
+	return cpuHasAVX2() ? "avx2" : "scalar";
+}
+
+LJKernel selectLJKernel()
+{
+	if (cpuHasAVX512()) return ljForceAVX512;
+	if (cpuHasAVX2()) return ljForceAVX2;
+	return ljForceScalar;
+}
+
+LJKernel ljKernelByName(const char* name)
+{
+	if (std::strcmp(name, "scalar") == 0) return ljForceScalar;
+	if (std::strcmp(name, "avx2") == 0) return cpuHasAVX2() ? ljForceAVX2 : nullptr;
+	if (std::strcmp(name, "avx512") == 0) return cpuHasAVX512() ? ljForceAVX512 : nullptr;
+	return nullptr;
+}
+
+const char* ljKernelName(LJKernel kernel)
+{
+	if (kernel == ljForceAVX512) return "avx512";
+	if (kernel == ljForceAVX2) return "avx2";
+	return "scalar";
+}
+
+LJBatchKernel selectLJBatchKernel()
+{
+	if (forceKernel == ljForceScalar) return ljBatchScalar;
+	if (forceKernel == ljForceAVX2) return ljBatchAVX2;
+	if (cpuHasAVX512()) return ljBatchAVX512;
+	if (cpuHasAVX2()) return ljBatchAVX2;
+	return ljBatchScalar;
+}
+
+const char* ljBatchKernelName(LJBatchKernel kernel)
+{
+	if (kernel == ljBatchAVX512) return "avx512";
+	if (kernel == ljBatchAVX2) return "avx2";
+	return "scalar";
+}
+
+bool checkLJKernels(std::ostream& out)
+{
+	// Work on a disordered 40x40 lattice and restore the global box afterwards
+	const double savedLW = LW, savedLH = LH, savedBoxSize = boxSize;
+	const int savedNpart = Npart;
+	ParticleSystem ps;
+	hexagonalLattice(ps, 40, 40);
+	std::mt19937_64 eng(12345);
+	std::uniform_real_distribution<double> jitter(-0.1 * eq_dist, 0.1 * eq_dist);
+	for (int i = 0; i < ps.n; ++i) {
+		ps.x[i] += jitter(eng);
+		ps.y[i] += jitter(eng);
+	}
+	applyPBC(ps);
+	NeighborList nl;
+	nl.build(ps);
+	LJParams p = makeLJParams();
+
+	// Reference: the original per-particle formula over all other particles, truncated at rCut
+	std::vector<double> fxRef(ps.n, 0.0), fyRef(ps.n, 0.0);
+	double fMax = 0.0, energyRef = 0.0, virialRef = 0.0;
+	const double shift = 4.0 * epsilon * (std::pow(sigma / rCut, 12) - std::pow(sigma / rCut, 6));
+	for (int i = 0; i < ps.n; ++i) {
+		for (int j = 0; j < ps.n; ++j) {
+			if (j == i) continue;
+			double dx = ps.x[j] - ps.x[i];
+			double dy = ps.y[j] - ps.y[i];
+			dx -= LW * std::round(dx / LW);
+			dy -= LH * std::round(dy / LH);
+			double d = std::sqrt(dx * dx + dy * dy);
+			if (d >= rCut) continue;
+			double r2_inv = 1.0 / (d * d);
+			double r6_inv = r2_inv * r2_inv * r2_inv;
+			double r12_inv = r6_inv * r6_inv;
+			double f_mag = -48.0 * epsilon * (std::pow(sigma, 12) * r12_inv - 0.5 * std::pow(sigma, 6) * r6_inv) * r2_inv;
+			fxRef[i] += f_mag * dx;
+			fyRef[i] += f_mag * dy;
+			// Every pair is visited twice
+			energyRef += 0.5 * (4.0 * epsilon * (std::pow(sigma, 12) * r12_inv - std::pow(sigma, 6) * r6_inv) - shift);
+			virialRef -= 0.5 * f_mag * d * d;
+		}
+		fMax = std::max(fMax, std::max(std::fabs(fxRef[i]), std::fabs(fyRef[i])));
+	}
+
+	bool ok = true;
+	const char* names[] = { "scalar", "avx2", "avx512" };
+	std::vector<double> fx(ps.n), fy(ps.n);
+	for (const char* name : names) {
+		LJKernel kernel = ljKernelByName(name);
+		if (kernel == nullptr) {
+			out << "LJ kernel " << name << ": not supported by this CPU" << std::endl;
+			continue;
+		}
+		std::fill(fx.begin(), fx.end(), 0.0);
+		std::fill(fy.begin(), fy.end(), 0.0);
+		PairSums sums;
+		kernel(p, ps.x.data(), ps.y.data(), nl.offsets.data(), nl.neighbors.data(), 0, ps.n, fx.data(), fy.data(), &sums);
+		double err = 0.0;
+		for (int i = 0; i < ps.n; ++i) {
+			err = std::max(err, std::max(std::fabs(fx[i] - fxRef[i]), std::fabs(fy[i] - fyRef[i])));
+		}
+		err /= fMax;
+		double sumsErr = std::max(std::fabs(sums.energy / energyRef - 1.0), std::fabs(sums.virial / virialRef - 1.0));
+
+		// Throughput: repeat the full evaluation for at least 0.2 s
+		long long reps = 0;
+		auto start = std::chrono::steady_clock::now();
+		double elapsed = 0.0;
+		while (elapsed < 0.2) {
+			kernel(p, ps.x.data(), ps.y.data(), nl.offsets.data(), nl.neighbors.data(), 0, ps.n, fx.data(), fy.data(), nullptr);
+			reps++;
+			elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		double pairsPerSecond = (double)nl.neighbors.size() * reps / elapsed;
+		bool pass = err < 1e-12 && sumsErr < 1e-12;
+		ok = ok && pass;
+		out << "LJ kernel " << name << ": max relative force error " << err << ", energy/virial " << sumsErr
+			<< (pass ? " (ok)" : " (FAILED)") << ", " << pairsPerSecond / 1e6 << " Mpairs/s" << std::endl;
+	}
+
+	// The same potential through a one-type spline table, which costs the same for any potential
+	LennardJones lj(epsilon, std::pow(2.0, 1.0 / 6.0) * sigma);
+	CutoffPotential shifted(lj, CutoffScheme::Shift, rCut, rCut);
+	PairTable table;
+	table.build({ &shifted }, { 0.6 * sigma }, 1, rCut, 1024);
+	auto runTable = [&](PairSums* sums) {
+		pairForceTable(table, ps.x.data(), ps.y.data(), ps.type.data(), nl.offsets.data(), nl.neighbors.data(),
+			0, ps.n, LW, LH, fx.data(), fy.data(), sums);
+	};
+	std::fill(fx.begin(), fx.end(), 0.0);
+	std::fill(fy.begin(), fy.end(), 0.0);
+	PairSums sums;
+	runTable(&sums);
+	double err = 0.0;
+	for (int i = 0; i < ps.n; ++i) {
+		err = std::max(err, std::max(std::fabs(fx[i] - fxRef[i]), std::fabs(fy[i] - fyRef[i])));
+	}
+	err /= fMax;
+	double sumsErr = std::max(std::fabs(sums.energy / energyRef - 1.0), std::fabs(sums.virial / virialRef - 1.0));
+	long long reps = 0;
+	auto start = std::chrono::steady_clock::now();
+	double elapsed = 0.0;
+	while (elapsed < 0.2) {
+		runTable(nullptr);
+		reps++;
+		elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	bool pass = err < 1e-6 && sumsErr < 1e-6;
+	ok = ok && pass;
+	out << "Pair table (1024 intervals): max relative force error " << err << ", energy/virial " << sumsErr
+		<< (pass ? " (ok)" : " (FAILED)")
+		<< ", " << (double)nl.neighbors.size() * reps / elapsed / 1e6 << " Mpairs/s" << std::endl;
+
+	// Replica batches: a differently disordered 4x4 lattice per lane against the scalar kernel
+	// on an all-pairs list of each lane on its own
+	const int W = LJ_BATCH_LANES;
+	ParticleSystem cell;
+	hexagonalLattice(cell, 4, 4);
+	const int n = cell.n;
+	const LJParams cp = makeLJParams();
+	std::vector<int> allOffsets(n + 1, 0), allPairs;
+	for (int i = 0; i < n; ++i) {
+		for (int j = i + 1; j < n; ++j) allPairs.push_back(j);
+		allOffsets[i + 1] = (int)allPairs.size();
+	}
+	std::vector<double> lanes(2 * (size_t)n * W), laneRef(lanes.size()), laneEnergyRef(W);
+	double laneMax = 0.0;
+	for (int l = 0; l < W; ++l) {
+		ParticleSystem copy = cell;
+		for (int i = 0; i < n; ++i) {
+			copy.x[i] += jitter(eng);
+			copy.y[i] += jitter(eng);
+		}
+		applyPBC(copy);
+		std::vector<double> lfx(n, 0.0), lfy(n, 0.0);
+		PairSums laneSums;
+		ljForceScalar(cp, copy.x.data(), copy.y.data(), allOffsets.data(), allPairs.data(), 0, n, lfx.data(), lfy.data(), &laneSums);
+		laneEnergyRef[l] = laneSums.energy;
+		for (int i = 0; i < n; ++i) {
+			lanes[(size_t)i * W + l] = copy.x[i];
+			lanes[((size_t)n + i) * W + l] = copy.y[i];
+			laneRef[(size_t)i * W + l] = lfx[i];
+			laneRef[((size_t)n + i) * W + l] = lfy[i];
+			laneMax = std::max(laneMax, std::max(std::fabs(lfx[i]), std::fabs(lfy[i])));
+		}
+	}
+	const LJBatchKernel batchKernels[] = { ljBatchScalar, cpuHasAVX2() ? ljBatchAVX2 : nullptr, cpuHasAVX512() ? ljBatchAVX512 : nullptr };
+	std::vector<double> laneForce(lanes.size());
+	double laneEnergy[LJ_BATCH_LANES];
+	for (int k = 0; k < 3; ++k) {
+		if (batchKernels[k] == nullptr) {
+			out << "LJ batch kernel " << names[k] << ": not supported by this CPU" << std::endl;
+			continue;
+		}
+		batchKernels[k](cp, n, lanes.data(), laneForce.data(), laneEnergy);
+		double batchErr = 0.0, batchEnergyErr = 0.0;
+		for (size_t c = 0; c < lanes.size(); ++c) batchErr = std::max(batchErr, std::fabs(laneForce[c] - laneRef[c]));
+		batchErr /= laneMax;
+		for (int l = 0; l < W; ++l) batchEnergyErr = std::max(batchEnergyErr, std::fabs(laneEnergy[l] / laneEnergyRef[l] - 1.0));
+		reps = 0;
+		start = std::chrono::steady_clock::now();
+		elapsed = 0.0;
+		while (elapsed < 0.2) {
+			batchKernels[k](cp, n, lanes.data(), laneForce.data(), nullptr);
+			reps++;
+			elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		pass = batchErr < 1e-12 && batchEnergyErr < 1e-12;
+		ok = ok && pass;
+		out << "LJ batch kernel " << names[k] << " (" << W << " replicas of " << n << "): max relative force error " << batchErr
+			<< ", energy " << batchEnergyErr << (pass ? " (ok)" : " (FAILED)") << ", "
+			<< (double)allPairs.size() * W * reps / elapsed / 1e6 << " Mpairs/s" << std::endl;
+	}
+
+	LW = savedLW;
+	LH = savedLH;
+	boxSize = savedBoxSize;
+	Npart = savedNpart;
+	return ok;
+}
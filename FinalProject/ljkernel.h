@@ -0,0 +1,67 @@
+// LENNARD-JONES PAIR KERNELS
+// Half-list force kernels: every pair (i, j) is visited once and the force is
+// added to i and subtracted from j (Newton's third law).
+
+#pragma once
+
+#include <ostream>
+
+// Coefficients precomputed once per force evaluation, so the inner loop has no std::pow
+struct LJParams
+{
+	double c12;    // 48 * epsilon * sigma^12
+	double c6;     // 24 * epsilon * sigma^6
+	double rCut2;  // Squared cutoff radius
+	double e12;    // 4 * epsilon * sigma^12
+	double e6;     // 4 * epsilon * sigma^6
+	double eShift; // V(rCut), subtracted from the pair energy so it is zero at the cutoff
+	double boxW, boxH;
+};
+
+// Potential energy and virial of the pairs a kernel visited
+struct PairSums
+{
+	double energy = 0.0; // Pair energy (J)
+	double virial = 0.0; // Sum over pairs of r_ij . F_ij (J), positive when repulsion dominates
+};
+
+LJParams makeLJParams();
+
+// Accumulates the force (N) of the pairs listed for particles iBegin..iEnd-1 into fx/fy.
+// offsets/neighbors is a half neighbor list (j > i). The output arrays are not cleared.
+// When sums is not null, the energy and virial of the same pairs are added to it in the same
+// pass; the forces are bitwise the same either way.
+typedef void (*LJKernel)(const LJParams& p, const double* x, const double* y,
+	const int* offsets, const int* neighbors, int iBegin, int iEnd, double* fx, double* fy, PairSums* sums);
+
+void ljForceScalar(const LJParams& p, const double* x, const double* y,
+	const int* offsets, const int* neighbors, int iBegin, int iEnd, double* fx, double* fy, PairSums* sums);
+void ljForceAVX2(const LJParams& p, const double* x, const double* y,
+	const int* offsets, const int* neighbors, int iBegin, int iEnd, double* fx, double* fy, PairSums* sums);
+void ljForceAVX512(const LJParams& p, const double* x, const double* y,
+	const int* offsets, const int* neighbors, int iBegin, int iEnd, double* fx, double* fy, PairSums* sums);
+
+// Widest kernel supported by the CPU we are running on
+LJKernel selectLJKernel();
+// Kernel by name ("scalar", "avx2", "avx512"), or nullptr if unknown or unsupported by this CPU
+LJKernel ljKernelByName(const char* name);
+const char* ljKernelName(LJKernel kernel);
+
+// Replica batches: LJ_BATCH_LANES independent copies of a small system stored interleaved, so
+// that lane l of every vector is replica l. Coordinate d of particle i of lane l is at
+// r[(d * n + i) * LJ_BATCH_LANES + l]. The kernels visit all pairs, with positions wrapped into
+// the box, overwrite f with the force (N) and, when energy is not null, the pair energy of each
+// lane (J).
+const int LJ_BATCH_LANES = 8;
+typedef void (*LJBatchKernel)(const LJParams& p, int n, const double* r, double* f, double* energy);
+
+void ljBatchScalar(const LJParams& p, int n, const double* r, double* f, double* energy);
+void ljBatchAVX2(const LJParams& p, int n, const double* r, double* f, double* energy);
+void ljBatchAVX512(const LJParams& p, int n, const double* r, double* f, double* energy);
+
+// Widest batch kernel supported by the CPU, or the one matching forceKernel when that was chosen
+LJBatchKernel selectLJBatchKernel();
+const char* ljBatchKernelName(LJBatchKernel kernel);
+
+// Compares every available kernel against the original all-pairs formula and reports pairs/second
+bool checkLJKernels(std::ostream& out);
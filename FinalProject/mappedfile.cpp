@@ -0,0 +1,103 @@
+#include "mappedfile.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		std::cout << "ERROR: cannot open " << path << std::endl;
+		return false;
+	}
+	fileHandle = file;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize)) {
+		std::cout << "ERROR: cannot read the size of " << path << std::endl;
+		close();
+		return false;
+	}
+	length = (size_t)fileSize.QuadPart;
+	// Empty files cannot be mapped; they are a valid, empty view
+	if (length == 0) return true;
+	mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mappingHandle != nullptr) view = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr) {
+		std::cout << "ERROR: cannot map " << path << " into memory" << std::endl;
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (view != nullptr) UnmapViewOfFile(view);
+	if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+	if (fileHandle != nullptr) CloseHandle(fileHandle);
+	view = nullptr;
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+	length = 0;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		std::cout << "ERROR: cannot open " << path << std::endl;
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		std::cout << "ERROR: cannot read the size of " << path << std::endl;
+		close();
+		return false;
+	}
+	length = (size_t)info.st_size;
+	// Empty files cannot be mapped; they are a valid, empty view
+	if (length == 0) return true;
+	void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (mapped == MAP_FAILED) {
+		std::cout << "ERROR: cannot map " << path << " into memory" << std::endl;
+		close();
+		return false;
+	}
+	view = (const char*)mapped;
+	// The whole file is about to be read, so start paging it in now
+	madvise(mapped, length, MADV_WILLNEED);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (view != nullptr) munmap((void*)view, length);
+	if (fd >= 0) ::close(fd);
+	view = nullptr;
+	fd = -1;
+	length = 0;
+}
+
+#endif
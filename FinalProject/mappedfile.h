@@ -0,0 +1,33 @@
+// MEMORY-MAPPED FILES
+// Read-only view of a whole file, on POSIX systems and on Windows
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	// Maps path read-only; prints the reason and returns false on failure
+	bool open(const std::string& path);
+	void close();
+
+	const char* data() const { return view; }
+	size_t size() const { return length; }
+
+private:
+	const char* view = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fd = -1;
+#endif
+};
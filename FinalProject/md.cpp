@@ -0,0 +1,415 @@
+#include "md.h"
+#include "engine.h"
+#include "neighbor.h"
+#include "potential.h"
+#include "profile.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+// Global variables
+double eq_dist = 3.6e-10;
+double boxSize = 2.5 * eq_dist;
+double LH = eq_dist + 2 * std::sqrt(0.75 * std::pow(eq_dist, 2));
+double LW = 3 * eq_dist;
+double LD = 0.0;
+int dimensions = 2;
+double temperature = 297;
+double dt = 1e-15;
+double rCut = 2.5 * sigma;
+int latticeX = 3;
+int latticeY = 3;
+int latticeZ = 3;
+int Npart = 9;
+unsigned long long rngSeed = 0;
+std::default_random_engine rng;
+LJKernel forceKernel = nullptr;
+const PairTable* pairTable = nullptr;
+int nThreads = 0;
+bool deterministicReduction = true;
+
+// Thread pool shared by every parallel loop, recreated when nThreads changes
+static ThreadPool* pool = nullptr;
+// Per-thread force accumulators. They are all zero between force calls: the reduction
+// clears what it consumes, so no thread has to clear a whole buffer before the kernel.
+static std::vector<std::vector<double>> threadFx, threadFy, threadFz;
+static std::vector<int> touchedBegin, touchedEnd;
+static std::vector<PairSums> threadSums;
+
+ThreadPool& threadPool()
+{
+	// hardware_concurrency() can be a system call, so it is only asked once
+	static const int hardwareThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	int wanted = nThreads > 0 ? nThreads : hardwareThreads;
+	if (pool == nullptr || pool->size() != wanted) {
+		delete pool;
+		pool = new ThreadPool(wanted);
+	}
+	return *pool;
+}
+
+int threadCount()
+{
+	return threadPool().size();
+}
+
+void ParticleSystem::resize(int count)
+{
+	n = count;
+	x.assign(n, 0.0);
+	y.assign(n, 0.0);
+	xOld.assign(n, 0.0);
+	yOld.assign(n, 0.0);
+	ax.assign(n, 0.0);
+	ay.assign(n, 0.0);
+	const int depth = dimensions == 3 ? n : 0;
+	z.assign(depth, 0.0);
+	zOld.assign(depth, 0.0);
+	az.assign(depth, 0.0);
+	type.assign(n, 0);
+	id.resize(n);
+	for (int i = 0; i < n; ++i) id[i] = i;
+}
+
+//Initial positions of the particles in meters.
+//Rows alternate their x offset by half a bond; the 3x3 case reproduces the original nine-particle cell.
+void hexagonalLattice(ParticleSystem& ps, int nx, int ny, int count)
+{
+	ps.resize(count > 0 ? std::min(count, nx * ny) : nx * ny);
+	double y_from_center = std::sqrt(0.75 * std::pow(eq_dist, 2));
+	for (int row = 0; row < ny; row++) {
+		for (int col = 0; col < nx; col++) {
+			int i = row * nx + col;
+			if (i >= ps.n) break;
+			ps.x[i] = (-0.5 * nx + 0.25 + col + 0.5 * (row % 2)) * eq_dist;
+			ps.y[i] = (0.5 * (ny - 1) - row) * y_from_center;
+		}
+	}
+	std::copy(ps.x.begin(), ps.x.end(), ps.xOld.begin());
+	std::copy(ps.y.begin(), ps.y.end(), ps.yOld.begin());
+
+	setBox(nx * eq_dist, eq_dist + (ny - 1) * y_from_center);
+	Npart = ps.n;
+}
+
+void squareLattice(ParticleSystem& ps, int nx, int ny, int count)
+{
+	ps.resize(count > 0 ? std::min(count, nx * ny) : nx * ny);
+	for (int i = 0; i < ps.n; i++) {
+		ps.x[i] = (-0.5 * nx + 0.5 + i % nx) * eq_dist;
+		ps.y[i] = (0.5 * (ny - 1) - i / nx) * eq_dist;
+	}
+	std::copy(ps.x.begin(), ps.x.end(), ps.xOld.begin());
+	std::copy(ps.y.begin(), ps.y.end(), ps.yOld.begin());
+
+	setBox(nx * eq_dist, ny * eq_dist);
+	Npart = ps.n;
+}
+
+// Cube of side sqrt(2) eq_dist with atoms at a corner and the centers of the three faces that meet there
+void fccLattice(ParticleSystem& ps, int nx, int ny, int nz)
+{
+	const double cube = std::sqrt(2.0) * eq_dist;
+	const double basis[4][3] = { { 0.0, 0.0, 0.0 }, { 0.5, 0.5, 0.0 }, { 0.5, 0.0, 0.5 }, { 0.0, 0.5, 0.5 } };
+	const int cells[3] = { nx, ny, nz };
+	ps.resize(4 * nx * ny * nz);
+	for (int i = 0; i < ps.n; i++) {
+		const int cell[3] = { i / 4 % nx, i / 4 / nx % ny, i / 4 / nx / ny };
+		for (int d = 0; d < 3; ++d) {
+			ps.position(d)[i] = (cell[d] + basis[i % 4][d] + 0.25 - 0.5 * cells[d]) * cube;
+			ps.oldPosition(d)[i] = ps.position(d)[i];
+		}
+	}
+
+	setBox(nx * cube, ny * cube);
+	LD = nz * cube;
+	Npart = ps.n;
+}
+
+void setBox(double width, double height)
+{
+	LW = width;
+	LH = height;
+	boxSize = 2.5 / 3.0 * std::max(LW, LH);
+}
+
+// MOLECULAR DYNAMICS FUNCTIONS
+// Lennard-Jones force over the pairs of the neighbor list, truncated and shifted at rCut, or
+// the tabulated multi-species potential when a parameter file was loaded. In 3D the built-in
+// potential goes through ljHalfListVector of engine.h instead of forceKernel.
+// Fills the acceleration arrays of every particle.
+// Each thread runs the pair kernel on its own rows into its own force buffer, then the
+// buffers are summed per particle. With deterministicReduction the rows are split statically
+// by pair count, so every run adds the same numbers in the same order; otherwise rows are
+// handed out in chunks on demand, which balances load better but is not bitwise reproducible.
+void calculateForce(ParticleSystem& ps, const NeighborList& nl, PairSums* sums)
+{
+	calculateForce(ps, nl, pairTable, ps.ax.data(), ps.ay.data(), ps.az.data(), sums);
+}
+
+void calculateForce(ParticleSystem& ps, const NeighborList& nl, const PairTable* table, double* ax, double* ay,
+	double* az, PairSums* sums)
+{
+	MD_PROFILE_SCOPE("force");
+	if (forceKernel == nullptr) forceKernel = selectLJKernel();
+	LJParams p = makeLJParams();
+	const bool threeD = dimensions == 3;
+	const double box[3] = { LW, LH, LD };
+	const PairParams<3, double> p3 = makePairParams<3, double>(sigma, epsilon, rCut, box);
+	const double invMass = 1.0 / cMass;
+	const int* offsets = nl.offsets.data();
+	const int* neighbors = nl.neighbors.data();
+	ThreadPool& tp = threadPool();
+	const int T = tp.size();
+	auto kernel = [&](int begin, int end, double* fx, double* fy, double* fz, PairSums* partial) {
+		MD_PROFILE_COUNT("pair evaluations", offsets[end] - offsets[begin]);
+		if (threeD && table != nullptr) {
+			pairForceTable(*table, ps.x.data(), ps.y.data(), ps.z.data(), ps.type.data(), offsets, neighbors, begin, end,
+				LW, LH, LD, fx, fy, fz, partial);
+		}
+		else if (threeD) {
+			const double* r[3] = { ps.x.data(), ps.y.data(), ps.z.data() };
+			double* f[3] = { fx, fy, fz };
+			ljHalfListVector<3, double>(p3, r, offsets, neighbors, begin, end, f, partial);
+		}
+		else if (table != nullptr) {
+			pairForceTable(*table, ps.x.data(), ps.y.data(), ps.type.data(), offsets, neighbors, begin, end, LW, LH, fx, fy, partial);
+		}
+		else {
+			forceKernel(p, ps.x.data(), ps.y.data(), offsets, neighbors, begin, end, fx, fy, partial);
+		}
+	};
+	if (sums != nullptr) *sums = PairSums();
+
+	if (T == 1) {
+		std::fill(ax, ax + ps.n, 0.0);
+		std::fill(ay, ay + ps.n, 0.0);
+		if (threeD) std::fill(az, az + ps.n, 0.0);
+		kernel(0, ps.n, ax, ay, az, sums);
+		for (int i = 0; i < ps.n; ++i) {
+			ax[i] *= invMass;
+			ay[i] *= invMass;
+		}
+		if (threeD) {
+			for (int i = 0; i < ps.n; ++i) az[i] *= invMass;
+		}
+		return;
+	}
+
+	const int depth = threeD ? ps.n : 0;
+	if ((int)threadFx.size() != T || (int)threadFx[0].size() != ps.n || (int)threadFz[0].size() != depth) {
+		threadFx.assign(T, std::vector<double>(ps.n, 0.0));
+		threadFy.assign(T, std::vector<double>(ps.n, 0.0));
+		threadFz.assign(T, std::vector<double>(depth, 0.0));
+		touchedBegin.assign(T, 0);
+		touchedEnd.assign(T, 0);
+	}
+	threadSums.assign(T, PairSums());
+
+	const int chunk = 256;
+	std::atomic<int> nextChunk(0);
+	tp.run([&](int t) {
+		MD_PROFILE_SCOPE("force rows");
+		double* fx = threadFx[t].data();
+		double* fy = threadFy[t].data();
+		double* fz = threadFz[t].data();
+		int lo = ps.n, hi = 0;
+		// Rows are sorted, so the last entry is the highest particle a row writes to
+		auto runRows = [&](int begin, int end) {
+			if (begin >= end) return;
+			kernel(begin, end, fx, fy, fz, sums != nullptr ? &threadSums[t] : nullptr);
+			lo = std::min(lo, begin);
+			hi = std::max(hi, end);
+			for (int i = begin; i < end; ++i) {
+				if (offsets[i + 1] > offsets[i]) hi = std::max(hi, neighbors[offsets[i + 1] - 1] + 1);
+			}
+		};
+		if (deterministicReduction) {
+			// Balance by pair count rather than particle count
+			long long pairs = offsets[ps.n];
+			int begin = (int)(std::lower_bound(offsets, offsets + ps.n, (int)(pairs * t / T)) - offsets);
+			int end = t == T - 1 ? ps.n : (int)(std::lower_bound(offsets, offsets + ps.n, (int)(pairs * (t + 1) / T)) - offsets);
+			runRows(begin, end);
+		}
+		else {
+			for (int c = nextChunk.fetch_add(1); c * chunk < ps.n; c = nextChunk.fetch_add(1)) {
+				runRows(c * chunk, std::min(ps.n, (c + 1) * chunk));
+			}
+		}
+		touchedBegin[t] = lo;
+		touchedEnd[t] = hi;
+	});
+
+	// Reduction in fixed thread order; each thread owns a contiguous block of particles
+	tp.run([&](int t) {
+		MD_PROFILE_SCOPE("force reduction");
+		int begin, end;
+		splitRange(ps.n, T, t, begin, end);
+		for (int i = begin; i < end; ++i) {
+			ax[i] = 0.0;
+			ay[i] = 0.0;
+		}
+		if (threeD) std::fill(az + begin, az + end, 0.0);
+		for (int s = 0; s < T; ++s) {
+			int lo = std::max(begin, touchedBegin[s]);
+			int hi = std::min(end, touchedEnd[s]);
+			double* fx = threadFx[s].data();
+			double* fy = threadFy[s].data();
+			for (int i = lo; i < hi; ++i) {
+				ax[i] += fx[i];
+				ay[i] += fy[i];
+				fx[i] = 0.0;
+				fy[i] = 0.0;
+			}
+			if (threeD) {
+				double* fz = threadFz[s].data();
+				for (int i = lo; i < hi; ++i) {
+					az[i] += fz[i];
+					fz[i] = 0.0;
+				}
+			}
+		}
+		for (int i = begin; i < end; ++i) {
+			ax[i] *= invMass;
+			ay[i] *= invMass;
+		}
+		if (threeD) {
+			for (int i = begin; i < end; ++i) az[i] *= invMass;
+		}
+	});
+	if (sums != nullptr) {
+		// In thread order, like the forces
+		for (const PairSums& partial : threadSums) {
+			sums->energy += partial.energy;
+			sums->virial += partial.virial;
+		}
+	}
+}
+
+double kineticEnergy(const ParticleSystem& ps)
+{
+	double sum = 0.0;
+	for (int i = 0; i < ps.n; ++i) {
+		double vx, vy, vz = 0.0;
+		if (dimensions == 3) particleVelocity(ps, i, vx, vy, vz);
+		else particleVelocity(ps, i, vx, vy);
+		sum += vx * vx + vy * vy + vz * vz;
+	}
+	return 0.5 * cMass * sum;
+}
+
+void applyPBC(ParticleSystem& ps)
+{
+	applyPBC(ps, 0, ps.n);
+}
+
+void applyPBC(ParticleSystem& ps, int begin, int end)
+{
+	MD_PROFILE_SCOPE("applyPBC");
+	// The box is centered on the origin
+	double* r[3] = { ps.x.data(), ps.y.data(), ps.z.data() };
+	const double L[3] = { LW, LH, LD };
+	if (dimensions == 3) wrapPositions<3, double>(r, L, begin, end);
+	else wrapPositions<2, double>(r, L, begin, end);
+}
+
+// Verlet integration. The new position overwrites the old one in place, so no temporaries are needed.
+// Every particle is independent, so each thread updates its own contiguous block.
+void integrate(ParticleSystem& ps)
+{
+	MD_PROFILE_SCOPE("integrate");
+	ThreadPool& tp = threadPool();
+	tp.run([&](int t) {
+		MD_PROFILE_SCOPE("verlet");
+		int begin, end;
+		splitRange(ps.n, tp.size(), t, begin, end);
+		double* r[3] = { ps.x.data(), ps.y.data(), ps.z.data() };
+		double* rOld[3] = { ps.xOld.data(), ps.yOld.data(), ps.zOld.data() };
+		const double* a[3] = { ps.ax.data(), ps.ay.data(), ps.az.data() };
+		if (dimensions == 3) verletPositions<3, double>(r, rOld, a, dt * dt, begin, end);
+		else verletPositions<2, double>(r, rOld, a, dt * dt, begin, end);
+		applyPBC(ps, begin, end);
+	});
+}
+
+// Times the full step on an nx x ny lattice for 1, 2, 4, ... threads up to every hardware thread
+void strongScaling(std::ostream& out, int nx, int ny, int steps)
+{
+	const int savedThreads = nThreads, savedDimensions = dimensions;
+	// The lattice is the 2D hexagonal one
+	dimensions = 2;
+	const int maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	std::vector<int> counts;
+	for (int t = 1; t < maxThreads; t *= 2) counts.push_back(t);
+	counts.push_back(maxThreads);
+
+	out << "Strong scaling, " << nx * ny << " particles, " << steps << " steps" << std::endl;
+	out << "threads   s/step        speedup   efficiency" << std::endl;
+	double serial = 0.0;
+	for (int t : counts) {
+		nThreads = t;
+		ParticleSystem ps;
+		hexagonalLattice(ps, nx, ny);
+		vInitial(ps);
+		NeighborList nl;
+		nl.build(ps);
+		calculateForce(ps, nl);
+		auto start = std::chrono::steady_clock::now();
+		for (int s = 0; s < steps; ++s) {
+			integrate(ps);
+			nl.update(ps);
+			calculateForce(ps, nl);
+		}
+		double perStep = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / steps;
+		if (t == 1) serial = perStep;
+		out << t << "\t  " << perStep << "\t" << serial / perStep << "\t  " << serial / perStep / t << std::endl;
+	}
+	nThreads = savedThreads;
+	dimensions = savedDimensions;
+}
+
+//Initial velocities function
+void vInitial(ParticleSystem& ps)
+{
+	std::random_device rd;
+	rng.seed(rngSeed != 0 ? (std::default_random_engine::result_type)rngSeed : rd());
+	std::uniform_real_distribution<double> distr(0.0, std::sqrt(0.5));
+
+	const int D = dimensions;
+	std::vector<double> v[3];
+	double vCenterMass[3] = { 0.0, 0.0, 0.0 };
+	double kE[3] = { 0.0, 0.0, 0.0 };
+	for (int d = 0; d < D; d++) v[d].resize(ps.n);
+	for (int i = 0; i < ps.n; i++) {
+		for (int d = 0; d < D; d++) {
+			// Generate a random double between 0 and 1
+			v[d][i] = distr(rng);
+			vCenterMass[d] += v[d][i];
+			kE[d] += cMass * v[d][i] * v[d][i];
+		}
+	}
+	for (int d = 0; d < D; d++) {
+		vCenterMass[d] = vCenterMass[d] / ps.n;
+		kE[d] = kE[d] / ps.n;
+	}
+	double scaleFactor = std::sqrt(2 * Kb * temperature / std::sqrt(std::pow(kE[0], 2) + std::pow(kE[1], 2)));
+	if (D == 3) {
+		// Equipartition, kT of m v^2 per component, for the velocities with the drift removed
+		double kE3 = 0.0;
+		for (int d = 0; d < D; d++) {
+			for (int i = 0; i < ps.n; i++) kE3 += cMass * (v[d][i] - vCenterMass[d]) * (v[d][i] - vCenterMass[d]);
+		}
+		scaleFactor = std::sqrt(3 * Kb * temperature * ps.n / kE3);
+	}
+	for (int d = 0; d < D; d++) {
+		std::vector<double>& old = ps.oldPosition(d);
+		for (int i = 0; i < ps.n; i++) {
+			v[d][i] = (v[d][i] - vCenterMass[d]) * scaleFactor;
+			old[i] += (-dt * v[d][i]);
+		}
+	}
+}
@@ -0,0 +1,113 @@
+// MOLECULAR DYNAMICS ENGINE
+// Particle storage and the functions that advance it in time
+
+#pragma once
+
+#include <cmath>
+#include <ostream>
+#include <random>
+#include <vector>
+
+#include "ljkernel.h"
+
+// Constants for Lennard-Jones potential in SI units
+const double PI = 3.14159265358979323846;
+const double epsilon = 0.00286 * 1.60218e-19; // Depth of the potential well in Joules
+const double sigma = 0.35e-9;                // Distance at which the potential is zero in meters
+const double cMass = 1.9944733e-26;
+const double Kb = 1.380649e-23;
+
+struct NeighborList;
+struct PairTable;
+class ThreadPool;
+
+// Global simulation parameters (defined in md.cpp)
+extern double eq_dist;
+extern double boxSize;
+extern double LH;
+extern double LW;
+extern double LD;      // Box depth (m), 3D only
+extern int dimensions; // 2, or 3 for particles with a z coordinate in a box LW x LH x LD
+extern double temperature;
+extern double dt;      // Time step for integration in seconds
+extern double rCut;    // Lennard-Jones cutoff radius (m)
+extern int latticeX;  // Particles per row of the initial hexagonal lattice
+extern int latticeY;  // Rows of the initial hexagonal lattice
+extern int latticeZ;  // Cubic cells along z of the initial FCC lattice (3D); latticeX and latticeY count them along x and y
+extern int Npart;
+extern unsigned long long rngSeed; // Seed for the initial velocities, 0 = draw one from std::random_device
+extern std::default_random_engine rng; // Engine behind every random draw; seeded by vInitial, saved in checkpoints
+extern LJKernel forceKernel; // Pair kernel used by calculateForce, picked at first use if unset
+extern const PairTable* pairTable; // Multi-species tabulated potential, used instead of forceKernel when set
+extern int nThreads;                // Worker threads for force and integration, 0 = all hardware threads
+extern bool deterministicReduction; // Static work split so forces are bitwise reproducible run-to-run
+
+// Structure-of-arrays particle store. Every per-particle quantity lives in its own
+// contiguous array so the integrator and force loops run over plain doubles. The z arrays
+// are only allocated when dimensions is 3.
+struct ParticleSystem
+{
+	int n = 0;
+	std::vector<double> x, y, z;          // Current positions (m)
+	std::vector<double> xOld, yOld, zOld; // Positions at the previous step (m)
+	std::vector<double> ax, ay, az;       // Accelerations (m/s^2)
+	std::vector<int> type;                // Atom type of each particle in pairTable, 0 without one
+	std::vector<int> id;                  // Index of each particle in the input, which output files keep after spatial sorting
+
+	void resize(int count);
+	// Coordinate d (0 = x, 1 = y, 2 = z) of the positions, previous positions and accelerations,
+	// for the loops written once for every dimension
+	std::vector<double>& position(int d) { return d == 0 ? x : d == 1 ? y : z; }
+	std::vector<double>& oldPosition(int d) { return d == 0 ? xOld : d == 1 ? yOld : zOld; }
+	std::vector<double>& acceleration(int d) { return d == 0 ? ax : d == 1 ? ay : az; }
+	const std::vector<double>& position(int d) const { return d == 0 ? x : d == 1 ? y : z; }
+	const std::vector<double>& oldPosition(int d) const { return d == 0 ? xOld : d == 1 ? yOld : zOld; }
+	const std::vector<double>& acceleration(int d) const { return d == 0 ? ax : d == 1 ? ay : az; }
+};
+
+// Fills the first count sites (all of them if count <= 0) of an nx x ny hexagonal lattice and sizes the box to it
+void hexagonalLattice(ParticleSystem& ps, int nx, int ny, int count = 0);
+// Same for an nx x ny square lattice, the 2D counterpart of the FCC (100) plane as the hexagonal
+// one is of the (111) plane; nearest neighbors are eq_dist apart in both
+void squareLattice(ParticleSystem& ps, int nx, int ny, int count = 0);
+// nx x ny x nz cubic cells of an FCC lattice with nearest neighbors eq_dist apart, and a box of
+// that size in all three dimensions (3D)
+void fccLattice(ParticleSystem& ps, int nx, int ny, int nz);
+// Sets LW and LH and the rendering scale that goes with them
+void setBox(double width, double height);
+void vInitial(ParticleSystem& ps);
+// With sums, the potential energy and virial of the pairs are accumulated in the same pass
+void calculateForce(ParticleSystem& ps, const NeighborList& nl, PairSums* sums = nullptr);
+// Same, with the pair forces of table (forceKernel if null) written as accelerations to ax, ay
+// and, in 3D, az
+void calculateForce(ParticleSystem& ps, const NeighborList& nl, const PairTable* table, double* ax, double* ay,
+	double* az, PairSums* sums = nullptr);
+// Velocity (m/s) of particle i at the current positions, v = (x - xOld) / dt + a dt / 2 as position
+// Verlet implies it. Every integrator leaves xOld so that this is its own velocity.
+inline void particleVelocity(const ParticleSystem& ps, int i, double& vx, double& vy)
+{
+	double dx = ps.x[i] - ps.xOld[i];
+	double dy = ps.y[i] - ps.yOld[i];
+	// x is wrapped into the box and xOld is not
+	dx -= LW * std::round(dx / LW);
+	dy -= LH * std::round(dy / LH);
+	vx = dx / dt + 0.5 * ps.ax[i] * dt;
+	vy = dy / dt + 0.5 * ps.ay[i] * dt;
+}
+// The same with the z component, in 3D
+inline void particleVelocity(const ParticleSystem& ps, int i, double& vx, double& vy, double& vz)
+{
+	particleVelocity(ps, i, vx, vy);
+	double dz = ps.z[i] - ps.zOld[i];
+	dz -= LD * std::round(dz / LD);
+	vz = dz / dt + 0.5 * ps.az[i] * dt;
+}
+// Kinetic energy (J) at the current positions, from particleVelocity
+double kineticEnergy(const ParticleSystem& ps);
+void applyPBC(ParticleSystem& ps);
+void applyPBC(ParticleSystem& ps, int begin, int end);
+void integrate(ParticleSystem& ps);
+
+ThreadPool& threadPool();
+int threadCount();
+void strongScaling(std::ostream& out, int nx, int ny, int steps);
@@ -0,0 +1,332 @@
+#include "mdapi.h"
+#include "config.h"
+#include "coordinates.h"
+#include "integrator.h"
+#include "md.h"
+#include "minimizer.h"
+#include "neighbor.h"
+#include "output.h"
+#include "potential.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+static const double ANGSTROM = 1e-10;
+static const double PICOSECOND = 1e-12;
+static const double KCAL_PER_MOL = 4184.0 / 6.02214076e23; // J per particle
+static const double BAR = 1e5;
+
+struct MDEngine
+{
+	RunOptions options;
+	ParticleSystem ps;
+	NeighborList nl;
+	Integrator integrator;
+	RunOutputs outputs;
+	std::vector<double> v[3], f[3]; // Velocities and forces, the first dimensions arrays
+};
+
+namespace {
+
+// The md.h globals as they were before the first engine, so every engine starts from the same
+// defaults however the previous one set them
+struct Globals
+{
+	double eqDist, boxSize, LH, LW, LD, temperature, dt, rCut;
+	int dimensions, latticeX, latticeY, latticeZ, Npart;
+	unsigned long long rngSeed;
+	LJKernel forceKernel;
+	const PairTable* pairTable;
+	int nThreads;
+	bool deterministicReduction;
+};
+
+bool defaultsSaved = false;
+Globals defaults;
+MDEngine* current = nullptr;
+
+void restoreDefaults()
+{
+	if (!defaultsSaved) {
+		defaults = Globals{ eq_dist, boxSize, LH, LW, LD, temperature, dt, rCut, dimensions, latticeX, latticeY, latticeZ, Npart, rngSeed,
+			forceKernel, pairTable, nThreads, deterministicReduction };
+		defaultsSaved = true;
+		return;
+	}
+	eq_dist = defaults.eqDist;
+	boxSize = defaults.boxSize;
+	LH = defaults.LH;
+	LW = defaults.LW;
+	LD = defaults.LD;
+	temperature = defaults.temperature;
+	dt = defaults.dt;
+	rCut = defaults.rCut;
+	dimensions = defaults.dimensions;
+	latticeX = defaults.latticeX;
+	latticeY = defaults.latticeY;
+	latticeZ = defaults.latticeZ;
+	Npart = defaults.Npart;
+	rngSeed = defaults.rngSeed;
+	forceKernel = defaults.forceKernel;
+	pairTable = defaults.pairTable;
+	nThreads = defaults.nThreads;
+	deterministicReduction = defaults.deterministicReduction;
+}
+
+// Velocities as the ENERGY lines and the velocity DCD use them, and forces
+void refreshDerived(MDEngine& md)
+{
+	const ParticleSystem& ps = md.ps;
+	for (int i = 0; i < ps.n; ++i) {
+		if (dimensions == 3) particleVelocity(ps, i, md.v[0][i], md.v[1][i], md.v[2][i]);
+		else particleVelocity(ps, i, md.v[0][i], md.v[1][i]);
+		for (int d = 0; d < dimensions; ++d) md.f[d][i] = cMass * ps.acceleration(d)[i];
+	}
+}
+
+// New velocities and forces after the positions were relaxed, as main starts the dynamics
+bool startDynamics(MDEngine& md)
+{
+	vInitial(md.ps);
+	calculateForce(md.ps, md.nl);
+	md.integrator = Integrator();
+	if (!md.integrator.setup(md.options, md.ps, md.nl)) return false;
+	refreshDerived(md);
+	return true;
+}
+
+// Every entry point takes a null engine, as after a failed md_create, without touching it
+bool engineGiven(const MDEngine* md)
+{
+	if (md != nullptr) return true;
+	std::cout << "ERROR: no engine, md_create failed or md_destroy freed it" << std::endl;
+	return false;
+}
+
+} // namespace
+
+MDEngine* md_create(int argc, const char* const* argv)
+{
+	if (current != nullptr) {
+		std::cout << "ERROR: an engine already exists, destroy it first" << std::endl;
+		return nullptr;
+	}
+	restoreDefaults();
+	// parseCommandLine skips the program name, as in main
+	std::vector<std::string> args(1, "md");
+	for (int i = 0; i < argc; ++i) args.push_back(argv[i]);
+	std::vector<char*> pointers;
+	for (std::string& a : args) pointers.push_back(&a[0]);
+
+	std::unique_ptr<MDEngine> md(new MDEngine());
+	RunOptions& options = md->options;
+	options.headless = true;
+	if (!parseCommandLine((int)pointers.size(), pointers.data(), options)) return nullptr;
+	if (!options.mode.empty() || options.replicas > 0) {
+		std::cout << "ERROR: diagnostic modes and replicas are only available in the program" << std::endl;
+		return nullptr;
+	}
+	profileStart(options.profileTrace);
+
+	ParticleSystem& ps = md->ps;
+	if (!loadInitialSystem(options, ps, md->nl)) return nullptr;
+	if (!loadForceField(options, ps) || !fitBoxToCutoff(options, ps)) return nullptr;
+	md->nl.skin = options.skin;
+	md->nl.restore(ps);
+	if (options.restartFrom.empty()) {
+		if (!minimize(options, ps, md->nl, std::cout)) return nullptr;
+		vInitial(ps);
+		calculateForce(ps, md->nl);
+	}
+	if (!md->integrator.setup(options, ps, md->nl)) return nullptr;
+	printConfiguration(options);
+	if (!md->outputs.open(options, ps, md->integrator)) return nullptr;
+	for (int d = 0; d < dimensions; ++d) {
+		md->v[d].assign(ps.n, 0.0);
+		md->f[d].assign(ps.n, 0.0);
+	}
+	refreshDerived(*md);
+	current = md.release();
+	return current;
+}
+
+void md_destroy(MDEngine* md)
+{
+	if (md == nullptr) return;
+	md->outputs.close(md->ps, md->nl);
+	profileFinish(std::cout);
+	if (md == current) current = nullptr;
+	delete md;
+}
+
+int md_minimize(MDEngine* md, long long steps, const char* method, double tolerance)
+{
+	if (!engineGiven(md)) return 0;
+	if (md->integrator.stepCount() > 0) {
+		std::cout << "ERROR: minimization must come before the first step" << std::endl;
+		return 0;
+	}
+	RunOptions options = md->options;
+	options.minimizeSteps = steps;
+	if (method != nullptr) options.minimizer = method;
+	if (tolerance > 0.0) options.minimizeTolerance = tolerance * KCAL_PER_MOL / ANGSTROM;
+	if (options.minimizer != "fire" && options.minimizer != "lbfgs") {
+		std::cout << "ERROR: minimizer must be fire or lbfgs, got " << options.minimizer << std::endl;
+		return 0;
+	}
+	if (!minimize(options, md->ps, md->nl, std::cout)) return 0;
+	return startDynamics(*md) ? 1 : 0;
+}
+
+int md_step(MDEngine* md, long long steps)
+{
+	if (!engineGiven(md)) return 0;
+	if (steps < 0) {
+		std::cout << "ERROR: the number of steps must not be negative" << std::endl;
+		return 0;
+	}
+	for (long long s = 0; s < steps; ++s) {
+		md->integrator.step(md->ps, md->nl);
+		md->outputs.stepDone(md->ps, md->nl, md->integrator.stepCount());
+	}
+	refreshDerived(*md);
+	return 1;
+}
+
+int md_count(const MDEngine* md)
+{
+	if (!engineGiven(md)) return 0;
+	return md->ps.n;
+}
+
+double* md_array(MDEngine* md, int which)
+{
+	if (!engineGiven(md)) return nullptr;
+	ParticleSystem& ps = md->ps;
+	if (which >= MD_Z && which < MD_ARRAY_COUNT && dimensions != 3) return nullptr;
+	switch (which) {
+	case MD_X: return ps.x.data();
+	case MD_Y: return ps.y.data();
+	case MD_X_OLD: return ps.xOld.data();
+	case MD_Y_OLD: return ps.yOld.data();
+	case MD_AX: return ps.ax.data();
+	case MD_AY: return ps.ay.data();
+	case MD_VX: return md->v[0].data();
+	case MD_VY: return md->v[1].data();
+	case MD_FX: return md->f[0].data();
+	case MD_FY: return md->f[1].data();
+	case MD_Z: return ps.z.data();
+	case MD_Z_OLD: return ps.zOld.data();
+	case MD_AZ: return ps.az.data();
+	case MD_VZ: return md->v[2].data();
+	case MD_FZ: return md->f[2].data();
+	default: return nullptr;
+	}
+}
+
+const int* md_ids(const MDEngine* md)
+{
+	if (!engineGiven(md)) return nullptr;
+	return md->ps.id.data();
+}
+
+const int* md_types(const MDEngine* md)
+{
+	if (!engineGiven(md)) return nullptr;
+	return md->ps.type.data();
+}
+
+long long md_step_count(const MDEngine* md)
+{
+	if (!engineGiven(md)) return 0;
+	return md->options.firstStep + md->integrator.stepCount();
+}
+
+double md_time(const MDEngine* md)
+{
+	if (!engineGiven(md)) return 0.0;
+	return md->integrator.time() / PICOSECOND;
+}
+
+int md_dimensions(const MDEngine* md)
+{
+	if (!engineGiven(md)) return 0;
+	return dimensions;
+}
+
+void md_box(const MDEngine* md, double* size)
+{
+	if (!engineGiven(md)) return;
+	size[0] = LW;
+	size[1] = LH;
+	if (dimensions == 3) size[2] = LD;
+}
+
+int md_energies(MDEngine* md, double* values)
+{
+	if (!engineGiven(md)) return 0;
+	const ParticleSystem& ps = md->ps;
+	// The forces go to scratch arrays, ps.ax is already current
+	const bool threeD = dimensions == 3;
+	std::vector<double> ax(ps.n), ay(ps.n), az(threeD ? ps.n : 0);
+	PairSums sums;
+	calculateForce(md->ps, md->nl, pairTable, ax.data(), ay.data(), az.data(), &sums);
+	const double kinetic = kineticEnergy(ps);
+	const int dof = std::max(1, dimensions * ps.n - dimensions); // Center-of-mass motion removed
+	const double volume = threeD ? LW * LH * LD : LW * LH * md->options.layerThickness;
+	values[0] = sums.energy / KCAL_PER_MOL;
+	values[1] = kinetic / KCAL_PER_MOL;
+	values[2] = (sums.energy + kinetic) / KCAL_PER_MOL;
+	values[3] = 2.0 * kinetic / (dof * Kb);
+	// Virial theorem, as the ENERGY lines
+	values[4] = threeD ? (2.0 * kinetic + sums.virial) / (3.0 * volume) / BAR : (kinetic + 0.5 * sums.virial) / volume / BAR;
+	return 1;
+}
+
+int md_gofr(MDEngine* md, int bins, double* rMax, double* g)
+{
+	if (!engineGiven(md)) return 0;
+	// The list holds every pair within the cutoff, and the minimum image is unique below half the box
+	const bool threeD = dimensions == 3;
+	const double limit = std::min(rCut, 0.5 * std::min(std::min(LW, LH), threeD ? LD : LH));
+	const double r = *rMax > 0.0 ? *rMax * ANGSTROM : limit;
+	if (bins < 1 || r > limit * (1.0 + 1e-12)) {
+		std::cout << "ERROR: g(r) needs at least one bin and a range of at most " << limit / ANGSTROM << " A" << std::endl;
+		return 0;
+	}
+	const ParticleSystem& ps = md->ps;
+	const NeighborList& nl = md->nl;
+	std::vector<long long> counts(bins, 0);
+	const double delta = r / bins;
+	for (int i = 0; i < ps.n; ++i) {
+		for (int k = nl.offsets[i]; k < nl.offsets[i + 1]; ++k) {
+			const int j = nl.neighbors[k];
+			double dx = ps.x[i] - ps.x[j];
+			double dy = ps.y[i] - ps.y[j];
+			dx -= LW * std::round(dx / LW);
+			dy -= LH * std::round(dy / LH);
+			double d2 = dx * dx + dy * dy;
+			if (threeD) {
+				double dz = ps.z[i] - ps.z[j];
+				dz -= LD * std::round(dz / LD);
+				d2 += dz * dz;
+			}
+			const double d = std::sqrt(d2);
+			if (d < r) counts[std::min(bins - 1, (int)(d / delta))]++;
+		}
+	}
+	// Each pair is one neighbor of both particles; ideal gas of the same density in every ring or shell
+	const double density = ps.n / (threeD ? LW * LH * LD : LW * LH);
+	for (int b = 0; b < bins; ++b) {
+		const double ring = threeD ? 4.0 / 3.0 * PI * delta * delta * delta * ((b + 1.0) * (b + 1.0) * (b + 1.0) - (double)b * b * b)
+			: PI * delta * delta * ((b + 1.0) * (b + 1.0) - (double)b * b);
+		g[b] = 2.0 * counts[b] / (ps.n * density * ring);
+	}
+	*rMax = r / ANGSTROM;
+	return 1;
+}
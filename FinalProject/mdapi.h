@@ -0,0 +1,80 @@
+// C INTERFACE
+// The engine behind a plain C API, built as a shared library for Python (python/mdengine.py) and
+// any other language with a C foreign-function interface. The particle arrays are handed out as
+// pointers into the engine's own storage, so a caller can wrap them (NumPy views) without copies;
+// they stay valid, and are updated in place, until md_destroy.
+//
+// The engine keeps its parameters in the globals of md.h, so only one engine exists at a time.
+// Functions that can fail print the reason, as the program does, and return 0; 1 means success.
+// A null engine is such a failure: functions returning a count or pointer then return 0 or null.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32)
+#define MD_API __declspec(dllexport)
+#else
+#define MD_API __attribute__((visibility("default")))
+#endif
+
+typedef struct MDEngine MDEngine;
+
+// Arrays of md_array, md_count() doubles each, in SI units and the engine's current particle
+// order (see md_ids). Positions and accelerations are the integrator's own arrays; velocities
+// and forces are kept by the engine and refreshed at the end of every call that moves the particles.
+// The z arrays exist only in 3D (md_dimensions); md_array returns null for them in 2D.
+enum MDArray
+{
+	MD_X, MD_Y,         // Positions (m), wrapped into the box centered on the origin
+	MD_X_OLD, MD_Y_OLD, // Positions of the previous step (m), not wrapped
+	MD_AX, MD_AY,       // Accelerations (m/s^2)
+	MD_VX, MD_VY,       // Velocities (m/s)
+	MD_FX, MD_FY,       // Forces (N)
+	MD_Z, MD_Z_OLD, MD_AZ, MD_VZ, MD_FZ,
+	MD_ARRAY_COUNT
+};
+
+// Sets the system up from the same options as the program's command line, "--key value" pairs
+// and configuration files (config.h), and prepares it as main does before the first step:
+// starting structure, force field, minimization if "minimize" is given, velocities, forces and
+// output files. Returns null on error or when another engine exists.
+MD_API MDEngine* md_create(int argc, const char* const* argv);
+// Writes the final checkpoint and analysis files, closes the trajectory and frees the engine
+MD_API void md_destroy(MDEngine* md);
+
+// Relaxes the structure with method ("fire" or "lbfgs", null = the minimizer option) for at most
+// steps steps or until no force exceeds tolerance (kcal/mol/A, <= 0 = the minimizetolerance
+// option), then draws new velocities at the temperature. Only before the first md_step.
+MD_API int md_minimize(MDEngine* md, long long steps, const char* method, double tolerance);
+// Advances steps steps, writing the output files the options ask for as a run does
+MD_API int md_step(MDEngine* md, long long steps);
+
+MD_API int md_count(const MDEngine* md);
+MD_API double* md_array(MDEngine* md, int which);
+// Index of every particle in the input; spatial sorting (sortfreq) reorders the arrays
+MD_API const int* md_ids(const MDEngine* md);
+// Atom type of every particle in the force field, 0 without parameter files
+MD_API const int* md_types(const MDEngine* md);
+// Steps taken since the start (including those of the checkpoint the run started from)
+MD_API long long md_step_count(const MDEngine* md);
+// Simulated time of this run (ps)
+MD_API double md_time(const MDEngine* md);
+// 2 or 3, the number of coordinates of every particle
+MD_API int md_dimensions(const MDEngine* md);
+// Width, height and, in 3D, depth of the periodic box (m): md_dimensions() values
+MD_API void md_box(const MDEngine* md, double* size);
+
+// Energies of the current state as the ENERGY lines print them: potential, kinetic and total
+// (kcal/mol), temperature (K) and pressure (bar) into values[0..4]
+MD_API int md_energies(MDEngine* md, double* values);
+// Radial distribution function of the current positions, all types together: g[k] for r in
+// [k, k + 1) * rMax / bins. *rMax (A) is at most the cutoff and half the box; <= 0 asks for
+// that limit, which is written back.
+MD_API int md_gofr(MDEngine* md, int bins, double* rMax, double* g);
+
+#ifdef __cplusplus
+}
+#endif
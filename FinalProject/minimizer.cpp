@@ -0,0 +1,300 @@
+#include "minimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <iomanip>
+#include <vector>
+
+static const double ANGSTROM = 1e-10;
+static const double KCAL_PER_MOL = 4184.0 / 6.02214076e23; // J per particle
+static const double FORCE_UNIT = KCAL_PER_MOL / ANGSTROM;   // N per kcal/mol/A
+// Largest distance any particle moves in one step, so that overlapping atoms of a loaded
+// structure are pushed apart instead of being fired across the box
+static const double MAX_MOVE = 0.1 * ANGSTROM;
+
+namespace {
+
+// Positions, forces and directions are handled as vectors of DN components, x0 y0 (z0) x1 y1 ...
+class Minimizer
+{
+public:
+	Minimizer(const RunOptions& options, ParticleSystem& ps, NeighborList& nl, std::ostream& out)
+		: ps(ps), nl(nl), out(out), maxSteps(options.minimizeSteps), tolerance(options.minimizeTolerance),
+		outputFreq(options.outputEnergies), dims(dimensions), f(dims * (size_t)ps.n) {}
+
+	void fire();
+	void lbfgs();
+	void finish(const char* method);
+
+private:
+	// Potential energy (J) and forces f (N) at the current positions
+	void evaluate();
+	// Positions += scale * d, wrapped into the box
+	void move(const std::vector<double>& d, double scale);
+	// Scale that keeps every particle of scale * d within MAX_MOVE
+	double moveLimit(const std::vector<double>& d) const;
+	bool converged() const { return maxForce <= tolerance; }
+	void log(bool always);
+	void savePositions();
+	void restorePositions();
+
+	ParticleSystem& ps;
+	NeighborList& nl;
+	std::ostream& out;
+	long long maxSteps;
+	double tolerance;
+	int outputFreq;
+	int dims;
+	std::vector<double> f;
+	std::vector<double> saved[3];
+	double energy = 0.0, startEnergy = 0.0, maxForce = 0.0, rmsForce = 0.0;
+	long long steps = 0, evaluations = 0;
+	long long lastLogged = -1;
+	bool stalled = false;
+};
+
+void Minimizer::evaluate()
+{
+	nl.update(ps);
+	PairSums sums;
+	calculateForce(ps, nl, &sums);
+	energy = sums.energy;
+	double max2 = 0.0, sum2 = 0.0;
+	for (int i = 0; i < ps.n; ++i) {
+		double f2 = 0.0;
+		for (int d = 0; d < dims; ++d) {
+			f[dims * i + d] = cMass * ps.acceleration(d)[i];
+			f2 += f[dims * i + d] * f[dims * i + d];
+		}
+		max2 = std::max(max2, f2);
+		sum2 += f2;
+	}
+	maxForce = std::sqrt(max2);
+	rmsForce = std::sqrt(sum2 / std::max(1, ps.n));
+	if (evaluations++ == 0) startEnergy = energy;
+}
+
+void Minimizer::move(const std::vector<double>& d, double scale)
+{
+	for (int k = 0; k < dims; ++k) {
+		std::vector<double>& r = ps.position(k);
+		for (int i = 0; i < ps.n; ++i) r[i] += scale * d[dims * i + k];
+	}
+	applyPBC(ps);
+}
+
+double Minimizer::moveLimit(const std::vector<double>& d) const
+{
+	double max2 = 0.0;
+	for (int i = 0; i < ps.n; ++i) {
+		double d2 = 0.0;
+		for (int k = 0; k < dims; ++k) d2 += d[dims * i + k] * d[dims * i + k];
+		max2 = std::max(max2, d2);
+	}
+	return max2 > MAX_MOVE * MAX_MOVE ? MAX_MOVE / std::sqrt(max2) : 1.0;
+}
+
+void Minimizer::savePositions()
+{
+	for (int d = 0; d < dims; ++d) saved[d] = ps.position(d);
+}
+
+void Minimizer::restorePositions()
+{
+	for (int d = 0; d < dims; ++d) ps.position(d) = saved[d];
+}
+
+// Same layout as the ENERGY lines: MTITLE once, then a MINIMIZE line every outputEnergies steps
+void Minimizer::log(bool always)
+{
+	const bool due = outputFreq > 0 && steps % outputFreq == 0;
+	if ((!always && !due) || lastLogged == steps) return;
+	if (lastLogged < 0) {
+		out << "MTITLE:" << std::setw(8) << "TS" << std::setw(15) << "POTENTIAL" << std::setw(15) << "MAXFORCE"
+			<< std::setw(15) << "RMSFORCE" << "\n\n";
+	}
+	out << "MINIMIZE:" << std::setw(6) << steps << std::fixed << std::setprecision(4) << std::setw(15) << energy / KCAL_PER_MOL
+		<< std::defaultfloat << std::setprecision(6) << std::setw(15) << maxForce / FORCE_UNIT << std::setw(15)
+		<< rmsForce / FORCE_UNIT << "\n\n" << std::flush;
+	lastLogged = steps;
+}
+
+// FIRE 2.0 (Guenole et al., Comput. Mater. Sci. 175, 109584, 2020, algorithm 2; FIRE from
+// Bitzek et al., PRL 97, 170201, 2006): damped dynamics with a semi-implicit Euler step whose
+// velocity is turned towards the force, speeding up while the motion stays downhill. Going
+// uphill steps half of the last move back and stops dead. During the first delay steps that
+// does not shrink the timestep, since the power of the zero starting velocity is zero.
+void Minimizer::fire()
+{
+	const int delay = 5;
+	const double grow = 1.1, shrink = 0.5, alphaStart = 0.1, alphaShrink = 0.99;
+	const double hMax = 10.0 * dt, hMin = 0.02 * dt;
+	double h = dt, alpha = alphaStart;
+	double lastScale = 0.0; // Fraction of d the last move applied, 0 before the first
+	int downhill = 0;
+	std::vector<double> v(f.size(), 0.0), d(f.size());
+	evaluate();
+	log(true);
+	while (steps < maxSteps && !converged()) {
+		double power = 0.0;
+		for (size_t k = 0; k < f.size(); ++k) power += f[k] * v[k];
+		if (power > 0.0) {
+			if (++downhill > delay) {
+				h = std::min(h * grow, hMax);
+				alpha *= alphaShrink;
+			}
+		}
+		else {
+			downhill = 0;
+			if (steps >= delay) {
+				if (h * shrink >= hMin) h *= shrink;
+				alpha = alphaStart;
+			}
+			// The forces stay those of the uphill positions, as in the reference algorithm
+			if (lastScale > 0.0) move(d, -0.5 * lastScale);
+			std::fill(v.begin(), v.end(), 0.0);
+		}
+		double v2 = 0.0, f2 = 0.0;
+		for (size_t k = 0; k < f.size(); ++k) {
+			v[k] += h * f[k] / cMass;
+			v2 += v[k] * v[k];
+			f2 += f[k] * f[k];
+		}
+		const double turn = f2 > 0.0 ? alpha * std::sqrt(v2 / f2) : 0.0;
+		for (size_t k = 0; k < f.size(); ++k) {
+			v[k] = (1.0 - alpha) * v[k] + turn * f[k];
+			d[k] = h * v[k];
+		}
+		lastScale = moveLimit(d);
+		move(d, lastScale);
+		evaluate();
+		steps++;
+		log(false);
+	}
+}
+
+// Limited-memory BFGS (Nocedal and Wright, Numerical Optimization, algorithm 7.4) with a
+// backtracking line search on the Armijo condition. The first step, and any step after the
+// history is dropped, moves the particle with the largest force by MAX_MOVE.
+void Minimizer::lbfgs()
+{
+	const size_t memory = 8;
+	const double armijo = 1e-4;
+	struct Update { std::vector<double> s, y; double rho; };
+	std::deque<Update> history;
+	std::vector<double> d(f.size()), gradient(f.size()), alphas;
+	auto dot = [](const std::vector<double>& a, const std::vector<double>& b) {
+		double sum = 0.0;
+		for (size_t k = 0; k < a.size(); ++k) sum += a[k] * b[k];
+		return sum;
+	};
+
+	evaluate();
+	log(true);
+	while (steps < maxSteps && !converged()) {
+		for (size_t k = 0; k < f.size(); ++k) gradient[k] = -f[k];
+
+		// Two-loop recursion: d = -H gradient
+		for (size_t k = 0; k < f.size(); ++k) d[k] = gradient[k];
+		alphas.assign(history.size(), 0.0);
+		for (size_t h = history.size(); h-- > 0;) {
+			alphas[h] = history[h].rho * dot(history[h].s, d);
+			for (size_t k = 0; k < d.size(); ++k) d[k] -= alphas[h] * history[h].y[k];
+		}
+		const double gamma = history.empty() ? MAX_MOVE / maxForce
+			: dot(history.back().s, history.back().y) / dot(history.back().y, history.back().y);
+		for (size_t k = 0; k < d.size(); ++k) d[k] *= gamma;
+		for (size_t h = 0; h < history.size(); ++h) {
+			const double beta = history[h].rho * dot(history[h].y, d);
+			for (size_t k = 0; k < d.size(); ++k) d[k] += (alphas[h] - beta) * history[h].s[k];
+		}
+		for (size_t k = 0; k < d.size(); ++k) d[k] = -d[k];
+		if (dot(d, gradient) >= 0.0) {
+			// Not a descent direction: start over from steepest descent
+			history.clear();
+			for (size_t k = 0; k < d.size(); ++k) d[k] = f[k] * (MAX_MOVE / maxForce);
+		}
+		const double limit = moveLimit(d);
+		for (double& component : d) component *= limit;
+
+		const double startEnergy = energy, slope = dot(d, gradient);
+		savePositions();
+		double step = 1.0;
+		move(d, step);
+		evaluate();
+		for (int tries = 0; energy > startEnergy + armijo * step * slope && tries < 20; ++tries) {
+			step *= 0.5;
+			restorePositions();
+			move(d, step);
+			evaluate();
+		}
+		if (energy > startEnergy + armijo * step * slope) {
+			// Even tiny steps go uphill: the energy is as low as double precision can tell
+			restorePositions();
+			evaluate();
+			if (history.empty()) {
+				stalled = true;
+				break;
+			}
+			history.clear();
+			continue;
+		}
+
+		Update update;
+		update.s.resize(d.size());
+		update.y.resize(d.size());
+		for (size_t k = 0; k < d.size(); ++k) {
+			update.s[k] = step * d[k];
+			update.y[k] = -f[k] - gradient[k];
+		}
+		const double sy = dot(update.s, update.y);
+		// Only curvature-positive pairs keep the inverse Hessian positive definite
+		if (sy > 0.0) {
+			update.rho = 1.0 / sy;
+			history.push_back(std::move(update));
+			if (history.size() > memory) history.pop_front();
+		}
+		steps++;
+		log(false);
+	}
+}
+
+void Minimizer::finish(const char* method)
+{
+	log(true);
+	std::copy(ps.x.begin(), ps.x.end(), ps.xOld.begin());
+	std::copy(ps.y.begin(), ps.y.end(), ps.yOld.begin());
+	if (dims == 3) std::copy(ps.z.begin(), ps.z.end(), ps.zOld.begin());
+	const double perAtom = energy / KCAL_PER_MOL / std::max(1, ps.n);
+	out << "Info: MINIMIZER " << method << (converged() ? " CONVERGED" : stalled ? " STALLED" : " STOPPED") << " after " << steps
+		<< " steps, " << evaluations << " force evaluations, energy " << startEnergy / KCAL_PER_MOL << " -> "
+		<< energy / KCAL_PER_MOL << " kcal/mol (" << perAtom << " per atom), max force " << maxForce / FORCE_UNIT
+		<< " kcal/mol/A" << std::endl;
+	// Small forces also hold in a jammed state, where atoms press on each other from every side
+	if (energy > 0.0) {
+		out << "Warning: the minimized pair energy is positive, " << perAtom
+			<< " kcal/mol per atom; atoms may still overlap or the box may be too small" << std::endl;
+	}
+	// The neighbor-list statistics describe the dynamics
+	nl.builds = 0;
+	nl.steps = 0;
+}
+
+}
+
+bool minimize(const RunOptions& options, ParticleSystem& ps, NeighborList& nl, std::ostream& out)
+{
+	if (options.minimizeSteps <= 0) return true;
+	if (options.minimizeTolerance < 0.0) {
+		out << "ERROR: minimizetolerance must not be negative" << std::endl;
+		return false;
+	}
+	out << "Info: MINIMIZER              " << options.minimizer << ", at most " << options.minimizeSteps
+		<< " steps, force tolerance " << options.minimizeTolerance / FORCE_UNIT << " kcal/mol/A" << std::endl;
+	Minimizer minimizer(options, ps, nl, out);
+	if (options.minimizer == "lbfgs") minimizer.lbfgs();
+	else minimizer.fire();
+	minimizer.finish(options.minimizer == "lbfgs" ? "L-BFGS" : "FIRE");
+	return true;
+}
@@ -0,0 +1,18 @@
+// ENERGY MINIMIZATION
+// FIRE and L-BFGS relaxation of the starting structure, with the force routine of the dynamics,
+// so loaded or generated structures reach dynamics without overlaps
+
+#pragma once
+
+#include <ostream>
+
+#include "config.h"
+#include "md.h"
+#include "neighbor.h"
+
+// Moves ps towards the nearest minimum of the potential energy with options.minimizer, for at most
+// options.minimizeSteps steps or until no particle feels a force above options.minimizeTolerance.
+// Prints the energy and forces every outputEnergies steps and at the end. Leaves the neighbor
+// list and accelerations current and xOld = x, so vInitial can start the dynamics from there.
+// Prints the reason and returns false on bad settings.
+bool minimize(const RunOptions& options, ParticleSystem& ps, NeighborList& nl, std::ostream& out);
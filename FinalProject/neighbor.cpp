@@ -0,0 +1,99 @@
+#include "neighbor.h"
+#include "profile.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cmath>
+
+void CellList::build(const ParticleSystem& ps, double minCellSize)
+{
+	nx = std::max(1, (int)std::floor(LW / minCellSize));
+	ny = std::max(1, (int)std::floor(LH / minCellSize));
+	nz = dimensions == 3 ? std::max(1, (int)std::floor(LD / minCellSize)) : 1;
+	cellW = LW / nx;
+	cellH = LH / ny;
+	cellD = dimensions == 3 ? LD / nz : 0.0;
+	head.assign(nx * ny * nz, -1);
+	next.assign(ps.n, -1);
+	for (int i = 0; i < ps.n; ++i) {
+		int c = dimensions == 3 ? cellOf(ps.x[i], ps.y[i], ps.z[i]) : cellOf(ps.x[i], ps.y[i]);
+		next[i] = head[c];
+		head[c] = i;
+	}
+}
+
+int CellList::cellOf(double x, double y) const
+{
+	int cx = (int)std::floor((x + 0.5 * LW) / cellW);
+	int cy = (int)std::floor((y + 0.5 * LH) / cellH);
+	// Particles sitting exactly on the upper box edge (or slightly outside before the next applyPBC)
+	cx = std::min(std::max(cx, 0), nx - 1);
+	cy = std::min(std::max(cy, 0), ny - 1);
+	return cy * nx + cx;
+}
+
+int CellList::cellOf(double x, double y, double z) const
+{
+	int cz = (int)std::floor((z + 0.5 * LD) / cellD);
+	cz = std::min(std::max(cz, 0), nz - 1);
+	return cz * nx * ny + cellOf(x, y);
+}
+
+// Positions and box of ps as BasicNeighborList takes them, in 2D or 3D
+static void listBuild(BasicNeighborList<double>& list, const double* const* r, int n, double rList)
+{
+	const double L[3] = { LW, LH, LD };
+	if (dimensions == 3) list.build<3>(r, n, L, rList);
+	else list.build<2>(r, n, L, rList);
+}
+
+void NeighborList::build(const ParticleSystem& ps)
+{
+	MD_PROFILE_SCOPE("neighbor build");
+	MD_PROFILE_COUNT("neighbor rebuilds", 1);
+	const double* r[3] = { ps.x.data(), ps.y.data(), ps.z.data() };
+	listBuild(*this, r, ps.n, (range > 0.0 ? range : rCut) + skin);
+}
+
+void NeighborList::restore(const ParticleSystem& ps)
+{
+	for (int d = 0; d < dimensions; ++d) {
+		if ((int)rRef[d].size() != ps.n) {
+			build(ps);
+			return;
+		}
+	}
+	MD_PROFILE_SCOPE("neighbor build");
+	// build() overwrites rRef, so it reads copies
+	const std::vector<double> x = rRef[0], y = rRef[1], z = rRef[2];
+	const double* r[3] = { x.data(), y.data(), z.data() };
+	listBuild(*this, r, ps.n, (range > 0.0 ? range : rCut) + skin);
+}
+
+bool NeighborList::needsRebuild(const ParticleSystem& ps) const
+{
+	const double* r[3] = { ps.x.data(), ps.y.data(), ps.z.data() };
+	const double L[3] = { LW, LH, LD };
+	if (dimensions == 3) return BasicNeighborList::needsRebuild<3>(r, ps.n, L);
+	return BasicNeighborList::needsRebuild<2>(r, ps.n, L);
+}
+
+bool NeighborList::update(const ParticleSystem& ps)
+{
+	MD_PROFILE_SCOPE("neighbor update");
+	steps++;
+	if (!needsRebuild(ps)) return false;
+	build(ps);
+	return true;
+}
+
+void NeighborList::printStats(std::ostream& out) const
+{
+	double pairsPerParticle = offsets.empty() || offsets.size() == 1 ? 0.0 : (double)neighbors.size() / (offsets.size() - 1);
+	out << "Neighbor list: " << builds << " builds in " << steps << " steps";
+	if (builds > 0) out << " (" << (double)steps / builds << " steps/build)";
+	out << ", " << pairsPerParticle << " neighbors/particle, "
+		<< (usedCells ? "cell grid " : "all-pairs scan ") << cells[0] << "x" << cells[1];
+	if (dimensions == 3) out << "x" << cells[2];
+	out << std::endl;
+}
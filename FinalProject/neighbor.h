@@ -0,0 +1,166 @@
+// NEIGHBOR SEARCH
+// Linked-cell grid and Verlet neighbor lists for any dimension and precision
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <vector>
+
+#include "md.h"
+#include "threadpool.h"
+
+// Linked-cell grid over the orthorhombic box [-LW/2, LW/2) x [-LH/2, LH/2), and [-LD/2, LD/2)
+// in 3D. head[c] is the first particle in cell c and next[i] the particle after i (-1 ends the chain).
+struct CellList
+{
+	int nx = 0, ny = 0, nz = 1;
+	double cellW = 0.0, cellH = 0.0, cellD = 0.0;
+	std::vector<int> head, next;
+
+	// Sizes the grid so that every cell is at least minCellSize wide and bins all particles.
+	void build(const ParticleSystem& ps, double minCellSize);
+	int cellOf(double x, double y) const;
+	int cellOf(double x, double y, double z) const; // 3D
+};
+
+// Half Verlet neighbor list in compressed rows for coordinates of type T: the neighbors j > i of
+// particle i are neighbors[offsets[i]] .. neighbors[offsets[i + 1] - 1], so each pair appears
+// once. Pairs closer than the list range (cutoff + skin) are kept, so the list stays valid until
+// some particle has moved more than skin / 2 since the last build. build and needsRebuild take
+// the dimension D, and the positions as one array per coordinate (r[0] = x, r[1] = y, r[2] = z),
+// wrapped into the box of side lengths L centered on the origin.
+template <typename T>
+struct BasicNeighborList
+{
+	T skin = T(0);
+	std::vector<int> offsets, neighbors;
+	std::vector<T> rRef[3]; // Positions at the last build, the first D arrays
+	int cells[3] = {};      // Cell grid of the last build
+	long long builds = 0;
+	bool usedCells = false; // False when the box is too small for three cells per side and all pairs are scanned
+
+	template <int D> void build(const T* const* r, int n, const T* L, T rList);
+	template <int D> bool needsRebuild(const T* const* r, int n, const T* L) const;
+};
+
+// The list of the simulation, over the ParticleSystem in SI units, in 2D or 3D as dimensions says
+struct NeighborList : BasicNeighborList<double>
+{
+	double range = 0.0; // Cutoff the list serves, 0 = rCut
+	long long steps = 0;
+
+	NeighborList() { skin = 0.3 * sigma; }
+	void build(const ParticleSystem& ps);
+	// Builds the list at the positions in rRef, as it was when they were recorded
+	// (loadCheckpoint), or at the current positions if they are missing
+	void restore(const ParticleSystem& ps);
+	bool needsRebuild(const ParticleSystem& ps) const;
+	// Called once per step; rebuilds only when the displacement criterion requires it.
+	bool update(const ParticleSystem& ps);
+	void printStats(std::ostream& out) const;
+};
+
+template <typename T>
+template <int D>
+void BasicNeighborList<T>::build(const T* const* r, int n, const T* L, T rList)
+{
+	const T rList2 = rList * rList;
+	int total = 1;
+	usedCells = true;
+	for (int d = 0; d < D; ++d) {
+		cells[d] = std::max(1, (int)std::floor(L[d] / rList));
+		total *= cells[d];
+		// With fewer than three cells per side the stencil would visit the same cell twice
+		usedCells = usedCells && cells[d] >= 3;
+	}
+
+	// Linked cells: head[c] is the first particle in cell c and next[i] the particle after i
+	std::vector<int> cellOf(n), head(usedCells ? total : 0, -1), next(n, -1);
+	if (usedCells) {
+		for (int i = 0; i < n; ++i) {
+			int c = 0;
+			for (int d = D - 1; d >= 0; --d) {
+				// Particles sitting exactly on the upper box edge (or slightly outside before the next wrap)
+				int cd = (int)std::floor((r[d][i] / L[d] + T(0.5)) * cells[d]);
+				cd = std::min(std::max(cd, 0), cells[d] - 1);
+				c = c * cells[d] + cd;
+			}
+			cellOf[i] = c;
+			next[i] = head[c];
+			head[c] = i;
+		}
+	}
+
+	auto consider = [&](int i, int j) {
+		T d2 = T(0);
+		for (int d = 0; d < D; ++d) {
+			T dr = r[d][j] - r[d][i];
+			dr -= L[d] * std::round(dr / L[d]);
+			d2 += dr * dr;
+		}
+		if (d2 < rList2) neighbors.push_back(j);
+	};
+
+	int stencil = 1;
+	for (int d = 0; d < D; ++d) stencil *= 3;
+	offsets.assign(n + 1, 0);
+	neighbors.clear();
+	for (int i = 0; i < n; ++i) {
+		offsets[i] = (int)neighbors.size();
+		if (usedCells) {
+			int home[D];
+			for (int d = 0, c = cellOf[i]; d < D; ++d) {
+				home[d] = c % cells[d];
+				c /= cells[d];
+			}
+			for (int s = 0; s < stencil; ++s) {
+				// s is the neighbor cell offset written in base 3, one digit per dimension
+				int shift[D];
+				for (int d = 0, code = s; d < D; ++d, code /= 3) shift[d] = code % 3 - 1;
+				int c = 0;
+				for (int d = D - 1; d >= 0; --d) c = c * cells[d] + (home[d] + shift[d] + cells[d]) % cells[d];
+				for (int j = head[c]; j != -1; j = next[j]) {
+					if (j > i) consider(i, j);
+				}
+			}
+		}
+		else {
+			for (int j = i + 1; j < n; ++j) consider(i, j);
+		}
+		// Ascending rows gather positions in memory order and let the force loop find the highest index written
+		std::sort(neighbors.begin() + offsets[i], neighbors.end());
+	}
+	offsets[n] = (int)neighbors.size();
+	for (int d = 0; d < D; ++d) rRef[d].assign(r[d], r[d] + n);
+	builds++;
+}
+
+template <typename T>
+template <int D>
+bool BasicNeighborList<T>::needsRebuild(const T* const* r, int n, const T* L) const
+{
+	if ((int)rRef[0].size() != n) return true;
+	const T limit2 = T(0.25) * skin * skin;
+	ThreadPool& tp = threadPool();
+	std::vector<char> moved(tp.size(), 0);
+	tp.run([&](int t) {
+		int begin, end;
+		splitRange(n, tp.size(), t, begin, end);
+		for (int i = begin; i < end; ++i) {
+			T d2 = T(0);
+			for (int d = 0; d < D; ++d) {
+				T dr = r[d][i] - rRef[d][i];
+				// A particle that crossed the box edge since the build has been wrapped
+				dr -= L[d] * std::round(dr / L[d]);
+				d2 += dr * dr;
+			}
+			if (d2 > limit2) {
+				moved[t] = 1;
+				return;
+			}
+		}
+	});
+	return std::find(moved.begin(), moved.end(), 1) != moved.end();
+}
@@ -0,0 +1,132 @@
+#include "output.h"
+#include "checkpoint.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+static const double KCAL_PER_MOL = 4184.0 / 6.02214076e23; // J per particle
+static const double ANGSTROM = 1e-10;
+static const double BAR = 1e5;
+
+bool RunOutputs::open(const RunOptions& options, const ParticleSystem& ps, const Integrator& integrator)
+{
+	firstStep = options.firstStep;
+	lastStep = firstStep;
+	this->integrator = &integrator;
+	layerThickness = options.layerThickness;
+	if (!options.velDcdFile.empty() && options.dcdFile.empty()) {
+		std::cout << "ERROR: veldcdfile needs dcdfile, both are written at every dcdfreq steps" << std::endl;
+		return false;
+	}
+	if (!options.dcdFile.empty()) {
+		if (options.dcdFreq <= 0) {
+			std::cout << "ERROR: dcdfreq must be positive when dcdfile is set" << std::endl;
+			return false;
+		}
+		dcdFreq = options.dcdFreq;
+		trajectory.reset(new TrajectoryWriter());
+		long long firstFrame = (firstStep / dcdFreq + 1) * dcdFreq;
+		if (!trajectory->open(options.dcdFile, options.velDcdFile, ps.n, firstFrame, dcdFreq, options.dcdUnitCell)) {
+			trajectory.reset();
+			return false;
+		}
+		std::cout << "Info: DCD FILENAME           " << options.dcdFile << std::endl;
+		if (!options.velDcdFile.empty()) std::cout << "Info: VELOCITY DCD FILENAME  " << options.velDcdFile << std::endl;
+		std::cout << "Info: DCD FREQUENCY          " << dcdFreq << std::endl;
+	}
+	if (!options.restartName.empty()) {
+		restartPath = options.restartName + ".chk";
+		restartFreq = options.restartFreq;
+		std::cout << "Info: RESTART FILENAME       " << restartPath << std::endl;
+		std::cout << "Info: RESTART FREQUENCY      " << restartFreq << std::endl;
+	}
+	if (!analysis.setup(options, ps)) return false;
+	analysisFreq = options.analysisFreq;
+	if (integrator.energy().step == firstStep) printEnergy(integrator.energy(), ps);
+	return true;
+}
+
+void RunOutputs::stepDone(const ParticleSystem& ps, const NeighborList& nl, long long step)
+{
+	MD_PROFILE_SCOPE("output");
+	lastStep = firstStep + step;
+	if (integrator->energy().step == lastStep) printEnergy(integrator->energy(), ps);
+	if (analysis.active() && lastStep % analysisFreq == 0) analysis.sample(ps, nl);
+	if (trajectory && lastStep % dcdFreq == 0) trajectory->submit(ps, *integrator, lastStep);
+	if (restartFreq > 0 && lastStep % restartFreq == 0) {
+		if (writeCheckpoint(restartPath, ps, nl, lastStep)) lastRestart = lastStep;
+	}
+}
+
+// Same columns and widths as NAMD, so extract_log.py reads TS, TOTAL, TEMP, POTENTIAL and
+// PRESSURE from columns 1, 11, 12, 13 and 16. Only VDW, KINETIC and the totals are nonzero.
+// In 2D the pressure (force per length) is divided by layerThickness to give bar, and VOLUME is
+// the box area times that thickness. TEMPAVG and PRESSAVG average the ENERGY lines of the run.
+void RunOutputs::printEnergy(const EnergySample& e, const ParticleSystem& ps)
+{
+	const int dof = std::max(1, dimensions * ps.n - dimensions); // Center-of-mass motion removed
+	const double area = LW * LH;
+	const double temperature = 2.0 * e.kinetic / (dof * Kb);
+	// Virial theorem: P A = K + W / 2 in two dimensions, P V = (2 K + W) / 3 in three
+	double pressure = (e.kinetic + 0.5 * e.virial) / (area * layerThickness) / BAR;
+	double volume = area * layerThickness / (ANGSTROM * ANGSTROM * ANGSTROM);
+	if (dimensions == 3) {
+		pressure = (2.0 * e.kinetic + e.virial) / (3.0 * area * LD) / BAR;
+		volume = area * LD / (ANGSTROM * ANGSTROM * ANGSTROM);
+	}
+	const double potential = e.potential / KCAL_PER_MOL;
+	const double kinetic = e.kinetic / KCAL_PER_MOL;
+	energyLines++;
+	temperatureSum += temperature;
+	pressureSum += pressure;
+	const double temperatureAvg = temperatureSum / energyLines;
+	const double pressureAvg = pressureSum / energyLines;
+
+	// A column without a title is NAMD's five-space gap between groups
+	struct Column { const char* title; double value; };
+	const Column columns[] = {
+		{ "BOND", 0.0 }, { "ANGLE", 0.0 }, { "DIHED", 0.0 }, { "IMPRP", 0.0 }, { "", 0.0 },
+		{ "ELECT", 0.0 }, { "VDW", potential }, { "BOUNDARY", 0.0 }, { "MISC", 0.0 }, { "KINETIC", kinetic }, { "", 0.0 },
+		{ "TOTAL", potential + kinetic }, { "TEMP", temperature }, { "POTENTIAL", potential },
+		{ "TOTAL3", potential + kinetic }, { "TEMPAVG", temperatureAvg }, { "", 0.0 },
+		{ "PRESSURE", pressure }, { "GPRESSURE", pressure }, { "VOLUME", volume }, { "PRESSAVG", pressureAvg },
+		{ "GPRESSAVG", pressureAvg } };
+
+	std::ostringstream line;
+	line << std::fixed << std::setprecision(4);
+	if (energyLines % 10 == 1) {
+		line << "ETITLE:      TS";
+		for (const Column& c : columns) {
+			if (*c.title == 0) line << "     ";
+			else line << std::setw(15) << c.title;
+		}
+		line << "\n\n";
+	}
+	line << "ENERGY: " << std::setw(7) << e.step;
+	for (const Column& c : columns) {
+		if (*c.title == 0) line << "     ";
+		else line << std::setw(15) << c.value;
+	}
+	line << "\n\n";
+	std::cout << line.str() << std::flush;
+}
+
+void RunOutputs::close(const ParticleSystem& ps, const NeighborList& nl)
+{
+	if (!restartPath.empty() && lastRestart != lastStep && integrator != nullptr && integrator->midCycle()) {
+		// Only the interactive and library runs can stop there; setup holds numsteps to whole cycles
+		std::cout << "Warning: no restart file at step " << lastStep << ", inside an r-RESPA cycle; " << restartPath;
+		if (lastRestart >= 0) std::cout << " is from step " << lastRestart << std::endl;
+		else std::cout << " was not written" << std::endl;
+	}
+	else if (!restartPath.empty() && lastRestart != lastStep) {
+		if (writeCheckpoint(restartPath, ps, nl, lastStep)) std::cout << "Info: Wrote restart file " << restartPath << " at step " << lastStep << std::endl;
+	}
+	restartPath.clear();
+	analysis.write(ps);
+	if (trajectory) trajectory->close();
+	trajectory.reset();
+}
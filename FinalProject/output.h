@@ -0,0 +1,44 @@
+// RUN OUTPUT
+// Files written while the simulation runs, driven once per step by both run loops
+
+#pragma once
+
+#include <memory>
+
+#include "analysis.h"
+#include "config.h"
+#include "dcd.h"
+#include "integrator.h"
+#include "md.h"
+#include "neighbor.h"
+
+class RunOutputs
+{
+public:
+	// Opens the files requested in options and prints the energies of the starting state;
+	// returns false (after printing why) if a file cannot be created
+	bool open(const RunOptions& options, const ParticleSystem& ps, const Integrator& integrator);
+	// Called after every completed step with the new state; step counts the steps of this run,
+	// the files are numbered from options.firstStep
+	void stepDone(const ParticleSystem& ps, const NeighborList& nl, long long step);
+	// Writes the final checkpoint and analysis files, flushes everything still queued and closes the files
+	void close(const ParticleSystem& ps, const NeighborList& nl);
+
+private:
+	// NAMD ENERGY line, with an ETITLE line before every tenth
+	void printEnergy(const EnergySample& e, const ParticleSystem& ps);
+
+	const Integrator* integrator = nullptr;
+	double layerThickness = 0.0;
+	long long energyLines = 0;
+	double temperatureSum = 0.0, pressureSum = 0.0;
+	StructureAnalysis analysis;
+	int analysisFreq = 0;
+	std::unique_ptr<TrajectoryWriter> trajectory;
+	int dcdFreq = 0;
+	std::string restartPath;
+	int restartFreq = 0;
+	long long firstStep = 0;
+	long long lastStep = 0;
+	long long lastRestart = -1;
+};
@@ -0,0 +1,78 @@
+#include "philox.h"
+#include "simd.h"
+
+void philoxLanesScalar(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, const uint32_t* keys, uint32_t k1, uint32_t* out)
+{
+	for (int l = 0; l < PHILOX_LANES; ++l) {
+		const Philox4x32 block = philox4x32(c0, c1, c2, c3, keys[l], k1);
+		for (int w = 0; w < 4; ++w) out[w * PHILOX_LANES + l] = block.v[w];
+	}
+}
+
+#ifdef MD_X86
+// Every stream sits in a 64-bit lane, so that mul_epu32 gives the full 32 x 32 bit product.
+// Only the low 32 bits of a lane are meaningful; the multiplies, xors and adds never carry
+// garbage from the high half into them, and the stores keep the low halves.
+MD_TARGET_AVX2
+void philoxLanesAVX2(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, const uint32_t* keys, uint32_t k1, uint32_t* out)
+{
+	const __m256i m0 = _mm256_set1_epi64x(0xD2511F53), m1 = _mm256_set1_epi64x(0xCD9E8D57);
+	const __m256i w0 = _mm256_set1_epi64x(0x9E3779B9), w1 = _mm256_set1_epi64x(0xBB67AE85);
+	const __m256i lowHalves = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+	for (int g = 0; g < PHILOX_LANES; g += 4) {
+		__m256i x0 = _mm256_set1_epi64x(c0), x1 = _mm256_set1_epi64x(c1);
+		__m256i x2 = _mm256_set1_epi64x(c2), x3 = _mm256_set1_epi64x(c3);
+		__m256i key0 = _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i*)(keys + g)));
+		__m256i key1 = _mm256_set1_epi64x(k1);
+		for (int round = 0; round < 10; ++round) {
+			const __m256i p0 = _mm256_mul_epu32(m0, x0), p1 = _mm256_mul_epu32(m1, x2);
+			x0 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(p1, 32), x1), key0);
+			x2 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(p0, 32), x3), key1);
+			x1 = p1;
+			x3 = p0;
+			key0 = _mm256_add_epi64(key0, w0);
+			key1 = _mm256_add_epi64(key1, w1);
+		}
+		const __m256i words[4] = { x0, x1, x2, x3 };
+		for (int w = 0; w < 4; ++w) {
+			const __m256i packed = _mm256_permutevar8x32_epi32(words[w], lowHalves);
+			_mm_storeu_si128((__m128i*)(out + w * PHILOX_LANES + g), _mm256_castsi256_si128(packed));
+		}
+	}
+}
+
+MD_TARGET_AVX512
+void philoxLanesAVX512(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, const uint32_t* keys, uint32_t k1, uint32_t* out)
+{
+	const __m512i m0 = _mm512_set1_epi64(0xD2511F53), m1 = _mm512_set1_epi64(0xCD9E8D57);
+	const __m512i w0 = _mm512_set1_epi64(0x9E3779B9), w1 = _mm512_set1_epi64(0xBB67AE85);
+	__m512i x0 = _mm512_set1_epi64(c0), x1 = _mm512_set1_epi64(c1);
+	__m512i x2 = _mm512_set1_epi64(c2), x3 = _mm512_set1_epi64(c3);
+	__m512i key0 = _mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i*)keys));
+	__m512i key1 = _mm512_set1_epi64(k1);
+	for (int round = 0; round < 10; ++round) {
+		const __m512i p0 = _mm512_mul_epu32(m0, x0), p1 = _mm512_mul_epu32(m1, x2);
+		x0 = _mm512_xor_si512(_mm512_xor_si512(_mm512_srli_epi64(p1, 32), x1), key0);
+		x2 = _mm512_xor_si512(_mm512_xor_si512(_mm512_srli_epi64(p0, 32), x3), key1);
+		x1 = p1;
+		x3 = p0;
+		key0 = _mm512_add_epi64(key0, w0);
+		key1 = _mm512_add_epi64(key1, w1);
+	}
+	_mm256_storeu_si256((__m256i*)out, _mm512_cvtepi64_epi32(x0));
+	_mm256_storeu_si256((__m256i*)(out + PHILOX_LANES), _mm512_cvtepi64_epi32(x1));
+	_mm256_storeu_si256((__m256i*)(out + 2 * PHILOX_LANES), _mm512_cvtepi64_epi32(x2));
+	_mm256_storeu_si256((__m256i*)(out + 3 * PHILOX_LANES), _mm512_cvtepi64_epi32(x3));
+}
+#else
+// Non-x86 builds only have the scalar version
+void philoxLanesAVX2(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, const uint32_t* keys, uint32_t k1, uint32_t* out)
+{
+	philoxLanesScalar(c0, c1, c2, c3, keys, k1, out);
+}
+
+void philoxLanesAVX512(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, const uint32_t* keys, uint32_t k1, uint32_t* out)
+{
+	philoxLanesScalar(c0, c1, c2, c3, keys, k1, out);
+}
+#endif
@@ -0,0 +1,47 @@
+// COUNTER-BASED RANDOM NUMBERS
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC11): every
+// draw is a pure function of a 128-bit counter and a 64-bit key, so a stream is reproducible
+// whatever order, thread or batch it is evaluated in, and needs no state to save or share.
+
+#pragma once
+
+#include <cstdint>
+
+struct Philox4x32
+{
+	uint32_t v[4];
+};
+
+inline Philox4x32 philox4x32(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t k0, uint32_t k1)
+{
+	const uint64_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+	const uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+	for (int round = 0; round < 10; ++round) {
+		const uint64_t p0 = M0 * c0, p1 = M1 * c2;
+		const uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+		const uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+		c1 = (uint32_t)p1;
+		c3 = (uint32_t)p0;
+		c0 = n0;
+		c2 = n2;
+		k0 += W0;
+		k1 += W1;
+	}
+	return Philox4x32{ { c0, c1, c2, c3 } };
+}
+
+// Uniform in (0, 1), never 0, so it can go into a logarithm
+inline double philoxUniform(uint32_t u)
+{
+	return (u + 0.5) * (1.0 / 4294967296.0);
+}
+
+// Eight streams at once, as the lanes of a replica batch: the streams share the counter and the
+// second key word and differ in the first, keys[l]. Word w of stream l goes to out[w * PHILOX_LANES + l].
+// The results are the same as philox4x32 lane by lane.
+const int PHILOX_LANES = 8;
+typedef void (*PhiloxLanes)(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, const uint32_t* keys, uint32_t k1, uint32_t* out);
+
+void philoxLanesScalar(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, const uint32_t* keys, uint32_t k1, uint32_t* out);
+void philoxLanesAVX2(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, const uint32_t* keys, uint32_t k1, uint32_t* out);
+void philoxLanesAVX512(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, const uint32_t* keys, uint32_t k1, uint32_t* out);
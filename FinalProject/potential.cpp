@@ -0,0 +1,639 @@
+#include "potential.h"
+#include "config.h"
+#include "md.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+static const double ANGSTROM = 1e-10;
+static const double KCAL_PER_MOL = 4184.0 / 6.02214076e23; // J per pair
+
+double LennardJones::energy(double r) const
+{
+	double q6 = std::pow(rmin / r, 6);
+	return eps * (q6 * q6 - 2.0 * q6);
+}
+
+double LennardJones::force(double r) const
+{
+	double q6 = std::pow(rmin / r, 6);
+	return 12.0 * eps * (q6 * q6 - q6) / r;
+}
+
+CutoffPotential::CutoffPotential(const PairPotential& base, CutoffScheme scheme, double ron, double roff)
+	: base(base), scheme(scheme), ron(std::min(ron, roff)), roff(roff), shift(0.0)
+{
+	if (scheme == CutoffScheme::Shift) shift = base.energy(roff);
+	// Below ron the force is unswitched, so the energy is V(r) plus a constant that joins it
+	// continuously to the integral of the switched force
+	if (scheme == CutoffScheme::ForceSwitch) shift = switchedForceIntegral(this->ron) - base.energy(this->ron);
+}
+
+// CHARMM switching function, S = (roff^2 - r^2)^2 (roff^2 + 2 r^2 - 3 ron^2) / (roff^2 - ron^2)^3
+double CutoffPotential::switchValue(double r) const
+{
+	if (r <= ron) return 1.0;
+	if (r >= roff) return 0.0;
+	double a = roff * roff, b = ron * ron, x = r * r;
+	return (a - x) * (a - x) * (a + 2.0 * x - 3.0 * b) / ((a - b) * (a - b) * (a - b));
+}
+
+double CutoffPotential::switchSlope(double r) const
+{
+	if (r <= ron || r >= roff) return 0.0;
+	double a = roff * roff, b = ron * ron, x = r * r;
+	return 2.0 * r * 6.0 * (a - x) * (b - x) / ((a - b) * (a - b) * (a - b));
+}
+
+double CutoffPotential::switchedForceIntegral(double r) const
+{
+	// Composite Simpson rule; the integrand is smooth between ron and roff
+	const int n = 64;
+	double h = (roff - r) / n;
+	if (h <= 0.0) return 0.0;
+	double sum = 0.0;
+	for (int k = 0; k <= n; ++k) {
+		double u = r + k * h;
+		double w = k == 0 || k == n ? 1.0 : (k % 2 == 1 ? 4.0 : 2.0);
+		sum += w * base.force(u) * switchValue(u);
+	}
+	return sum * h / 3.0;
+}
+
+double CutoffPotential::energy(double r) const
+{
+	if (r >= roff) return 0.0;
+	switch (scheme) {
+	case CutoffScheme::Truncate: return base.energy(r);
+	case CutoffScheme::Shift: return base.energy(r) - shift;
+	case CutoffScheme::Switch: return base.energy(r) * switchValue(r);
+	case CutoffScheme::ForceSwitch: return r < ron ? base.energy(r) + shift : switchedForceIntegral(r);
+	}
+	return 0.0;
+}
+
+double CutoffPotential::force(double r) const
+{
+	if (r >= roff) return 0.0;
+	switch (scheme) {
+	case CutoffScheme::Truncate:
+	case CutoffScheme::Shift: return base.force(r);
+	case CutoffScheme::Switch: return base.force(r) * switchValue(r) - base.energy(r) * switchSlope(r);
+	case CutoffScheme::ForceSwitch: return base.force(r) * switchValue(r);
+	}
+	return 0.0;
+}
+
+double SplitPotential::energy(double r) const
+{
+	double x = std::min(1.0, std::max(0.0, (r - (rSplit - width)) / width));
+	double S = 1.0 - x * x * (3.0 - 2.0 * x);
+	return base.energy(r) * (inner ? S : 1.0 - S);
+}
+
+double SplitPotential::force(double r) const
+{
+	double x = std::min(1.0, std::max(0.0, (r - (rSplit - width)) / width));
+	double S = 1.0 - x * x * (3.0 - 2.0 * x);
+	double slope = -6.0 * x * (1.0 - x) / width;
+	double innerForce = base.force(r) * S - base.energy(r) * slope;
+	return inner ? innerForce : base.force(r) - innerForce;
+}
+
+// CHARMM parameter files
+
+static std::string upper(std::string text)
+{
+	for (char& c : text) c = (char)std::toupper((unsigned char)c);
+	return text;
+}
+
+static bool isSectionKeyword(const std::string& word)
+{
+	static const char* keywords[] = { "ATOMS", "BONDS", "BOND", "ANGLES", "ANGL", "THETAS", "THETA", "DIHEDRALS",
+		"DIHE", "PHI", "IMPROPER", "IMPR", "IMPHI", "CMAP", "NONBONDED", "NONB", "NBONDED", "NBFIX", "HBOND", "END", "RETURN" };
+	for (const char* k : keywords) {
+		if (word == k) return true;
+	}
+	return false;
+}
+
+static bool parseNumber(const std::string& text, double& value)
+{
+	char* end;
+	value = std::strtod(text.c_str(), &end);
+	return !text.empty() && *end == '\0';
+}
+
+bool ForceField::load(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file) {
+		std::cout << "ERROR: cannot open parameter file " << path << std::endl;
+		return false;
+	}
+
+	std::string section;
+	std::string line, pending;
+	int lineNumber = 0;
+	int typesRead = 0;
+	bool nonbondedOptions = false;
+	while (std::getline(file, line)) {
+		lineNumber++;
+		line = line.substr(0, line.find('!'));
+		line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+		// Title lines of the card format
+		if (!line.empty() && line[0] == '*') continue;
+		// A trailing '-' continues the command on the next line
+		size_t last = line.find_last_not_of(" \t");
+		if (last != std::string::npos && line[last] == '-' && (last == 0 || std::isspace((unsigned char)line[last - 1]))) {
+			pending += line.substr(0, last) + " ";
+			continue;
+		}
+		line = pending + line;
+		pending.clear();
+
+		std::istringstream stream(line);
+		std::vector<std::string> words;
+		std::string word;
+		while (stream >> word) words.push_back(word);
+		if (words.empty()) continue;
+
+		std::string first = upper(words[0]);
+		if (isSectionKeyword(first)) {
+			section = first.substr(0, 4);
+			if (section == "NBON") section = "NONB";
+			nonbondedOptions = section == "NONB";
+			if (section == "END" || section == "RETU") break;
+			if (!nonbondedOptions) continue;
+		}
+
+		if (section == "NONB" && nonbondedOptions) {
+			// NONBONDED nbxmod 5 atom cdiel shift vatom vdistance vswitch cutnb 14.0 ctofnb 12.0 ctonnb 10.0 ...
+			for (size_t k = 1; k < words.size(); ++k) {
+				std::string option = upper(words[k]);
+				double value;
+				bool hasValue = k + 1 < words.size() && parseNumber(words[k + 1], value);
+				if (option == "CUTNB" && hasValue) cutnb = value * ANGSTROM;
+				else if (option == "CTOFNB" && hasValue) ctofnb = value * ANGSTROM;
+				else if (option == "CTONNB" && hasValue) ctonnb = value * ANGSTROM;
+				else if (option == "VSWITCH" || option == "VSWI") scheme = CutoffScheme::Switch;
+				else if (option == "VFSWITCH" || option == "VFSW") scheme = CutoffScheme::ForceSwitch;
+				else if (option == "VSHIFT" || option == "VSHI") scheme = CutoffScheme::Shift;
+			}
+			nonbondedOptions = false;
+			continue;
+		}
+
+		if (section == "NONB") {
+			// atom  ignored  epsilon  Rmin/2  [ignored  eps,1-4  Rmin/2,1-4]
+			double eps, rminHalf;
+			if (words.size() < 4 || !parseNumber(words[2], eps) || !parseNumber(words[3], rminHalf)) {
+				std::cout << "ERROR: " << path << ":" << lineNumber << ": expected \"type ignored epsilon Rmin/2\"" << std::endl;
+				return false;
+			}
+			AtomType type = { upper(words[0]), std::abs(eps) * KCAL_PER_MOL, rminHalf * ANGSTROM };
+			int existing = typeIndex(type.name);
+			if (existing >= 0) types[existing] = type;
+			else types.push_back(type);
+			typesRead++;
+		}
+		else if (section == "NBFI") {
+			// type1  type2  Emin  Rmin  [Emin,1-4  Rmin,1-4]
+			double emin, rmin;
+			if (words.size() < 4 || !parseNumber(words[2], emin) || !parseNumber(words[3], rmin)) {
+				std::cout << "ERROR: " << path << ":" << lineNumber << ": expected \"type1 type2 Emin Rmin\"" << std::endl;
+				return false;
+			}
+			int i = typeIndex(upper(words[0]));
+			int j = typeIndex(upper(words[1]));
+			if (i < 0 || j < 0) {
+				std::cout << "Warning: " << path << ":" << lineNumber << ": NBFIX for unknown type ignored" << std::endl;
+				continue;
+			}
+			fixes.push_back({ i, j, std::abs(emin) * KCAL_PER_MOL, rmin * ANGSTROM });
+		}
+	}
+	if (typesRead == 0) {
+		std::cout << "ERROR: " << path << " has no NONBONDED atom types" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int ForceField::typeIndex(const std::string& name) const
+{
+	std::string key = upper(name);
+	for (size_t t = 0; t < types.size(); ++t) {
+		if (types[t].name == key) return (int)t;
+	}
+	return -1;
+}
+
+void ForceField::pairParameters(int i, int j, double& epsilon, double& rmin) const
+{
+	epsilon = std::sqrt(types[i].epsilon * types[j].epsilon);
+	rmin = types[i].rminHalf + types[j].rminHalf;
+	for (const PairFix& fix : fixes) {
+		if ((fix.i == i && fix.j == j) || (fix.i == j && fix.j == i)) {
+			epsilon = fix.epsilon;
+			rmin = fix.rmin;
+		}
+	}
+}
+
+// Spline tables
+
+// Quintic through p, its first derivative d and second derivative a at t = 0 and t = 1, in powers of t
+static void fitQuintic(double p0, double d0, double a0, double p1, double d1, double a1, double* c)
+{
+	const double dp = p1 - p0;
+	c[0] = p0;
+	c[1] = d0;
+	c[2] = 0.5 * a0;
+	c[3] = 10.0 * dp - 6.0 * d0 - 4.0 * d1 - 1.5 * a0 + 0.5 * a1;
+	c[4] = -15.0 * dp + 8.0 * d0 + 7.0 * d1 + 1.5 * a0 - a1;
+	c[5] = 6.0 * dp - 3.0 * d0 - 3.0 * d1 - 0.5 * a0 + 0.5 * a1;
+}
+
+void PairTable::build(const std::vector<const PairPotential*>& potentials, const std::vector<double>& rMin, int typeCount,
+	double rCut, int intervalCount)
+{
+	types = typeCount;
+	intervals = intervalCount;
+	rCut2 = rCut * rCut;
+	s0.assign(types * types, 0.0);
+	invDs.assign(types * types, 0.0);
+	force.assign((size_t)types * types * FORCE_TERMS * intervals, 0.0);
+	energy.assign((size_t)types * types * ENERGY_TERMS * intervals, 0.0);
+
+	std::vector<double> u(intervals + 1), du(intervals + 1), d2u(intervals + 1);
+	// The last node sits on the cutoff; sample it just inside, where the potential still applies
+	const double rInside = std::nextafter(rCut, 0.0);
+	for (int p = 0; p < types * types; ++p) {
+		const PairPotential& v = *potentials[p];
+		s0[p] = rMin[p] * rMin[p];
+		const double ds = (rCut2 - s0[p]) / intervals;
+		invDs[p] = 1.0 / ds;
+		// V, dV/ds = -g/2 and d2V/ds2 = -(dg/ds)/2 at every node, g = F/r. Only the last derivative
+		// is numerical, by fourth-order differences a fraction of an interval wide; backwards at the
+		// cutoff, where every scheme but truncation is zero anyway and the force may jump.
+		const double h = ds / 8.0;
+		auto g = [&](double s) {
+			const double r = std::min(std::sqrt(s), rInside);
+			return v.force(r) / r;
+		};
+		for (int k = 0; k <= intervals; ++k) {
+			const double s = s0[p] + k * ds;
+			double slope;
+			if (k < intervals) slope = (8.0 * (g(s + h) - g(s - h)) - g(s + 2.0 * h) + g(s - 2.0 * h)) / (12.0 * h);
+			else {
+				slope = (25.0 * g(s) - 48.0 * g(s - h) + 36.0 * g(s - 2.0 * h) - 16.0 * g(s - 3.0 * h)
+					+ 3.0 * g(s - 4.0 * h)) / (12.0 * h);
+			}
+			u[k] = v.energy(std::min(std::sqrt(s), rInside));
+			du[k] = -0.5 * g(s);
+			d2u[k] = -0.5 * slope;
+		}
+		// One C2 spline of V per pair; the force table is its derivative, F/r = -2 dV/ds, so the
+		// force is C1 and exactly minus the gradient of the tabulated energy
+		double* f = force.data() + (size_t)p * FORCE_TERMS * intervals;
+		double* e = energy.data() + (size_t)p * ENERGY_TERMS * intervals;
+		for (int k = 0; k < intervals; ++k) {
+			double* c = e + ENERGY_TERMS * k;
+			fitQuintic(u[k], du[k] * ds, d2u[k] * ds * ds, u[k + 1], du[k + 1] * ds, d2u[k + 1] * ds * ds, c);
+			for (int q = 0; q < FORCE_TERMS; ++q) f[FORCE_TERMS * k + q] = -2.0 * invDs[p] * (q + 1) * c[q + 1];
+		}
+	}
+}
+
+// Interval and local t of s, from s0 up; shorter distances are the wall's
+static inline int tableInterval(double s, double s0, double invDs, int intervals, double& t)
+{
+	double u = (s - s0) * invDs;
+	int k = std::min((int)u, intervals - 1);
+	t = u - k;
+	return k;
+}
+
+static inline double forcePolynomial(const double* c, double t)
+{
+	return c[0] + t * (c[1] + t * (c[2] + t * (c[3] + t * c[4])));
+}
+
+static inline double energyPolynomial(const double* c, double t)
+{
+	return c[0] + t * (c[1] + t * (c[2] + t * (c[3] + t * (c[4] + t * c[5]))));
+}
+
+// Below s0 the pair gets the r^-12 core of Lennard-Jones, matched to the F/r (g0) and energy
+// (v0) of the table at s0, so overlapping atoms are pushed apart ever harder instead of feeling
+// a force that vanishes with r: F/r = g0 (s0/s)^7 and V = v0 + g0 s0 ((s0/s)^6 - 1) / 12.
+// q is s0 / s.
+static inline double wallForce(double g0, double q)
+{
+	const double q3 = q * q * q;
+	return g0 * q3 * q3 * q;
+}
+
+static inline double wallEnergy(double g0, double v0, double s0, double q)
+{
+	const double q3 = q * q * q;
+	return v0 + g0 * s0 * (q3 * q3 - 1.0) / 12.0;
+}
+
+double PairTable::evalForce(int ti, int tj, double r2) const
+{
+	if (r2 >= rCut2) return 0.0;
+	int p = pair(ti, tj);
+	if (r2 < s0[p]) return wallForce(forceTable(p)[0], s0[p] / r2);
+	double t;
+	const int k = tableInterval(r2, s0[p], invDs[p], intervals, t);
+	return forcePolynomial(forceTable(p) + FORCE_TERMS * k, t);
+}
+
+double PairTable::evalEnergy(int ti, int tj, double r2) const
+{
+	if (r2 >= rCut2) return 0.0;
+	int p = pair(ti, tj);
+	if (r2 < s0[p]) return wallEnergy(forceTable(p)[0], energyTable(p)[0], s0[p], s0[p] / r2);
+	double t;
+	const int k = tableInterval(r2, s0[p], invDs[p], intervals, t);
+	return energyPolynomial(energyTable(p) + ENERGY_TERMS * k, t);
+}
+
+double PairTable::maxForceError(int ti, int tj, const PairPotential& potential, double rFrom) const
+{
+	const int samples = 20000;
+	const double rCut = std::sqrt(rCut2);
+	double peak = 0.0, worst = 0.0;
+	for (int k = 0; k < samples; ++k) {
+		double r = rFrom + (rCut - rFrom) * (k + 0.5) / samples;
+		double exact = potential.force(r);
+		peak = std::max(peak, std::abs(exact));
+		worst = std::max(worst, std::abs(evalForce(ti, tj, r * r) * r - exact));
+	}
+	return peak > 0.0 ? worst / peak : 0.0;
+}
+
+template <int D, bool Energy>
+static void pairTableLoop(const PairTable& table, const double* const* r, const int* type,
+	const int* offsets, const int* neighbors, int iBegin, int iEnd, const double* L, double* const* f, PairSums* sums)
+{
+	double energy = 0.0, virial = 0.0;
+	double half[D];
+	for (int d = 0; d < D; ++d) half[d] = 0.5 * L[d];
+	const double rCut2 = table.rCut2;
+	const double* s0 = table.s0.data();
+	const double* invDs = table.invDs.data();
+	const int last = table.intervals - 1;
+	for (int i = iBegin; i < iEnd; ++i) {
+		double ri[D], fi[D];
+		for (int d = 0; d < D; ++d) {
+			ri[d] = r[d][i];
+			fi[d] = 0.0;
+		}
+		const int row = type[i] * table.types;
+		for (int k = offsets[i]; k < offsets[i + 1]; ++k) {
+			int j = neighbors[k];
+			double dr[D];
+			double d2 = 0.0;
+			for (int d = 0; d < D; ++d) {
+				dr[d] = r[d][j] - ri[d];
+				// Both positions are wrapped into the box, so one image shift is enough and
+				// cheaper than std::round, which is a library call without SSE4.1
+				if (dr[d] > half[d]) dr[d] -= L[d];
+				else if (dr[d] < -half[d]) dr[d] += L[d];
+				d2 += dr[d] * dr[d];
+			}
+			if (d2 >= rCut2) continue;
+			const int p = row + type[j];
+			const double* c = table.forceTable(p);
+			// F/r, positive = repulsive, so the force on i points away from j
+			double g;
+			if (d2 >= s0[p]) {
+				double u = (d2 - s0[p]) * invDs[p];
+				int interval = std::min((int)u, last);
+				double t = u - interval;
+				g = forcePolynomial(c + PairTable::FORCE_TERMS * interval, t);
+				if (Energy) energy += energyPolynomial(table.energyTable(p) + PairTable::ENERGY_TERMS * interval, t);
+			}
+			else {
+				const double q = s0[p] / d2;
+				g = wallForce(c[0], q);
+				if (Energy) energy += wallEnergy(c[0], table.energyTable(p)[0], s0[p], q);
+			}
+			for (int d = 0; d < D; ++d) {
+				fi[d] -= g * dr[d];
+				f[d][j] += g * dr[d];
+			}
+			if (Energy) virial += g * d2;
+		}
+		for (int d = 0; d < D; ++d) f[d][i] += fi[d];
+	}
+	if (Energy) {
+		sums->energy += energy;
+		sums->virial += virial;
+	}
+}
+
+void pairForceTable(const PairTable& table, const double* x, const double* y, const int* type,
+	const int* offsets, const int* neighbors, int iBegin, int iEnd, double boxW, double boxH, double* fx, double* fy,
+	PairSums* sums)
+{
+	const double* r[2] = { x, y };
+	const double L[2] = { boxW, boxH };
+	double* f[2] = { fx, fy };
+	if (sums != nullptr) pairTableLoop<2, true>(table, r, type, offsets, neighbors, iBegin, iEnd, L, f, sums);
+	else pairTableLoop<2, false>(table, r, type, offsets, neighbors, iBegin, iEnd, L, f, nullptr);
+}
+
+void pairForceTable(const PairTable& table, const double* x, const double* y, const double* z, const int* type,
+	const int* offsets, const int* neighbors, int iBegin, int iEnd, double boxW, double boxH, double boxD, double* fx,
+	double* fy, double* fz, PairSums* sums)
+{
+	const double* r[3] = { x, y, z };
+	const double L[3] = { boxW, boxH, boxD };
+	double* f[3] = { fx, fy, fz };
+	if (sums != nullptr) pairTableLoop<3, true>(table, r, type, offsets, neighbors, iBegin, iEnd, L, f, sums);
+	else pairTableLoop<3, false>(table, r, type, offsets, neighbors, iBegin, iEnd, L, f, nullptr);
+}
+
+// Potentials behind pairTable, kept for the tables derived from it by buildSplitTables
+static std::vector<std::unique_ptr<PairPotential>> owned;
+static std::vector<const PairPotential*> tabulated;
+static std::vector<double> tabulatedStarts, tabulatedRmin;
+
+bool setupForceField(const ForceField& ff, CutoffScheme scheme, double ron, double roff, int intervals, std::ostream& out)
+{
+	static PairTable table;
+	const int n = (int)ff.types.size();
+	if (n == 0) {
+		out << "ERROR: no atom types to build a pair table from" << std::endl;
+		return false;
+	}
+	if (intervals < 16) {
+		out << "ERROR: tableintervals must be at least 16" << std::endl;
+		return false;
+	}
+
+	owned.clear();
+	std::vector<const PairPotential*> potentials(n * n);
+	std::vector<double> rmins(n * n), starts(n * n);
+	for (int i = 0; i < n; ++i) {
+		for (int j = 0; j < n; ++j) {
+			double eps, rmin;
+			ff.pairParameters(i, j, eps, rmin);
+			owned.emplace_back(new LennardJones(eps, rmin));
+			const PairPotential& lj = *owned.back();
+			owned.emplace_back(new CutoffPotential(lj, scheme, ron, roff));
+			potentials[i * n + j] = owned.back().get();
+			rmins[i * n + j] = rmin;
+			// Far enough inside the repulsive wall that no thermal collision gets there
+			starts[i * n + j] = std::min(0.6 * rmin, 0.5 * roff);
+		}
+	}
+	table.build(potentials, starts, n, roff, intervals);
+	table.names.clear();
+	for (const AtomType& type : ff.types) table.names.push_back(type.name);
+	tabulated = potentials;
+	tabulatedStarts = starts;
+	tabulatedRmin = rmins;
+
+	static const char* schemeNames[] = { "truncated", "shifted", "switched", "force-switched" };
+	out << "Info: PAIR TABLE               " << n << " types (";
+	for (int i = 0; i < n; ++i) out << (i > 0 ? " " : "") << ff.types[i].name;
+	out << "), " << intervals << " intervals in r^2 up to " << roff / ANGSTROM << " A, " << schemeNames[(int)scheme];
+	if (scheme == CutoffScheme::Switch || scheme == CutoffScheme::ForceSwitch) out << " from " << ron / ANGSTROM << " A";
+	out << ", " << table.force.size() * sizeof(double) / 1024 << " KiB of forces" << std::endl;
+	double worst = 0.0;
+	for (int i = 0; i < n; ++i) {
+		for (int j = i; j < n; ++j) {
+			// Accuracy where the pair is bound or weakly repulsive; closer is never sampled
+			worst = std::max(worst, table.maxForceError(i, j, *potentials[i * n + j], 0.85 * rmins[i * n + j]));
+		}
+	}
+	out << "Info: PAIR TABLE FORCE ERROR   " << worst << " of the peak force beyond 0.85 Rmin" << std::endl;
+	pairTable = &table;
+	return true;
+}
+
+bool buildInnerTable(double rSplit, double width, int intervals, PairTable& inner, std::ostream& out)
+{
+	// Without a parameter file, the truncated and shifted Lennard-Jones potential of the kernels
+	LennardJones lj(epsilon, std::pow(2.0, 1.0 / 6.0) * sigma);
+	CutoffPotential shifted(lj, CutoffScheme::Shift, rCut, rCut);
+	std::vector<const PairPotential*> full = { &shifted };
+	std::vector<double> rmins = { std::pow(2.0, 1.0 / 6.0) * sigma };
+	std::vector<double> starts = { 0.6 * rmins[0] };
+	double roff = rCut;
+	if (pairTable != nullptr) {
+		full = tabulated;
+		starts = tabulatedStarts;
+		rmins = tabulatedRmin;
+		roff = std::sqrt(pairTable->rCut2);
+	}
+	if (width <= 0.0 || width >= rSplit || rSplit >= roff) {
+		out << "ERROR: the r-RESPA split needs 0 < respawidth < respasplit < cutoff" << std::endl;
+		return false;
+	}
+
+	const int n = (int)std::lround(std::sqrt((double)full.size()));
+	std::vector<std::unique_ptr<PairPotential>> parts;
+	std::vector<const PairPotential*> innerParts;
+	for (const PairPotential* v : full) {
+		parts.emplace_back(new SplitPotential(*v, true, rSplit, width));
+		innerParts.push_back(parts.back().get());
+	}
+	for (double& s : starts) s = std::min(s, 0.5 * rSplit);
+	inner.build(innerParts, starts, n, rSplit, intervals);
+
+	double worst = 0.0;
+	for (int i = 0; i < n; ++i) {
+		for (int j = i; j < n; ++j) {
+			const int p = i * n + j;
+			worst = std::max(worst, inner.maxForceError(i, j, *innerParts[p], 0.85 * rmins[p]));
+		}
+	}
+	out << "Info: RESPA INNER TABLE        " << (rSplit - width) / ANGSTROM << " to " << rSplit / ANGSTROM
+		<< " A, " << inner.force.size() * sizeof(double) / 1024 << " KiB, force error " << worst << " of the peak force" << std::endl;
+	return true;
+}
+
+bool loadForceField(RunOptions& options, ParticleSystem& ps)
+{
+	if (options.parameterFiles.empty()) {
+		if (!options.typeNames.empty()) {
+			std::cout << "ERROR: types needs a parameters file" << std::endl;
+			return false;
+		}
+		return true;
+	}
+	ForceField ff;
+	for (const std::string& path : options.parameterFiles) {
+		if (!ff.load(path)) return false;
+	}
+
+	CutoffScheme scheme = ff.scheme;
+	if (options.switching == 0) scheme = CutoffScheme::Truncate;
+	else if (options.forceSwitching == 1) scheme = CutoffScheme::ForceSwitch;
+	else if (options.switching == 1 && scheme != CutoffScheme::ForceSwitch) scheme = CutoffScheme::Switch;
+	if (!options.cutoffGiven && ff.ctofnb > 0.0) rCut = ff.ctofnb;
+	double ron = options.switchDist > 0.0 ? options.switchDist : (ff.ctonnb > 0.0 ? ff.ctonnb : rCut);
+	if ((scheme == CutoffScheme::Switch || scheme == CutoffScheme::ForceSwitch) && ron >= rCut) {
+		std::cout << "ERROR: switchdist " << ron / ANGSTROM << " must be below the cutoff " << rCut / ANGSTROM << std::endl;
+		return false;
+	}
+	if (options.pairlistDist > 0.0) {
+		if (options.pairlistDist <= rCut) {
+			std::cout << "ERROR: pairlistdist must be larger than the cutoff" << std::endl;
+			return false;
+		}
+		options.skin = options.pairlistDist - rCut;
+	}
+
+	// Only the types present get a table; they are renumbered in order of appearance
+	std::vector<std::string> names = options.typeNames;
+	if (names.empty()) {
+		names.push_back(ff.types[0].name);
+		if (ff.types.size() > 1) std::cout << "Warning: no types given, every particle is " << ff.types[0].name << std::endl;
+	}
+	ForceField used;
+	std::vector<int> original, typeOf;
+	// Coordinate files give one name per atom, mostly repeats of the previous one
+	std::string lastName;
+	for (const std::string& name : names) {
+		if (!typeOf.empty() && name == lastName) {
+			typeOf.push_back(typeOf.back());
+			continue;
+		}
+		lastName = name;
+		int t = ff.typeIndex(name);
+		if (t < 0) {
+			std::cout << "ERROR: atom type " << name << " is not in the parameter files" << std::endl;
+			return false;
+		}
+		int compact = used.typeIndex(ff.types[t].name);
+		if (compact < 0) {
+			compact = (int)used.types.size();
+			used.types.push_back(ff.types[t]);
+			original.push_back(t);
+		}
+		typeOf.push_back(compact);
+	}
+	for (const ForceField::PairFix& fix : ff.fixes) {
+		int i = (int)(std::find(original.begin(), original.end(), fix.i) - original.begin());
+		int j = (int)(std::find(original.begin(), original.end(), fix.j) - original.begin());
+		if (i < (int)original.size() && j < (int)original.size()) used.fixes.push_back({ i, j, fix.epsilon, fix.rmin });
+	}
+	// By input index, as a checkpoint may hold the particles in their sorted order
+	for (int i = 0; i < ps.n; ++i) ps.type[i] = typeOf[ps.id[i] % typeOf.size()];
+
+	return setupForceField(used, scheme, ron, rCut, options.tableIntervals, std::cout);
+}
@@ -0,0 +1,170 @@
+// PAIR POTENTIALS
+// Multi-species nonbonded parameters read from CHARMM parameter files, and the spline tables
+// in r^2 that the force loop evaluates instead of the potential itself
+
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ljkernel.h"
+
+struct ParticleSystem;
+struct RunOptions;
+
+// A radial pair potential in SI units. Only the table builder calls it, so it may be as
+// expensive as it likes: switching functions, numerical integrals or any exotic form all
+// cost the same in the force loop.
+class PairPotential
+{
+public:
+	virtual ~PairPotential() {}
+	virtual double energy(double r) const = 0; // J
+	virtual double force(double r) const = 0;  // -dV/dr (N), positive = repulsive
+};
+
+// CHARMM form, V = eps * ((rmin / r)^12 - 2 (rmin / r)^6), with eps > 0 the well depth
+class LennardJones : public PairPotential
+{
+public:
+	LennardJones(double eps, double rmin) : eps(eps), rmin(rmin) {}
+	double energy(double r) const override;
+	double force(double r) const override;
+
+private:
+	double eps, rmin;
+};
+
+// How a potential is brought to zero at the cutoff roff
+enum class CutoffScheme
+{
+	Truncate,    // V for r < roff, nothing beyond
+	Shift,       // V(r) - V(roff), as the built-in LJ kernels
+	Switch,      // CHARMM vswitch: V(r) S(r) with the switching function S between ron and roff
+	ForceSwitch  // CHARMM vfswitch: F(r) S(r), energy integrated back from roff
+};
+
+class CutoffPotential : public PairPotential
+{
+public:
+	CutoffPotential(const PairPotential& base, CutoffScheme scheme, double ron, double roff);
+	double energy(double r) const override;
+	double force(double r) const override;
+
+private:
+	double switchValue(double r) const;
+	double switchSlope(double r) const;
+	// Integral of the switched force from r to roff, for ron <= r <= roff
+	double switchedForceIntegral(double r) const;
+
+	const PairPotential& base;
+	CutoffScheme scheme;
+	double ron, roff;
+	double shift; // V(roff) for Shift, energy offset below ron for ForceSwitch
+};
+
+// Part of a potential for multiple time stepping: V S(r) (inner) or V (1 - S(r)) (outer), where S
+// falls smoothly from 1 to 0 between rSplit - width and rSplit. The parts add up to the potential,
+// forces included, and the inner part is zero beyond rSplit.
+class SplitPotential : public PairPotential
+{
+public:
+	SplitPotential(const PairPotential& base, bool inner, double rSplit, double width)
+		: base(base), inner(inner), rSplit(rSplit), width(width) {}
+	double energy(double r) const override;
+	double force(double r) const override;
+
+private:
+	const PairPotential& base;
+	bool inner;
+	double rSplit, width;
+};
+
+// Nonbonded parameters of one atom type, from the NONBONDED section of a CHARMM file
+struct AtomType
+{
+	std::string name;
+	double epsilon;  // Well depth (J), stored positive
+	double rminHalf; // Rmin/2 (m)
+};
+
+// Atom types and cutoff settings of one or more CHARMM parameter files (.prm, .inp, .str).
+// Pair parameters follow the CHARMM (Lorentz-Berthelot) rules, eps_ij = sqrt(eps_i eps_j) and
+// Rmin_ij = Rmin/2_i + Rmin/2_j, unless an NBFIX line overrides the pair.
+struct ForceField
+{
+	std::vector<AtomType> types;
+	// NBFIX override of one type pair, rmin is the full Rmin_ij (m)
+	struct PairFix { int i, j; double epsilon, rmin; };
+	std::vector<PairFix> fixes;
+
+	// Settings from the NONBONDED header line, in m; 0 when the file does not give them
+	double ctonnb = 0.0, ctofnb = 0.0, cutnb = 0.0;
+	CutoffScheme scheme = CutoffScheme::Switch;
+
+	// Adds the types of a parameter file; a type read again replaces the earlier one, as
+	// with several "parameters" lines in NAMD. Prints the reason and returns false on error.
+	bool load(const std::string& path);
+	int typeIndex(const std::string& name) const; // -1 if unknown
+	void pairParameters(int i, int j, double& epsilon, double& rmin) const;
+};
+
+// Per type-pair quintic Hermite spline of V over s = r^2, uniform in s from (0.6 Rmin_ij)^2 to
+// rCut^2, matching V and its first two derivatives at every node, so V is C2. F/r = -2 dV/ds is
+// kept as a table of its own, the derivative of the same quintics: the force is C1 and exactly
+// minus the gradient of the tabulated energy, which the energy drift relies on. The repulsive
+// r^-12 wall of Lennard-Jones continues the two below the table. Each interval holds the
+// coefficients in its local t in [0, 1), so a lookup is one multiply to find the interval and a
+// Horner evaluation. The table of a pair is contiguous, and only the types present in the system
+// are tabulated, so a system with a few species keeps the force tables in L1/L2.
+struct PairTable
+{
+	static const int FORCE_TERMS = 5;  // Quartic of F/r per interval
+	static const int ENERGY_TERMS = 6; // Quintic of V per interval
+
+	int types = 0;
+	int intervals = 0;
+	double rCut2 = 0.0;
+	std::vector<double> s0;     // Per pair: start of the table; shorter distances get an r^-12 wall matched to it
+	std::vector<double> invDs;  // Per pair: intervals per unit of s
+	std::vector<double> force;  // F/r (N/m), FORCE_TERMS * intervals per pair, pairs in row-major type order
+	std::vector<double> energy; // V (J), ENERGY_TERMS * intervals per pair, same order
+	std::vector<std::string> names; // Atom type of each index, empty for tables not built from a force field
+
+	// potentials[ti * types + tj] and rMin must be symmetric
+	void build(const std::vector<const PairPotential*>& potentials, const std::vector<double>& rMin, int typeCount,
+		double rCut, int intervalCount);
+	int pair(int ti, int tj) const { return ti * types + tj; }
+	const double* forceTable(int p) const { return force.data() + (size_t)p * FORCE_TERMS * intervals; }
+	const double* energyTable(int p) const { return energy.data() + (size_t)p * ENERGY_TERMS * intervals; }
+	double evalForce(int ti, int tj, double r2) const;  // F/r
+	double evalEnergy(int ti, int tj, double r2) const;
+	// Largest deviation of the force of pair (ti, tj) from the potential between rFrom and rCut,
+	// relative to the largest force in that range
+	double maxForceError(int ti, int tj, const PairPotential& potential, double rFrom) const;
+};
+
+// Force kernel over the half neighbor list, as ljkernel.h, with the per-pair potential taken
+// from the table by the types of the two particles. With sums, also adds the energy and virial.
+void pairForceTable(const PairTable& table, const double* x, const double* y, const int* type,
+	const int* offsets, const int* neighbors, int iBegin, int iEnd, double boxW, double boxH, double* fx, double* fy,
+	PairSums* sums);
+// The same in 3D
+void pairForceTable(const PairTable& table, const double* x, const double* y, const double* z, const int* type,
+	const int* offsets, const int* neighbors, int iBegin, int iEnd, double boxW, double boxH, double boxD, double* fx,
+	double* fy, double* fz, PairSums* sums);
+
+// Builds pairTable from the force field with the given cutoff scheme, prints the types and the
+// table accuracy, and makes calculateForce use it
+bool setupForceField(const ForceField& ff, CutoffScheme scheme, double ron, double roff, int intervals, std::ostream& out);
+
+// Tabulates the inner part, up to rSplit, of the potential calculateForce uses (pairTable, or
+// the built-in Lennard-Jones one without it), for r-RESPA. The outer part is the full force
+// minus this one, so it needs no table of its own.
+bool buildInnerTable(double rSplit, double width, int intervals, PairTable& inner, std::ostream& out);
+
+// Reads options.parameterFiles, settles cutoff, switching and pair-list distance the way NAMD
+// does (configuration keys over the file's NONBONDED settings), builds the table and gives the
+// particles their types from options.typeNames. Does nothing without parameter files.
+bool loadForceField(RunOptions& options, ParticleSystem& ps);
@@ -0,0 +1,266 @@
+#include "profile.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+const int MAX_PROBES = 64;
+// Trace events kept per thread; about 24 MB each, later events are counted and dropped
+const size_t MAX_EVENTS = 1 << 20;
+
+struct TraceEvent
+{
+	int probe;
+	uint64_t start; // ns
+	uint64_t value; // Duration (ns) of a timer, running total of a counter
+};
+
+// Written only by its own thread. The totals are atomics so profileSummary can read them while
+// the thread runs; single writer, so plain loads and stores are enough.
+struct ThreadProfile
+{
+	std::string name;
+	std::atomic<uint64_t> calls[MAX_PROBES] = {};
+	std::atomic<uint64_t> total[MAX_PROBES] = {};      // ns, or the count of a counter
+	std::atomic<uint64_t> intervalMax[MAX_PROBES] = {}; // ns, reset by profileSummary
+	std::atomic<uint64_t> runMax[MAX_PROBES] = {};
+	// What the previous profileSummary printed; touched only under registryMutex
+	uint64_t reportedCalls[MAX_PROBES] = {};
+	uint64_t reportedTotal[MAX_PROBES] = {};
+	std::vector<TraceEvent> events;
+	uint64_t dropped = 0;
+};
+
+struct Probe
+{
+	const char* name;
+	ProfileKind kind;
+};
+
+std::mutex registryMutex;
+Probe probes[MAX_PROBES];
+int probeCount = 0;
+// Never freed, so the totals of threads that have exited still show in the report
+std::vector<std::unique_ptr<ThreadProfile>> threads;
+bool tracing = false;
+std::string traceFile;
+const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+ThreadProfile& thisThread()
+{
+	thread_local ThreadProfile* profile = nullptr;
+	if (profile == nullptr) {
+		std::lock_guard<std::mutex> lock(registryMutex);
+		threads.emplace_back(new ThreadProfile());
+		profile = threads.back().get();
+		profile->name = "thread " + std::to_string(threads.size() - 1);
+	}
+	return *profile;
+}
+
+void add(std::atomic<uint64_t>& a, uint64_t v)
+{
+	a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
+
+void raise(std::atomic<uint64_t>& a, uint64_t v)
+{
+	if (v > a.load(std::memory_order_relaxed)) a.store(v, std::memory_order_relaxed);
+}
+
+void trace(ThreadProfile& t, int probe, uint64_t start, uint64_t value)
+{
+	if (t.events.size() < MAX_EVENTS) t.events.push_back(TraceEvent{ probe, start, value });
+	else t.dropped++;
+}
+
+#ifdef MD_PROFILE
+// Names and labels go into the JSON file as they are; escape the characters that would end a string
+std::string jsonString(const std::string& s)
+{
+	std::string quoted = "\"";
+	for (char c : s) {
+		if (c == '"' || c == '\\') quoted += '\\';
+		quoted += c;
+	}
+	return quoted + "\"";
+}
+
+bool writeTrace(const std::string& path)
+{
+	std::ofstream file(path);
+	if (!file) {
+		std::cout << "ERROR: cannot write trace file " << path << std::endl;
+		return false;
+	}
+	// Microseconds with nanosecond resolution, as the format expects
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" << std::endl;
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"md\"}}";
+	size_t written = 0;
+	for (size_t tid = 0; tid < threads.size(); ++tid) {
+		const ThreadProfile& t = *threads[tid];
+		file << "," << std::endl << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+			<< ",\"args\":{\"name\":" << jsonString(t.name) << "}}";
+		for (const TraceEvent& e : t.events) {
+			const Probe& p = probes[e.probe];
+			file << "," << std::endl;
+			if (p.kind == ProfileTimer) {
+				file << "{\"name\":" << jsonString(p.name) << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+					<< ",\"ts\":" << e.start * 1e-3 << ",\"dur\":" << e.value * 1e-3 << "}";
+			}
+			else {
+				// Counter tracks belong to the process, so each thread gets its own
+				file << "{\"name\":" << jsonString(std::string(p.name) + " (" + t.name + ")") << ",\"ph\":\"C\",\"pid\":1,\"tid\":" << tid
+					<< ",\"ts\":" << e.start * 1e-3 << ",\"args\":{\"value\":" << e.value << "}}";
+			}
+		}
+		written += t.events.size();
+	}
+	file << std::endl << "]}" << std::endl;
+	if (!file) {
+		std::cout << "ERROR: failed writing trace file " << path << std::endl;
+		return false;
+	}
+	std::cout << "Info: PROFILE TRACE " << path << ": " << written << " events" << std::endl;
+	return true;
+}
+#endif
+
+} // namespace
+
+int profileProbe(const char* name, ProfileKind kind)
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	for (int p = 0; p < probeCount; ++p) {
+		if (probes[p].kind == kind && std::string(probes[p].name) == name) return p;
+	}
+	if (probeCount == MAX_PROBES) {
+		// Out of slots: share the last one rather than write past the tables
+		return MAX_PROBES - 1;
+	}
+	probes[probeCount] = Probe{ name, kind };
+	return probeCount++;
+}
+
+uint64_t profileNow()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void profileRecord(int probe, uint64_t start, uint64_t end)
+{
+	ThreadProfile& t = thisThread();
+	const uint64_t ns = end - start;
+	add(t.calls[probe], 1);
+	add(t.total[probe], ns);
+	raise(t.intervalMax[probe], ns);
+	raise(t.runMax[probe], ns);
+	if (tracing) trace(t, probe, start, ns);
+}
+
+void profileCount(int probe, long long n)
+{
+	ThreadProfile& t = thisThread();
+	add(t.calls[probe], 1);
+	add(t.total[probe], (uint64_t)n);
+	if (tracing) trace(t, probe, profileNow(), t.total[probe].load(std::memory_order_relaxed));
+}
+
+void profileThreadName(const std::string& name)
+{
+#ifdef MD_PROFILE
+	ThreadProfile& t = thisThread();
+	std::lock_guard<std::mutex> lock(registryMutex);
+	t.name = name;
+#else
+	(void)name;
+#endif
+}
+
+void profileStart(const std::string& file)
+{
+#ifdef MD_PROFILE
+	traceFile = file;
+	tracing = !file.empty();
+#else
+	if (!file.empty()) {
+		std::cout << "Warning: this build has no profiling (MD_PROFILE), " << file << " will not be written" << std::endl;
+	}
+#endif
+}
+
+void profileSummary(std::ostream& out, const std::string& label)
+{
+#ifdef MD_PROFILE
+	std::lock_guard<std::mutex> lock(registryMutex);
+	for (const std::unique_ptr<ThreadProfile>& t : threads) {
+		std::ostringstream line;
+		bool any = false;
+		for (int p = 0; p < probeCount; ++p) {
+			const uint64_t calls = t->calls[p].load(std::memory_order_relaxed);
+			const uint64_t total = t->total[p].load(std::memory_order_relaxed);
+			const uint64_t n = calls - t->reportedCalls[p];
+			if (n == 0) continue;
+			const uint64_t sum = total - t->reportedTotal[p];
+			t->reportedCalls[p] = calls;
+			t->reportedTotal[p] = total;
+			any = true;
+			line << "  " << probes[p].name << ": ";
+			if (probes[p].kind == ProfileTimer) {
+				const uint64_t longest = t->intervalMax[p].exchange(0, std::memory_order_relaxed);
+				line << n << " x " << sum * 1e-3 / n << " us (max " << longest * 1e-3 << ")";
+			}
+			else {
+				line << sum;
+			}
+		}
+		if (any) out << "PROFILE: " << label << "  " << t->name << line.str() << std::endl;
+	}
+#else
+	(void)out;
+	(void)label;
+#endif
+}
+
+bool profileFinish(std::ostream& out)
+{
+#ifdef MD_PROFILE
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (const std::unique_ptr<ThreadProfile>& t : threads) {
+			for (int p = 0; p < probeCount; ++p) {
+				const uint64_t calls = t->calls[p].load(std::memory_order_relaxed);
+				if (calls == 0) continue;
+				const uint64_t total = t->total[p].load(std::memory_order_relaxed);
+				out << "Info: PROFILE " << t->name << " " << probes[p].name << ": ";
+				if (probes[p].kind == ProfileTimer) {
+					out << calls << " calls, " << total * 1e-9 << " s, mean " << total * 1e-3 / calls << " us, max "
+						<< t->runMax[p].load(std::memory_order_relaxed) * 1e-3 << " us" << std::endl;
+				}
+				else {
+					out << total << " in " << calls << " updates" << std::endl;
+				}
+			}
+			if (t->dropped > 0) {
+				out << "Warning: " << t->dropped << " trace events of " << t->name << " dropped, the trace keeps "
+					<< MAX_EVENTS << " per thread" << std::endl;
+			}
+		}
+	}
+	if (!tracing) return true;
+	std::lock_guard<std::mutex> lock(registryMutex);
+	return writeTrace(traceFile);
+#else
+	(void)out;
+	return true;
+#endif
+}
@@ -0,0 +1,68 @@
+// HOT-PATH PROFILING
+// Scoped timers and counters on the force, integration, neighbor-list and render paths. They are
+// compiled in only with -DMD_PROFILE; otherwise MD_PROFILE_SCOPE and MD_PROFILE_COUNT expand to
+// nothing and the functions below only print what is missing. Every thread accumulates into its
+// own slots, so a probe costs two clock reads and no lock, and the summaries are per thread.
+// With profiletrace the individual events also go to a Chrome trace-event file
+// (chrome://tracing or ui.perfetto.dev), which shows the simulation, render and pool threads
+// on one timeline.
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+enum ProfileKind { ProfileTimer, ProfileCounter };
+
+// Index of the timer or counter called name, registered on first use. Names are string literals.
+int profileProbe(const char* name, ProfileKind kind);
+// Nanoseconds on a steady clock since the start of the program
+uint64_t profileNow();
+// Adds one call of timer probe, running from start to end
+void profileRecord(int probe, uint64_t start, uint64_t end);
+// Adds n to counter probe
+void profileCount(int probe, long long n);
+
+class ProfileScope
+{
+public:
+	explicit ProfileScope(int probe) : probe(probe), start(profileNow()) {}
+	~ProfileScope() { profileRecord(probe, start, profileNow()); }
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	int probe;
+	uint64_t start;
+};
+
+#ifdef MD_PROFILE
+#define MD_PROFILE_JOIN2(a, b) a##b
+#define MD_PROFILE_JOIN(a, b) MD_PROFILE_JOIN2(a, b)
+// Times the rest of the enclosing block as timer name
+#define MD_PROFILE_SCOPE(name) \
+	static const int MD_PROFILE_JOIN(profileProbe_, __LINE__) = profileProbe(name, ProfileTimer); \
+	ProfileScope MD_PROFILE_JOIN(profileScope_, __LINE__)(MD_PROFILE_JOIN(profileProbe_, __LINE__))
+// Adds n to counter name
+#define MD_PROFILE_COUNT(name, n) \
+	do { \
+		static const int profileCounter_ = profileProbe(name, ProfileCounter); \
+		profileCount(profileCounter_, (long long)(n)); \
+	} while (0)
+#else
+#define MD_PROFILE_SCOPE(name) ((void)0)
+#define MD_PROFILE_COUNT(name, n) ((void)0)
+#endif
+
+// Name of the calling thread in the summaries and the trace
+void profileThreadName(const std::string& name);
+// Starts recording trace events for profileFinish to write to traceFile, when not empty.
+// Call before starting any thread. Prints a warning in builds without MD_PROFILE.
+void profileStart(const std::string& traceFile);
+// One PROFILE line per thread with the timers and counters since the previous call: calls,
+// mean and longest time, and counts. label is printed after "PROFILE:" (the step, as in TIMING).
+void profileSummary(std::ostream& out, const std::string& label);
+// Totals of the whole run per thread and probe, then the trace file. Call when every thread
+// that recorded events has stopped or is idle. Returns false if the trace could not be written.
+bool profileFinish(std::ostream& out);
@@ -0,0 +1,232 @@
+# PYTHON BINDINGS OF THE MD ENGINE
+# Drives the C interface of mdapi.h through ctypes, so no compiler is needed on the Python side.
+# The particle arrays are NumPy views of the engine's own buffers: reading them copies nothing,
+# and they follow the run in place after every step(). Every view keeps its Engine alive, and
+# close() refuses while one is left, since md_destroy frees the buffers. ctypes releases the GIL
+# for every call into the library, so other Python threads keep running during step() and minimize().
+#
+# Build the library first (from FinalProject):
+#   g++ -O2 -std=c++17 -DMD_HEADLESS -fPIC -shared -fvisibility=hidden $(ls *.cpp | grep -v main.cpp) -pthread -o libmd.so
+#
+# Example:
+#   from mdengine import Engine
+#   with Engine(latticex=100, latticey=100, temperature=120, seed=7) as md:
+#       md.minimize(500)
+#       md.step(1000)
+#       print(md.energies()["temperature"], md.x[:5])
+
+import ctypes
+import gc
+import os
+import sys
+import weakref
+
+import numpy as np
+
+# Order of enum MDArray in mdapi.h
+_ARRAYS = ["x", "y", "x_old", "y_old", "ax", "ay", "vx", "vy", "fx", "fy", "z", "z_old", "az", "vz", "fz"]
+
+_lib = None
+
+
+def load_library(path=None):
+    """Loads libmd from path, $MD_LIBRARY, or the FinalProject directory above this file."""
+    global _lib
+    if _lib is not None:
+        return _lib
+    if path is None:
+        path = os.environ.get("MD_LIBRARY")
+    if path is None:
+        name = {"win32": "md.dll", "darwin": "libmd.dylib"}.get(sys.platform, "libmd.so")
+        path = os.path.join(os.path.dirname(os.path.abspath(__file__)), os.pardir, name)
+    lib = ctypes.CDLL(path)
+
+    engine = ctypes.c_void_p
+    lib.md_create.argtypes = [ctypes.c_int, ctypes.POINTER(ctypes.c_char_p)]
+    lib.md_create.restype = engine
+    lib.md_destroy.argtypes = [engine]
+    lib.md_destroy.restype = None
+    lib.md_minimize.argtypes = [engine, ctypes.c_longlong, ctypes.c_char_p, ctypes.c_double]
+    lib.md_minimize.restype = ctypes.c_int
+    lib.md_step.argtypes = [engine, ctypes.c_longlong]
+    lib.md_step.restype = ctypes.c_int
+    lib.md_count.argtypes = [engine]
+    lib.md_count.restype = ctypes.c_int
+    lib.md_array.argtypes = [engine, ctypes.c_int]
+    lib.md_array.restype = ctypes.POINTER(ctypes.c_double)
+    lib.md_ids.argtypes = [engine]
+    lib.md_ids.restype = ctypes.POINTER(ctypes.c_int)
+    lib.md_types.argtypes = [engine]
+    lib.md_types.restype = ctypes.POINTER(ctypes.c_int)
+    lib.md_step_count.argtypes = [engine]
+    lib.md_step_count.restype = ctypes.c_longlong
+    lib.md_time.argtypes = [engine]
+    lib.md_time.restype = ctypes.c_double
+    lib.md_dimensions.argtypes = [engine]
+    lib.md_dimensions.restype = ctypes.c_int
+    lib.md_box.argtypes = [engine, ctypes.POINTER(ctypes.c_double)]
+    lib.md_box.restype = None
+    lib.md_energies.argtypes = [engine, ctypes.POINTER(ctypes.c_double)]
+    lib.md_energies.restype = ctypes.c_int
+    lib.md_gofr.argtypes = [engine, ctypes.c_int, ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double)]
+    lib.md_gofr.restype = ctypes.c_int
+    _lib = lib
+    return lib
+
+
+class _Buffer:
+    """Base object of a view: n values of dtype at pointer, owned by engine, which it keeps alive."""
+
+    def __init__(self, engine, pointer, n, dtype):
+        self.engine = engine
+        address = ctypes.cast(pointer, ctypes.c_void_p).value
+        self.__array_interface__ = {"shape": (n,), "typestr": np.dtype(dtype).str, "data": (address, True), "version": 3}
+
+
+def _array_property(k, name):
+    return property(lambda self: self._view(np.float64, self._lib.md_array, k),
+                    doc="Read-only view of the engine's " + name + " array")
+
+
+class Engine:
+    """One simulation, set up from the program's options.
+
+    Positional arguments are configuration files and keyword arguments "--key value" options,
+    in that order, so Engine("run.conf", numsteps=1000, dcdfile="run.dcd") is the same as
+    ./md run.conf --numsteps 1000 --dcdfile run.dcd. Lengths are in Angstrom and the timestep
+    in fs, as on the command line. Only one Engine exists at a time.
+
+    x, y, x_old, y_old (m), ax, ay (m/s^2), vx, vy (m/s), fx, fy (N), ids and types are views
+    of the engine's arrays, with z, z_old, az, vz and fz in 3D runs (dimensions=3; None in 2D), in its current particle order; ids gives each particle's index in
+    the input, which spatial sorting (sortfreq) changes. Views are only valid until close(), so
+    keep copies (np.array(md.x)) of what is needed afterwards.
+    """
+
+    def __init__(self, *files, library=None, **options):
+        self._md = None
+        self._lib = load_library(library)
+        args = list(files)
+        for key, value in options.items():
+            if isinstance(value, bool):
+                value = "yes" if value else "no"
+            elif isinstance(value, (list, tuple)):
+                value = ",".join(str(v) for v in value)
+            args += ["--" + key, str(value)]
+        argv = (ctypes.c_char_p * len(args))(*[a.encode() for a in args])
+        # Base objects of the views handed out; they hold the engine, it holds them only weakly
+        self._buffers = weakref.WeakSet()
+        self._md = self._lib.md_create(len(args), argv)
+        if not self._md:
+            raise RuntimeError("the engine could not be set up, see the ERROR line above")
+        self.n = self._lib.md_count(self._md)
+        self.dimensions = self._lib.md_dimensions(self._md)
+
+    def _engine(self):
+        """Handle of the engine for the C calls; raises once close() has freed it."""
+        if not self._md:
+            raise RuntimeError("the engine is closed")
+        return self._md
+
+    def _view(self, dtype, function, *args):
+        """Read-only NumPy view, without a copy, of the n values at the pointer function returns,
+        or None for a null pointer (the z arrays of a 2D run)."""
+        pointer = function(self._engine(), *args)
+        if not pointer:
+            return None
+        buffer = _Buffer(self, pointer, self.n, dtype)
+        self._buffers.add(buffer)
+        return np.asarray(buffer)
+
+    @property
+    def ids(self):
+        """Read-only view of each particle's index in the input"""
+        return self._view(np.intc, self._lib.md_ids)
+
+    @property
+    def types(self):
+        """Read-only view of each particle's atom type"""
+        return self._view(np.intc, self._lib.md_types)
+
+    def close(self):
+        """Writes the final checkpoint and analysis files and frees the engine. Raises while views
+        of its arrays still exist, since they would then read freed memory."""
+        if not self._md:
+            return
+        if self._buffers:
+            # Views in reference cycles are only freed by the collector
+            gc.collect()
+        if self._buffers:
+            raise RuntimeError("%d views of the engine's arrays still exist; delete them, or keep copies "
+                               "(np.array(md.x)), before close()" % len(self._buffers))
+        self._lib.md_destroy(self._md)
+        self._md = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+    def _check(self, ok, what):
+        if not ok:
+            raise RuntimeError(what + " failed, see the ERROR line above")
+
+    def step(self, steps=1):
+        """Advances steps steps with the integrator of the options."""
+        self._check(self._lib.md_step(self._engine(), steps), "step")
+
+    def minimize(self, steps, method=None, tolerance=0.0):
+        """Relaxes the structure (fire or lbfgs, tolerance in kcal/mol/A) and draws new velocities.
+        Only before the first step."""
+        self._check(self._lib.md_minimize(self._engine(), steps, method.encode() if method else None, tolerance), "minimize")
+
+    @property
+    def positions(self):
+        """(x, y) or (x, y, z) views (m)"""
+        return (self.x, self.y, self.z)[:self.dimensions]
+
+    @property
+    def velocities(self):
+        """(vx, vy) or (vx, vy, vz) views (m/s)"""
+        return (self.vx, self.vy, self.vz)[:self.dimensions]
+
+    @property
+    def forces(self):
+        """(fx, fy) or (fx, fy, fz) views (N)"""
+        return (self.fx, self.fy, self.fz)[:self.dimensions]
+
+    @property
+    def step_count(self):
+        return self._lib.md_step_count(self._engine())
+
+    @property
+    def time(self):
+        """Simulated time of this run (ps)"""
+        return self._lib.md_time(self._engine())
+
+    @property
+    def box(self):
+        """Width, height and, in 3D, depth of the periodic box (m)"""
+        size = (ctypes.c_double * 3)()
+        self._lib.md_box(self._engine(), size)
+        return tuple(size[:self.dimensions])
+
+    def energies(self):
+        """Potential, kinetic and total energy (kcal/mol), temperature (K) and pressure (bar) now."""
+        values = (ctypes.c_double * 5)()
+        self._check(self._lib.md_energies(self._engine(), values), "energies")
+        return dict(zip(["potential", "kinetic", "total", "temperature", "pressure"], values))
+
+    def gofr(self, bins=100, rmax=0.0):
+        """g(r) of the current positions up to rmax A (0 = the cutoff): (bin centers in A, g)."""
+        g = np.zeros(bins)
+        r = ctypes.c_double(rmax)
+        self._check(self._lib.md_gofr(self._engine(), bins, ctypes.byref(r), g.ctypes.data_as(ctypes.POINTER(ctypes.c_double))), "gofr")
+        return (np.arange(bins) + 0.5) * r.value / bins, g
+
+
+for _k, _name in enumerate(_ARRAYS):
+    setattr(Engine, _name, _array_property(_k, _name))
@@ -0,0 +1,304 @@
+// REAL-TIME 2D VISUALISATION
+// Window, shaders and the render loop that draws the snapshots of the simulation thread
+
+#ifndef MD_HEADLESS
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <iostream>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "profile.h"
+#include "render.h"
+#include "simulation.h"
+
+// settings
+const unsigned int SCR_WIDTH = 450;
+const unsigned int SCR_HEIGHT = 450;
+
+// Shader source code
+// Every particle is the same unit dodecagon (location 0) moved to its own center (location 1, one per instance).
+// Centers arrive in meters; uScale maps them to normalized device coordinates.
+const char* vertexShaderSource = "#version 450 core\n"
+"layout (location = 0) in vec2 aPos;\n"
+"layout (location = 1) in vec2 aCenter;\n"
+"uniform float uScale;\n"
+"uniform float uRadius;\n"
+"void main()\n"
+"{\n"
+"   gl_Position = vec4(aCenter * uScale + aPos * uRadius, 0.0, 1.0);\n"
+"}\0";
+const char* fragmentShaderSource = "#version 450 core\n"
+"out vec4 FragColor;\n"
+"void main()\n"
+"{\n"
+"   FragColor = vec4(1.0f, 0.5f, 0.2f, 1.0f);\n"
+"}\n\0";
+
+// The instance buffer holds three frames of centers so the CPU can fill one while the GPU reads the others
+const int INSTANCE_REGIONS = 3;
+
+//Forward declarations
+void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void processInput(GLFWwindow* window);
+std::array<float, 26> unitDodecagon();
+std::array<unsigned int, 36> dodecagonIndices();
+
+int runInteractive(ParticleSystem& particles, NeighborList& neighborList, Integrator& integrator, RunOutputs& outputs,
+	const RunOptions& options)
+{
+	const int stepsPerFrame = options.stepsPerFrame;
+	const int offscreenFrames = options.offscreenFrames;
+
+	//Initialize glfw library
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	//4.5 core is enough for persistent mapping and vertex attribute bindings, and is what Mesa's llvmpipe provides
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	if (offscreenFrames > 0)
+	{
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	}
+
+	//Create a window object (pointer?) and prompt an error if it failed to do so
+	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Molecular Dynamics Real-time Simulation", NULL, NULL);
+	if (window == NULL)
+	{
+		std::cout << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+	if (offscreenFrames > 0)
+	{
+		//Do not let vsync hide the cost of the render path
+		glfwSwapInterval(0);
+	}
+
+	//Prompt error if Glad failed to initialize
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	{
+		std::cout << "Failed to initialize GLAD" << std::endl;
+		return -1;
+	}
+
+	//Define the location and size of the rendering window
+	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+	//Read modifications of the size of the 'window' (first argument) and call the defined function. in this case, the function sets the window size to the readings.
+	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+
+	int success;
+	char infoLog[512];
+	//Shaders
+	//Vertex shader
+	unsigned int vertexShader;
+	vertexShader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+	glCompileShader(vertexShader);
+	glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
+		std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+		return 0;
+	}
+	//Fragment shader
+	unsigned int fragmentShader;
+	fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
+	glCompileShader(fragmentShader);
+	glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
+		std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+		return 0;
+	}
+	//Shader program. Final linked verion of multiple shaders combined
+	unsigned int shaderProgram;
+	shaderProgram = glCreateProgram(); //Returns the ID reference to the created object
+	glAttachShader(shaderProgram, vertexShader);
+	glAttachShader(shaderProgram, fragmentShader);
+	glLinkProgram(shaderProgram);
+	glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+	if (!success) 
+	{
+		glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+		std::cout << "ERROR::SHADER::PROGRAM::COMPILATION_FAILED\n" << infoLog << std::endl;
+		return 0;
+	}
+	//Delete individual shaders as we have them now linked to the main one
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	//Geometry and vertex buffer assignation
+	//The dodecagon mesh never changes, so it is uploaded once into immutable buffers
+	std::array<float, 26> vertices = unitDodecagon();
+	std::array<unsigned int, 36> indices = dodecagonIndices();
+	unsigned int VBO, VAO, EBO, instanceVBO;
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+	glGenBuffers(1, &instanceVBO);
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferStorage(GL_ARRAY_BUFFER, sizeof(vertices), vertices.data(), 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices.data(), 0);
+	//Per-particle centers: persistently mapped, written by the CPU without any glBufferData or remapping
+	const GLsizeiptr regionBytes = 2 * sizeof(float) * particles.n;
+	const GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+	glBufferStorage(GL_ARRAY_BUFFER, INSTANCE_REGIONS * regionBytes, NULL, mapFlags);
+	char* instanceData = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, INSTANCE_REGIONS * regionBytes, mapFlags);
+	GLsync regionFence[INSTANCE_REGIONS] = { 0 };
+	//Define how opengl should interpret the vertex data. The layout is specified once; only the
+	//instance binding's offset moves between regions.
+	glVertexAttribFormat(0, 2, GL_FLOAT, GL_FALSE, 0);
+	glVertexAttribBinding(0, 0);
+	glBindVertexBuffer(0, VBO, 0, 2 * sizeof(float));
+	glEnableVertexAttribArray(0);
+	glVertexAttribFormat(1, 2, GL_FLOAT, GL_FALSE, 0);
+	glVertexAttribBinding(1, 1);
+	glVertexBindingDivisor(1, 1);
+	glBindVertexBuffer(1, instanceVBO, 0, 2 * sizeof(float));
+	glEnableVertexAttribArray(1);
+	//Also possible to unbind the VAO so we dont accidentally modify it. Its is rare though.
+	glBindVertexArray(0);
+
+	glUseProgram(shaderProgram);
+	glUniform1f(glGetUniformLocation(shaderProgram, "uScale"), (float)(1.0 / boxSize));
+	glUniform1f(glGetUniformLocation(shaderProgram, "uRadius"), (float)((3.5e-10 / 2) / boxSize));
+
+	//The integrator runs on its own thread from here on; the loop below only draws its snapshots
+	SimulationThread simulation(particles, neighborList, integrator, outputs, stepsPerFrame);
+	simulation.start();
+
+	//MAIN LOOP
+	//Loop of lines to call each iteration (not yet aware of the loop's frequency) while the window is open
+	profileThreadName("render");
+	int region = 0;
+	long long frames = 0;
+	double renderSeconds = 0.0;
+	while (!glfwWindowShouldClose(window))
+	{
+		MD_PROFILE_SCOPE("frame");
+		auto frameStart = std::chrono::steady_clock::now();
+		processInput(window);
+
+		//Keep drawing the previous positions if the integrator has not finished a new snapshot
+		if (simulation.snapshots.acquire())
+		{
+			const Snapshot& snapshot = simulation.snapshots.readBuffer();
+			region = (region + 1) % INSTANCE_REGIONS;
+			//Wait until the GPU has finished the draw that last read this region (three frames ago)
+			if (regionFence[region])
+			{
+				MD_PROFILE_SCOPE("fence wait");
+				while (glClientWaitSync(regionFence[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {}
+				glDeleteSync(regionFence[region]);
+				regionFence[region] = 0;
+			}
+			{
+				MD_PROFILE_SCOPE("upload");
+				MD_PROFILE_COUNT("bytes uploaded", regionBytes);
+				std::memcpy(instanceData + region * regionBytes, snapshot.centers.data(), regionBytes);
+			}
+			glBindVertexArray(VAO);
+			glBindVertexBuffer(1, instanceVBO, region * regionBytes, 2 * sizeof(float));
+		};
+
+		//Rendering commands
+		{
+			MD_PROFILE_SCOPE("draw");
+			glClearColor(0.8f, 0.8f, 0.8f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT);
+
+			glUseProgram(shaderProgram);
+			glBindVertexArray(VAO);
+			glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0, particles.n);
+			if (regionFence[region])
+			{
+				glDeleteSync(regionFence[region]);
+			}
+			regionFence[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+
+		simulation.frameRendered();
+		renderSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStart).count();
+		frames++;
+
+		{
+			MD_PROFILE_SCOPE("swap buffers");
+			glfwSwapBuffers(window);
+		}
+		glfwPollEvents();
+		if (offscreenFrames > 0 && frames >= offscreenFrames)
+		{
+			glfwSetWindowShouldClose(window, true);
+		}
+	}
+	if (frames > 0)
+	{
+		std::cout << "Render path: " << 1000.0 * renderSeconds / frames << " ms CPU/frame over " << frames
+			<< " frames (" << particles.n << " particles, " << simulation.stepCount() << " MD steps)" << std::endl;
+	}
+	simulation.stop();
+	integrator.report(particles, std::cout);
+	glfwTerminate();
+
+	return 0;
+}
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+	glViewport(0, 0, width, height);
+}
+
+void processInput(GLFWwindow* window)
+{
+	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+		glfwSetWindowShouldClose(window, true);
+}
+
+//Dodecagon vertices generator
+//Unit dodecagon around the origin: the center followed by the 12 corners, (x, y) each.
+//Computed once; the vertex shader scales it by the particle radius and moves it to each particle.
+std::array<float, 26> unitDodecagon()
+{
+	MD_PROFILE_SCOPE("dodecagon vertices");
+	std::array<float, 26> vertices;
+
+	// Dodecagon center coordinates
+	vertices[0] = 0.0f;
+	vertices[1] = 0.0f;
+
+	// Coordinates of the 12 vertices
+	for (int i = 0; i < 12; ++i) {
+		double angle = 2 * PI * i / 12; // Calculate the angle for each vertex
+		vertices[2 * (i + 1)] = (float)std::cos(angle);
+		vertices[2 * (i + 1) + 1] = (float)std::sin(angle);
+	}
+
+	return vertices;
+}
+
+//Triangle fan of the dodecagon as 12 triangles (center, corner, next corner)
+std::array<unsigned int, 36> dodecagonIndices()
+{
+	std::array<unsigned int, 36> indices;
+	for (int a = 0; a < 12; a++)
+	{
+		indices[3 * a] = 0;
+		indices[3 * a + 1] = a + 1;
+		indices[3 * a + 2] = a == 11 ? 1 : a + 2;
+	};
+	return indices;
+}
+
+#endif // MD_HEADLESS
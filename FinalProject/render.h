@@ -0,0 +1,15 @@
+// REAL-TIME 2D VISUALISATION
+// Not compiled in MD_HEADLESS builds, which need neither GLFW nor GLAD
+
+#pragma once
+
+#include "config.h"
+#include "integrator.h"
+#include "md.h"
+#include "neighbor.h"
+#include "output.h"
+
+// Opens the window and draws the system while a SimulationThread integrates it.
+// Returns the process exit code.
+int runInteractive(ParticleSystem& particles, NeighborList& neighborList, Integrator& integrator, RunOutputs& outputs,
+	const RunOptions& options);
@@ -0,0 +1,366 @@
+#include "replica.h"
+#include "philox.h"
+#include "profile.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <random>
+#include <vector>
+
+static const double KCAL_PER_MOL = 4184.0 / 6.02214076e23; // J per particle
+static const double PICOSECOND = 1e-12;
+
+// Word 3 of the Philox counter, so the streams of one key never overlap
+enum ReplicaStream : uint32_t { VelocityStream = 0, NoiseStream = 1, ExchangeStream = 2 };
+
+static_assert(PHILOX_LANES == LJ_BATCH_LANES, "one Philox stream per lane of a batch");
+
+namespace {
+
+// LJ_BATCH_LANES replicas in the interleaved layout of ljkernel.h
+struct ReplicaBatch
+{
+	std::vector<double> r, v, f;
+	int replica[LJ_BATCH_LANES];      // Replica of each lane, -1 for the padding of the last batch
+	double potential[LJ_BATCH_LANES]; // Pair energy (J) at the last step that asked for it
+};
+
+class ReplicaRunner
+{
+public:
+	ReplicaRunner(const RunOptions& options, std::ostream& out) : options(options), out(out) {}
+
+	bool setup(const ParticleSystem& ps);
+	void run();
+
+private:
+	uint32_t key(int replica) const { return (uint32_t)replica; }
+	double laneTemperature(const ReplicaBatch& b, int l) const { return b.replica[l] < 0 ? temperature : ladder[slotOf[b.replica[l]]]; }
+	void initialVelocities(ReplicaBatch& b);
+	// Steps from + 1 .. to of one batch; the potential is evaluated at step to
+	void advance(ReplicaBatch& b, long long from, long long to);
+	double kinetic(int replica) const;
+	void exchange();
+	void report(long long step);
+
+	const RunOptions& options;
+	std::ostream& out;
+	LJBatchKernel kernel = nullptr;
+	PhiloxLanes random = nullptr;
+	LJParams params;
+	int n = 0, replicas = 0;
+	uint32_t seed = 0;
+	std::vector<ReplicaBatch> batches;
+	std::vector<double> ladder;           // Temperatures (K) in ascending order, one slot per replica
+	std::vector<int> slotOf, replicaAt;   // Replica -> slot and slot -> replica
+	long long exchangeRounds = 0;
+	std::vector<long long> exchangeTries, exchangeAccepted; // Per pair of slots s, s + 1
+	std::vector<double> sumTemperature, sumPotential;       // Per slot, over the REPLICA samples
+	std::vector<long long> samples;
+	bool titled = false;
+};
+
+bool ReplicaRunner::setup(const ParticleSystem& ps)
+{
+	if (dimensions != 2) {
+		out << "ERROR: the replica batch kernels are 2D, replicas need dimensions 2" << std::endl;
+		return false;
+	}
+	if (!options.parameterFiles.empty()) {
+		out << "ERROR: replicas use the built-in Lennard-Jones potential, parameters is not supported" << std::endl;
+		return false;
+	}
+	if (options.numSteps <= 0) {
+		out << "ERROR: numsteps must be positive for replicas" << std::endl;
+		return false;
+	}
+	if (options.replicaExchange < 0 || options.langevinDamping < 0.0) {
+		out << "ERROR: replicaexchange and langevindamping must not be negative" << std::endl;
+		return false;
+	}
+	replicas = options.replicas;
+	n = ps.n;
+
+	// One temperature per replica, the ends of a geometric ladder, or one for all
+	const std::vector<double>& given = options.replicaTemperatures;
+	if (given.empty()) ladder.assign(replicas, temperature);
+	else if ((int)given.size() == replicas) ladder = given;
+	else if (given.size() == 1) ladder.assign(replicas, given[0]);
+	else if (given.size() == 2) {
+		ladder.resize(replicas);
+		for (int k = 0; k < replicas; ++k) {
+			ladder[k] = replicas > 1 ? given[0] * std::pow(given[1] / given[0], (double)k / (replicas - 1)) : given[0];
+		}
+	}
+	else {
+		out << "ERROR: replicatemperatures needs 1, 2 or " << replicas << " values, got " << given.size() << std::endl;
+		return false;
+	}
+	if (*std::min_element(ladder.begin(), ladder.end()) <= 0.0) {
+		out << "ERROR: replica temperatures must be positive" << std::endl;
+		return false;
+	}
+	// Replica k starts in slot k of the sorted ladder
+	std::sort(ladder.begin(), ladder.end());
+	slotOf.resize(replicas);
+	replicaAt.resize(replicas);
+	for (int k = 0; k < replicas; ++k) slotOf[k] = replicaAt[k] = k;
+	exchangeTries.assign(std::max(0, replicas - 1), 0);
+	exchangeAccepted.assign(exchangeTries.size(), 0);
+	sumTemperature.assign(replicas, 0.0);
+	sumPotential.assign(replicas, 0.0);
+	samples.assign(replicas, 0);
+
+	unsigned long long fullSeed = rngSeed;
+	if (fullSeed == 0) {
+		std::random_device rd;
+		fullSeed = ((unsigned long long)rd() << 32) | rd();
+	}
+	seed = (uint32_t)(fullSeed ^ (fullSeed >> 32));
+
+	kernel = selectLJBatchKernel();
+	random = kernel == ljBatchAVX512 ? philoxLanesAVX512 : kernel == ljBatchAVX2 ? philoxLanesAVX2 : philoxLanesScalar;
+	params = makeLJParams();
+	const int W = LJ_BATCH_LANES;
+	batches.resize((replicas + W - 1) / W);
+	for (size_t b = 0; b < batches.size(); ++b) {
+		ReplicaBatch& batch = batches[b];
+		batch.r.resize(2 * (size_t)n * W);
+		batch.v.resize(batch.r.size());
+		batch.f.resize(batch.r.size());
+		for (int l = 0; l < W; ++l) {
+			const int replica = (int)b * W + l;
+			batch.replica[l] = replica < replicas ? replica : -1;
+			for (int i = 0; i < n; ++i) {
+				batch.r[(size_t)i * W + l] = ps.x[i];
+				batch.r[((size_t)n + i) * W + l] = ps.y[i];
+			}
+		}
+		initialVelocities(batch);
+		kernel(params, n, batch.r.data(), batch.f.data(), batch.potential);
+	}
+
+	out << "Info: REPLICAS               " << replicas << " of " << n << " particles, " << batches.size() << " batches of "
+		<< W << ", LJ batch kernel " << ljBatchKernelName(kernel) << std::endl;
+	out << "Info: REPLICA TEMPERATURES  ";
+	for (double t : ladder) out << " " << t;
+	out << std::endl;
+	out << "Info: REPLICA EXCHANGE       ";
+	if (options.replicaExchange > 0 && replicas > 1) out << "every " << options.replicaExchange << " steps" << std::endl;
+	else out << "off" << std::endl;
+	out << "Info: REPLICA SEED           " << fullSeed << std::endl;
+	return true;
+}
+
+// Maxwell-Boltzmann velocities by Box-Muller, without center-of-mass motion and scaled to the
+// temperature of the lane
+void ReplicaRunner::initialVelocities(ReplicaBatch& b)
+{
+	const int W = LJ_BATCH_LANES;
+	for (int l = 0; l < W; ++l) {
+		const double T = laneTemperature(b, l);
+		double mean[2] = { 0.0, 0.0 };
+		for (int i = 0; i < n; ++i) {
+			const Philox4x32 u = philox4x32((uint32_t)i, 0, 0, VelocityStream, key(b.replica[l]), seed);
+			const double radius = std::sqrt(-2.0 * std::log(philoxUniform(u.v[0])));
+			const double angle = 2.0 * PI * philoxUniform(u.v[1]);
+			b.v[(size_t)i * W + l] = radius * std::cos(angle);
+			b.v[((size_t)n + i) * W + l] = radius * std::sin(angle);
+			mean[0] += b.v[(size_t)i * W + l];
+			mean[1] += b.v[((size_t)n + i) * W + l];
+		}
+		double v2 = 0.0;
+		for (int d = 0; d < 2; ++d) {
+			for (int i = 0; i < n; ++i) {
+				double& v = b.v[((size_t)d * n + i) * W + l];
+				if (n > 1) v -= mean[d] / n;
+				v2 += v * v;
+			}
+		}
+		const double scale = v2 > 0.0 ? std::sqrt(2.0 * n * Kb * T / (cMass * v2)) : 0.0;
+		for (int i = 0; i < 2 * n; ++i) b.v[(size_t)i * W + l] *= scale;
+	}
+}
+
+// BAOAB splitting of Langevin dynamics (Leimkuhler and Matthews, Appl. Math. Res. Express 2013):
+// half kick, half drift, exact Ornstein-Uhlenbeck velocity update, half drift, force, half kick.
+// The update is exact only with Gaussian noise, drawn by Box-Muller as the initial velocities.
+void ReplicaRunner::advance(ReplicaBatch& b, long long from, long long to)
+{
+	const int W = LJ_BATCH_LANES;
+	const size_t size = b.r.size();
+	const double halfDt = 0.5 * dt, kick = 0.5 * dt / cMass;
+	const double c1 = std::exp(-options.langevinDamping * dt);
+	double noise[LJ_BATCH_LANES];
+	uint32_t keys[LJ_BATCH_LANES], bits[4 * LJ_BATCH_LANES];
+	for (int l = 0; l < W; ++l) {
+		noise[l] = std::sqrt((1.0 - c1 * c1) * Kb * laneTemperature(b, l) / cMass);
+		keys[l] = key(b.replica[l]);
+	}
+	double* v = b.v.data();
+	const double* f = b.f.data();
+	// A particle moves far less than a box per step, so one shift brings it back
+	auto wrap = [](double* r, size_t count, double L) {
+		for (size_t k = 0; k < count; ++k) {
+			if (r[k] >= 0.5 * L) r[k] -= L;
+			else if (r[k] < -0.5 * L) r[k] += L;
+		}
+	};
+
+	for (long long step = from + 1; step <= to; ++step) {
+		for (size_t k = 0; k < size; ++k) {
+			v[k] += kick * f[k];
+			b.r[k] += halfDt * v[k];
+		}
+		// One Philox block per lane holds the noise of two particles, a Box-Muller pair each
+		for (int i = 0; i < n; i += 2) {
+			random((uint32_t)step, (uint32_t)(step >> 32), (uint32_t)i, NoiseStream, keys, seed, bits);
+			for (int h = 0; h < 2 && i + h < n; ++h) {
+				double* vx = v + (size_t)(i + h) * W;
+				double* vy = v + ((size_t)n + i + h) * W;
+				for (int l = 0; l < W; ++l) {
+					const double radius = noise[l] * std::sqrt(-2.0 * std::log(philoxUniform(bits[2 * h * W + l])));
+					const double angle = 2.0 * PI * philoxUniform(bits[(2 * h + 1) * W + l]);
+					vx[l] = c1 * vx[l] + radius * std::cos(angle);
+					vy[l] = c1 * vy[l] + radius * std::sin(angle);
+				}
+			}
+		}
+		for (size_t k = 0; k < size; ++k) b.r[k] += halfDt * v[k];
+		wrap(b.r.data(), (size_t)n * W, LW);
+		wrap(b.r.data() + (size_t)n * W, (size_t)n * W, LH);
+		kernel(params, n, b.r.data(), b.f.data(), step == to ? b.potential : nullptr);
+		for (size_t k = 0; k < size; ++k) v[k] += kick * f[k];
+	}
+}
+
+double ReplicaRunner::kinetic(int replica) const
+{
+	const ReplicaBatch& b = batches[replica / LJ_BATCH_LANES];
+	const int l = replica % LJ_BATCH_LANES;
+	double v2 = 0.0;
+	for (int k = 0; k < 2 * n; ++k) v2 += b.v[(size_t)k * LJ_BATCH_LANES + l] * b.v[(size_t)k * LJ_BATCH_LANES + l];
+	return 0.5 * cMass * v2;
+}
+
+// Metropolis swaps of the temperatures of neighboring slots, the even pairs and the odd pairs in
+// turn. Accepted swaps scale the velocities to the new temperature, so no re-equilibration is needed.
+void ReplicaRunner::exchange()
+{
+	const int W = LJ_BATCH_LANES;
+	MD_PROFILE_SCOPE("replica exchange");
+	const long long attempt = exchangeRounds++;
+	for (int s = (int)(attempt % 2); s + 1 < replicas; s += 2) {
+		const int a = replicaAt[s], c = replicaAt[s + 1];
+		const double Ua = batches[a / W].potential[a % W], Uc = batches[c / W].potential[c % W];
+		const double delta = (1.0 / (Kb * ladder[s]) - 1.0 / (Kb * ladder[s + 1])) * (Ua - Uc);
+		const Philox4x32 u = philox4x32((uint32_t)attempt, (uint32_t)(attempt >> 32), (uint32_t)s, ExchangeStream, 0, seed);
+		exchangeTries[s]++;
+		if (delta < 0.0 && philoxUniform(u.v[0]) >= std::exp(delta)) continue;
+		exchangeAccepted[s]++;
+		std::swap(replicaAt[s], replicaAt[s + 1]);
+		slotOf[a] = s + 1;
+		slotOf[c] = s;
+		const double up = std::sqrt(ladder[s + 1] / ladder[s]);
+		for (int k = 0; k < 2 * n; ++k) {
+			batches[a / W].v[(size_t)k * W + a % W] *= up;
+			batches[c / W].v[(size_t)k * W + c % W] /= up;
+		}
+	}
+}
+
+// Same layout as the ENERGY lines: RTITLE once, then a REPLICA line per replica
+void ReplicaRunner::report(long long step)
+{
+	if (!titled) {
+		out << "RTITLE:" << std::setw(8) << "TS" << std::setw(15) << "REPLICA" << std::setw(15) << "TEMPTARGET" << std::setw(15)
+			<< "POTENTIAL" << std::setw(15) << "KINETIC" << std::setw(15) << "TEMP" << "\n\n";
+		titled = true;
+	}
+	for (int k = 0; k < replicas; ++k) {
+		const int s = slotOf[k];
+		const double K = kinetic(k), U = batches[k / LJ_BATCH_LANES].potential[k % LJ_BATCH_LANES];
+		const double T = K / (n * Kb);
+		sumTemperature[s] += T;
+		sumPotential[s] += U;
+		samples[s]++;
+		out << "REPLICA:" << std::setw(7) << step << std::setw(15) << k << std::fixed << std::setprecision(4) << std::setw(15)
+			<< ladder[s] << std::setw(15) << U / KCAL_PER_MOL << std::setw(15) << K / KCAL_PER_MOL << std::setw(15) << T
+			<< std::defaultfloat << std::setprecision(6) << "\n";
+	}
+	out << "\n" << std::flush;
+}
+
+void ReplicaRunner::run()
+{
+	ThreadPool& tp = threadPool();
+	const int T = tp.size();
+	const long long total = options.numSteps;
+	const int outputFreq = options.outputEnergies;
+	const int exchangeFreq = replicas > 1 ? options.replicaExchange : 0;
+	if (outputFreq > 0) report(0);
+
+	auto start = std::chrono::steady_clock::now();
+	long long step = 0;
+	while (step < total) {
+		// Each batch runs on its own up to the next step that needs all of them
+		long long next = total;
+		if (outputFreq > 0) next = std::min(next, (step / outputFreq + 1) * outputFreq);
+		if (exchangeFreq > 0) next = std::min(next, (step / exchangeFreq + 1) * exchangeFreq);
+		tp.run([&](int t) {
+			MD_PROFILE_SCOPE("replica batches");
+			int begin, end;
+			splitRange((int)batches.size(), T, t, begin, end);
+			for (int b = begin; b < end; ++b) advance(batches[b], step, next);
+		});
+		step = next;
+		if (exchangeFreq > 0 && step % exchangeFreq == 0) exchange();
+		if (outputFreq > 0 && (step % outputFreq == 0 || step == total)) {
+			report(step);
+			profileSummary(out, std::to_string(step));
+		}
+	}
+	const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	// Slots of the same temperature sample the same ensemble and are reported together
+	for (int s = 0; s < replicas;) {
+		double temperatureSum = 0.0, potentialSum = 0.0;
+		long long count = 0;
+		int next = s;
+		for (; next < replicas && ladder[next] == ladder[s]; ++next) {
+			temperatureSum += sumTemperature[next];
+			potentialSum += sumPotential[next];
+			count += samples[next];
+		}
+		if (count > 0) {
+			out << "Info: REPLICA TEMPERATURE " << ladder[s] << " K: mean temperature " << temperatureSum / count
+				<< " K, mean potential " << potentialSum / count / KCAL_PER_MOL << " kcal/mol over " << count
+				<< " samples" << std::endl;
+		}
+		s = next;
+	}
+	for (size_t s = 0; s < exchangeTries.size(); ++s) {
+		if (exchangeTries[s] == 0) continue;
+		out << "Info: REPLICA EXCHANGE " << ladder[s] << " K <-> " << ladder[s + 1] << " K: accepted " << exchangeAccepted[s]
+			<< " of " << exchangeTries[s] << " (" << 100.0 * exchangeAccepted[s] / exchangeTries[s] << "%)" << std::endl;
+	}
+	const double particleSteps = (double)replicas * n * total;
+	out << "Info: REPLICAS ran " << total << " steps in " << elapsed << " s, " << elapsed / particleSteps * 1e9
+		<< " ns per particle step" << std::endl;
+}
+
+}
+
+bool runReplicas(const RunOptions& options, const ParticleSystem& ps, std::ostream& out)
+{
+	if (!options.dcdFile.empty() || !options.restartName.empty() || !options.gofrFile.empty() || !options.densityFile.empty()) {
+		out << "Warning: replica runs write no trajectory, checkpoint or analysis files" << std::endl;
+	}
+	ReplicaRunner runner(options, out);
+	if (!runner.setup(ps)) return false;
+	runner.run();
+	return true;
+}
@@ -0,0 +1,20 @@
+// REPLICA ENSEMBLES
+// Many independent copies of a small system advanced in lockstep by one process. The replicas
+// are stored interleaved in batches of LJ_BATCH_LANES, so a nine-particle cell fills the vector
+// units lane by lane and the batches fill the threads. Optionally, replicas at neighboring
+// temperatures swap temperatures by Metropolis exchange (replica-exchange MD).
+
+#pragma once
+
+#include <ostream>
+
+#include "config.h"
+#include "md.h"
+
+// Runs options.replicas copies of ps for options.numSteps steps of Langevin dynamics (BAOAB) at
+// the temperatures of options.replicaTemperatures, attempting exchanges every
+// options.replicaExchange steps. The velocities, the thermostat noise and the exchanges come
+// from Philox streams keyed by replica and seed, so the output is the same for any number of
+// threads. Prints REPLICA lines every outputEnergies steps and a summary per temperature.
+// Prints the reason and returns false on bad settings.
+bool runReplicas(const RunOptions& options, const ParticleSystem& ps, std::ostream& out);
@@ -0,0 +1,23 @@
+// SIMD SUPPORT
+// Intrinsics and the attributes that let single functions use a wider instruction set than the
+// rest of the build; callers check the CPU before calling them.
+
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX instructions inside functions that ask for them;
+// MSVC accepts the intrinsics anywhere.
+#if defined(__GNUC__) || defined(__clang__)
+#define MD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define MD_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define MD_TARGET_AVX2
+#define MD_TARGET_AVX512
+#endif
@@ -0,0 +1,142 @@
+#include "simulation.h"
+#include "profile.h"
+
+#include <chrono>
+#include <ctime>
+#include <iostream>
+
+SimulationThread::SimulationThread(ParticleSystem& ps, NeighborList& nl, Integrator& integrator, RunOutputs& outputs, int stepsPerFrame)
+	: ps(ps), nl(nl), integrator(integrator), outputs(outputs), stepsPerFrame(stepsPerFrame)
+{
+	// The renderer has something to draw before the first step finishes
+	takeSnapshot(ps, 0, snapshots.writeBuffer());
+	snapshots.publish();
+}
+
+SimulationThread::~SimulationThread()
+{
+	stop();
+}
+
+void SimulationThread::start()
+{
+	stopRequested = false;
+	worker = std::thread(&SimulationThread::loop, this);
+}
+
+void SimulationThread::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(pacingMutex);
+		stopRequested = true;
+	}
+	pacing.notify_one();
+	if (worker.joinable()) worker.join();
+}
+
+void SimulationThread::frameRendered()
+{
+	{
+		std::lock_guard<std::mutex> lock(pacingMutex);
+		framesRendered++;
+	}
+	pacing.notify_one();
+}
+
+void SimulationThread::loop()
+{
+	profileThreadName("simulation");
+	while (!stopRequested) {
+		long long s = step.load(std::memory_order_relaxed);
+		if (stepsPerFrame > 0 && s >= (framesRendered + 1) * stepsPerFrame) {
+			// This frame's steps are done: sleep until the renderer presents it
+			MD_PROFILE_SCOPE("pacing wait");
+			std::unique_lock<std::mutex> lock(pacingMutex);
+			pacing.wait(lock, [&] { return stopRequested || s < (framesRendered + 1) * stepsPerFrame; });
+			continue;
+		}
+
+		if (s % 100000 == 0)
+		{
+			std::cout << "Time: " << integrator.time() * 1e12 << " picoseconds" << std::endl;
+			nl.printStats(std::cout);
+			if (s > 0) profileSummary(std::cout, std::to_string(s));
+		};
+
+		integrator.step(ps, nl);
+		step.store(s + 1, std::memory_order_relaxed);
+		outputs.stepDone(ps, nl, s + 1);
+
+		// Paced runs show the end of every batch. Free-running ones only copy positions
+		// out when the renderer has taken the previous snapshot.
+		if (stepsPerFrame > 0 ? (s + 1) % stepsPerFrame == 0 : !snapshots.pending()) {
+			publishSnapshot();
+		}
+	}
+}
+
+void SimulationThread::publishSnapshot()
+{
+	takeSnapshot(ps, step.load(std::memory_order_relaxed), snapshots.writeBuffer());
+	snapshots.publish();
+}
+
+void runHeadless(ParticleSystem& ps, NeighborList& nl, Integrator& integrator, RunOutputs& outputs, long long numSteps, int outputTiming)
+{
+	typedef std::chrono::steady_clock Clock;
+	const Clock::time_point wallStart = Clock::now();
+	const std::clock_t cpuStart = std::clock();
+	Clock::time_point intervalStart = wallStart;
+	// With an adaptive timestep, ns/day comes from the simulated time rather than from dt
+	double intervalTime = integrator.time();
+
+	for (long long s = 0; s < numSteps; ++s) {
+		if (s % 100000 == 0)
+		{
+			std::cout << "Time: " << integrator.time() * 1e12 << " picoseconds" << std::endl;
+			nl.printStats(std::cout);
+		};
+
+		integrator.step(ps, nl);
+
+		long long done = s + 1;
+		outputs.stepDone(ps, nl, done);
+		if (outputTiming > 0 && (done % outputTiming == 0 || done == numSteps)) {
+			Clock::time_point now = Clock::now();
+			double wall = std::chrono::duration<double>(now - wallStart).count();
+			double cpu = (double)(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+			long long intervalSteps = done % outputTiming == 0 ? outputTiming : done % outputTiming;
+			double perStep = std::chrono::duration<double>(now - intervalStart).count() / intervalSteps;
+			double nsPerStep = (integrator.time() - intervalTime) * 1e9 / intervalSteps;
+			double hoursLeft = perStep * (numSteps - done) / 3600.0;
+			std::cout << "TIMING: " << done << "  CPU: " << cpu << ", " << cpu / done << "/step"
+				<< "  Wall: " << wall << ", " << perStep << "/step, " << hoursLeft << " hours remaining, "
+				<< nsPerStep / perStep * 86400.0 << " ns/day" << std::endl;
+			profileSummary(std::cout, std::to_string(done));
+			intervalStart = now;
+			intervalTime = integrator.time();
+		}
+	}
+
+	double perStep = std::chrono::duration<double>(Clock::now() - wallStart).count() / numSteps;
+	double nsPerStep = integrator.time() * 1e9 / numSteps;
+	double nsPerDay = nsPerStep / perStep * 86400.0;
+	std::cout << "Info: Benchmark time: " << threadCount() << " CPUs " << perStep << " s/step "
+		<< 1.0 / nsPerDay << " days/ns " << nsPerDay << " ns/day, "
+		<< perStep / ps.n * 1e9 << " ns/particle-step" << std::endl;
+	nl.printStats(std::cout);
+	integrator.report(ps, std::cout);
+}
+
+void takeSnapshot(const ParticleSystem& ps, long long step, Snapshot& snapshot)
+{
+	MD_PROFILE_SCOPE("snapshot");
+	MD_PROFILE_COUNT("snapshot bytes", 2 * sizeof(float) * ps.n);
+	snapshot.step = step;
+	snapshot.centers.resize(2 * ps.n);
+	float* c = snapshot.centers.data();
+	for (int i = 0; i < ps.n; ++i) {
+		c[2 * i] = (float)ps.x[i];
+		c[2 * i + 1] = (float)ps.y[i];
+	}
+}
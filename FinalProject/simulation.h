@@ -0,0 +1,63 @@
+// SIMULATION THREAD
+// Runs the MD integrator on its own thread and hands position snapshots to the renderer
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "integrator.h"
+#include "md.h"
+#include "neighbor.h"
+#include "output.h"
+#include "triplebuffer.h"
+
+// Positions at one step, interleaved (x0, y0, x1, y1, ...) in meters
+struct Snapshot
+{
+	long long step = 0;
+	std::vector<float> centers;
+};
+
+class SimulationThread
+{
+public:
+	// stepsPerFrame > 0 advances that many steps per rendered frame; 0 runs as fast as possible.
+	// integrator advances the particles and outputs receives every step, both on the simulation thread.
+	SimulationThread(ParticleSystem& ps, NeighborList& nl, Integrator& integrator, RunOutputs& outputs, int stepsPerFrame);
+	~SimulationThread();
+
+	void start();
+	void stop();
+	// Called by the renderer once per frame; releases the next batch of steps in paced mode
+	void frameRendered();
+	long long stepCount() const { return step.load(std::memory_order_relaxed); }
+
+	TripleBuffer<Snapshot> snapshots;
+
+private:
+	void loop();
+	void publishSnapshot();
+
+	ParticleSystem& ps;
+	NeighborList& nl;
+	Integrator& integrator;
+	RunOutputs& outputs;
+	const int stepsPerFrame;
+	std::thread worker;
+	std::atomic<bool> stopRequested{ false };
+	std::atomic<long long> step{ 0 };
+	std::atomic<long long> framesRendered{ 0 };
+	std::mutex pacingMutex;
+	std::condition_variable pacing;
+};
+
+// Batch run without any window: integrates numSteps steps on the calling thread and prints
+// NAMD-style TIMING lines every outputTiming steps, and the Benchmark line and integrator report at the end
+void runHeadless(ParticleSystem& ps, NeighborList& nl, Integrator& integrator, RunOutputs& outputs, long long numSteps, int outputTiming);
+
+// Copies the current positions into a snapshot
+void takeSnapshot(const ParticleSystem& ps, long long step, Snapshot& snapshot);
@@ -0,0 +1,157 @@
+#include "spatialsort.h"
+
+#include <algorithm>
+#include <utility>
+
+// Spreads the 32 bits of v over the even bits of the result
+static uint64_t spreadBits(uint32_t v)
+{
+	uint64_t x = v;
+	x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+	x = (x | (x << 8)) & 0x00FF00FF00FF00FFull;
+	x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0Full;
+	x = (x | (x << 2)) & 0x3333333333333333ull;
+	x = (x | (x << 1)) & 0x5555555555555555ull;
+	return x;
+}
+
+// Spreads the low 21 bits of v over every third bit of the result
+static uint64_t spreadBits3(uint32_t v)
+{
+	uint64_t x = v & 0x1FFFFF;
+	x = (x | (x << 32)) & 0x001F00000000FFFFull;
+	x = (x | (x << 16)) & 0x001F0000FF0000FFull;
+	x = (x | (x << 8)) & 0x100F00F00F00F00Full;
+	x = (x | (x << 4)) & 0x10C30C30C30C30C3ull;
+	x = (x | (x << 2)) & 0x1249249249249249ull;
+	return x;
+}
+
+uint64_t mortonKey(uint32_t cx, uint32_t cy)
+{
+	return spreadBits(cx) | (spreadBits(cy) << 1);
+}
+
+uint64_t mortonKey(uint32_t cx, uint32_t cy, uint32_t cz)
+{
+	return spreadBits3(cx) | (spreadBits3(cy) << 1) | (spreadBits3(cz) << 2);
+}
+
+// The quadrant of each level in turn, from the coarsest, with the coordinates rotated and
+// reflected into the frame of that quadrant's sub-curve
+uint64_t hilbertKey(uint32_t cx, uint32_t cy, int bits)
+{
+	const uint32_t side = 1u << bits;
+	uint64_t key = 0;
+	for (uint32_t s = side >> 1; s > 0; s >>= 1) {
+		const uint32_t rx = (cx & s) ? 1 : 0;
+		const uint32_t ry = (cy & s) ? 1 : 0;
+		key += (uint64_t)s * s * ((3 * rx) ^ ry);
+		if (ry == 0) {
+			if (rx == 1) {
+				cx = side - 1 - cx;
+				cy = side - 1 - cy;
+			}
+			std::swap(cx, cy);
+		}
+	}
+	return key;
+}
+
+// Skilling's transform (AIP Conf. Proc. 707, 381, 2004): the coordinates are turned, level by
+// level, into the "transposed" Hilbert index, whose bits interleaved give the key
+uint64_t hilbertKey(uint32_t cx, uint32_t cy, uint32_t cz, int bits)
+{
+	uint32_t X[3] = { cx, cy, cz };
+	const uint32_t top = 1u << (bits - 1);
+	for (uint32_t q = top; q > 1; q >>= 1) {
+		const uint32_t p = q - 1;
+		for (int i = 0; i < 3; ++i) {
+			if (X[i] & q) X[0] ^= p;
+			else {
+				const uint32_t t = (X[0] ^ X[i]) & p;
+				X[0] ^= t;
+				X[i] ^= t;
+			}
+		}
+	}
+	// Gray encode
+	X[1] ^= X[0];
+	X[2] ^= X[1];
+	uint32_t t = 0;
+	for (uint32_t q = top; q > 1; q >>= 1) {
+		if (X[2] & q) t ^= q - 1;
+	}
+	uint64_t key = 0;
+	for (int b = bits - 1; b >= 0; --b) {
+		for (int i = 0; i < 3; ++i) key = (key << 1) | (((X[i] ^ t) >> b) & 1);
+	}
+	return key;
+}
+
+void spatialOrder(const ParticleSystem& ps, double cellSize, const std::string& curve, std::vector<int>& order)
+{
+	CellList grid;
+	grid.build(ps, cellSize);
+	const int cells = grid.nx * grid.ny * grid.nz;
+	const bool threeD = dimensions == 3;
+	int bits = 1;
+	while ((1 << bits) < std::max(std::max(grid.nx, grid.ny), grid.nz)) bits++;
+	std::vector<std::pair<uint64_t, int>> keyed(cells);
+	for (int c = 0; c < cells; ++c) {
+		const uint32_t cx = c % grid.nx, cy = c / grid.nx % grid.ny, cz = c / grid.nx / grid.ny;
+		if (threeD) keyed[c] = { curve == "morton" ? mortonKey(cx, cy, cz) : hilbertKey(cx, cy, cz, bits), c };
+		else keyed[c] = { curve == "morton" ? mortonKey(cx, cy) : hilbertKey(cx, cy, bits), c };
+	}
+	std::sort(keyed.begin(), keyed.end());
+
+	// Counting sort of the particles by the rank of their cell, stable within a cell
+	std::vector<int> cellOf(ps.n), start(cells, 0);
+	for (int i = 0; i < ps.n; ++i) {
+		cellOf[i] = threeD ? grid.cellOf(ps.x[i], ps.y[i], ps.z[i]) : grid.cellOf(ps.x[i], ps.y[i]);
+		start[cellOf[i]]++;
+	}
+	int slot = 0;
+	for (const std::pair<uint64_t, int>& cell : keyed) {
+		const int count = start[cell.second];
+		start[cell.second] = slot;
+		slot += count;
+	}
+	order.resize(ps.n);
+	for (int i = 0; i < ps.n; ++i) order[start[cellOf[i]]++] = i;
+}
+
+void permuteParticles(ParticleSystem& ps, const std::vector<int>& order)
+{
+	permuteArray(ps.x, order);
+	permuteArray(ps.y, order);
+	permuteArray(ps.xOld, order);
+	permuteArray(ps.yOld, order);
+	permuteArray(ps.ax, order);
+	permuteArray(ps.ay, order);
+	if (!ps.z.empty()) {
+		permuteArray(ps.z, order);
+		permuteArray(ps.zOld, order);
+		permuteArray(ps.az, order);
+	}
+	permuteArray(ps.type, order);
+	permuteArray(ps.id, order);
+}
+
+double neighborCacheLines(const NeighborList& nl)
+{
+	const int n = (int)nl.offsets.size() - 1;
+	if (n <= 0) return 0.0;
+	const int perLine = 64 / sizeof(double);
+	long long lines = 0;
+	for (int i = 0; i < n; ++i) {
+		// Rows are sorted, so a new line starts wherever the line index changes
+		int last = -1;
+		for (int k = nl.offsets[i]; k < nl.offsets[i + 1]; ++k) {
+			const int line = nl.neighbors[k] / perLine;
+			if (line != last) lines++;
+			last = line;
+		}
+	}
+	return (double)lines / n;
+}
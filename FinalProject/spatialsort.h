@@ -0,0 +1,44 @@
+// SPATIAL SORTING
+// Reorders the particles along a space-filling curve through a cell grid, so that particles
+// close in space are close in memory and the neighbor lookups of the force loop hit the cache.
+// ps.id keeps the original index of every particle, which the output files are written in.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "md.h"
+#include "neighbor.h"
+
+// Position of cell (cx, cy) along the Z-order curve: the bits of cx and cy interleaved
+uint64_t mortonKey(uint32_t cx, uint32_t cy);
+// Position of cell (cx, cy) along the Hilbert curve through a 2^bits x 2^bits grid. Unlike the
+// Z-order curve it never jumps, so consecutive cells always share an edge.
+uint64_t hilbertKey(uint32_t cx, uint32_t cy, int bits);
+// The same for cell (cx, cy, cz) of a 3D grid, with bits up to 21
+uint64_t mortonKey(uint32_t cx, uint32_t cy, uint32_t cz);
+uint64_t hilbertKey(uint32_t cx, uint32_t cy, uint32_t cz, int bits);
+
+// order[k] is the particle that goes to slot k: the cells of a grid of cells at least cellSize
+// wide in the order of curve ("hilbert" or "morton"), the particles of one cell in their current order
+void spatialOrder(const ParticleSystem& ps, double cellSize, const std::string& curve, std::vector<int>& order);
+
+// a[k] = old a[order[k]], for any per-particle array. The result is copied back rather than
+// swapped in, so the array keeps its storage and views of it (mdapi.h) stay valid.
+template <typename T>
+void permuteArray(std::vector<T>& a, const std::vector<int>& order)
+{
+	std::vector<T> sorted(a.size());
+	for (size_t k = 0; k < order.size(); ++k) sorted[k] = a[order[k]];
+	std::copy(sorted.begin(), sorted.end(), a.begin());
+}
+
+// Applies order to every array of ps: positions, previous positions, accelerations, types and ids
+void permuteParticles(ParticleSystem& ps, const std::vector<int>& order);
+
+// Mean number of distinct 64-byte lines of a coordinate array holding the neighbors of one
+// particle, a proxy for the cache misses of the force loop that does not need hardware counters
+double neighborCacheLines(const NeighborList& nl);
@@ -0,0 +1,71 @@
+#include "threadpool.h"
+#include "profile.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threads)
+{
+	for (int tid = 1; tid < std::max(threads, 1); ++tid) {
+		workers.emplace_back(&ThreadPool::workerLoop, this, tid);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread& worker : workers) worker.join();
+}
+
+void ThreadPool::run(const std::function<void(int)>& job)
+{
+	if (workers.empty()) {
+		job(0);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		task = &job;
+		pending = (int)workers.size();
+		generation++;
+	}
+	wake.notify_all();
+	job(0);
+	// Time the caller spends waiting for the slowest worker
+	MD_PROFILE_SCOPE("pool wait");
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return pending == 0; });
+	task = nullptr;
+}
+
+void ThreadPool::workerLoop(int tid)
+{
+	profileThreadName("worker " + std::to_string(tid));
+	unsigned long long seen = 0;
+	while (true) {
+		const std::function<void(int)>* job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return stopping || generation != seen; });
+			if (stopping) return;
+			seen = generation;
+			job = task;
+		}
+		(*job)(tid);
+		bool last;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			last = --pending == 0;
+		}
+		if (last) done.notify_one();
+	}
+}
+
+void splitRange(int n, int nThreads, int tid, int& begin, int& end)
+{
+	begin = (int)((long long)n * tid / nThreads);
+	end = (int)((long long)n * (tid + 1) / nThreads);
+}
@@ -0,0 +1,38 @@
+// THREAD POOL
+// Persistent worker threads that execute one task on every thread and wait for all of them
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+	// Starts threads - 1 workers; the calling thread acts as thread 0 inside run()
+	explicit ThreadPool(int threads);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	int size() const { return (int)workers.size() + 1; }
+	// Calls task(tid) once for every tid in [0, size()) and returns when all calls have finished
+	void run(const std::function<void(int)>& task);
+
+private:
+	void workerLoop(int tid);
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	const std::function<void(int)>* task = nullptr;
+	unsigned long long generation = 0;
+	int pending = 0;
+	bool stopping = false;
+};
+
+// Contiguous, near-equal share [begin, end) of n items for thread tid out of nThreads
+void splitRange(int n, int nThreads, int tid, int& begin, int& end);
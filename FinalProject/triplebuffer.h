@@ -0,0 +1,48 @@
+// TRIPLE BUFFER
+// Lock-free single-producer/single-consumer hand-off of the latest complete value.
+// The writer fills its back buffer and swaps it with the shared middle slot; the reader
+// swaps its front buffer with the middle slot when a new value is there. Neither side
+// ever waits for the other, and the reader always sees a fully written value.
+
+#pragma once
+
+#include <atomic>
+
+template <typename T>
+class TripleBuffer
+{
+public:
+	// Buffer the writer may fill; it is not visible to the reader until publish()
+	T& writeBuffer() { return buffers[back]; }
+
+	void publish()
+	{
+		back = middle.exchange(back | freshBit, std::memory_order_acq_rel) & indexMask;
+	}
+
+	// True while the last published value has not been picked up by the reader
+	bool pending() const
+	{
+		return (middle.load(std::memory_order_acquire) & freshBit) != 0;
+	}
+
+	// Takes the newest published value if there is one. Returns false if nothing new arrived.
+	bool acquire()
+	{
+		if (!pending()) return false;
+		front = middle.exchange(front, std::memory_order_acq_rel) & indexMask;
+		return true;
+	}
+
+	// Value taken by the last successful acquire()
+	const T& readBuffer() const { return buffers[front]; }
+
+private:
+	static const int indexMask = 3;
+	static const int freshBit = 4;
+
+	T buffers[3];
+	int front = 0;
+	int back = 1;
+	std::atomic<int> middle{ 2 };
+};